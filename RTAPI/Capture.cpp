@@ -0,0 +1,264 @@
+#include "Capture.h"
+
+#include <cstring>
+
+//record layout: op byte, ints, then floats or doubles, then the op's extra
+//(pointer offset, or byte count + bytes for rtBufferData)
+static int intCount(CaptureOp op)
+{
+	switch (op)
+	{
+	case CAPTURE_GEN_BUFFERS:
+	case CAPTURE_ENABLE_CLIENT:
+	case CAPTURE_DISABLE_CLIENT:
+	case CAPTURE_ENABLE:
+	case CAPTURE_DISABLE:
+	case CAPTURE_MATERIAL:
+	case CAPTURE_DISPATCH:
+	case CAPTURE_TRAVERSAL:
+	case CAPTURE_FETCH:
+	case CAPTURE_SCHEDULE:
+	case CAPTURE_ANTIALIAS:
+	case CAPTURE_SAMPLER:
+	case CAPTURE_DENOISE:
+		return 1;
+	case CAPTURE_INIT:
+	case CAPTURE_BIND_BUFFER:
+	case CAPTURE_LIGHT_SAMPLING:
+	case CAPTURE_RATE_MAP:
+		return 2;
+	case CAPTURE_BUFFER_DATA:
+	case CAPTURE_LIGHT:
+	case CAPTURE_VERTEX_POINTER:
+	case CAPTURE_COLOR_POINTER:
+	case CAPTURE_NORMAL_POINTER:
+	case CAPTURE_DRAW_ARRAYS:
+		return 3;
+	default:
+		return 0;
+	}
+}
+
+static int floatCount(CaptureOp op)
+{
+	switch (op)
+	{
+	case CAPTURE_MATERIAL: return 1;
+	case CAPTURE_LIGHT: return 4;
+	case CAPTURE_MODELVIEW: return 16;
+	default: return 0;
+	}
+}
+
+static int doubleCount(CaptureOp op)
+{
+	switch (op)
+	{
+	case CAPTURE_PERSPECTIVE: return 4;
+	case CAPTURE_LOOK_AT: return 9;
+	case CAPTURE_ADAPTIVE: return 2;
+	case CAPTURE_REPROJECTION: return 1;
+	case CAPTURE_FOVEATION: return 3;
+	case CAPTURE_PATH_TERMINATION: return 2;
+	default: return 0;
+	}
+}
+
+CaptureLog& Capture()
+{
+	static CaptureLog log;
+	return log;
+}
+
+CaptureLog::CaptureLog()
+	:file(NULL), bytes(0), hasModelview(false)
+{
+}
+
+CaptureLog::~CaptureLog()
+{
+	Open(NULL);
+}
+
+bool CaptureLog::Open(const char* path)
+{
+	if (file != NULL) fclose(file);
+	file = NULL;
+	bytes = 0;
+	hasModelview = false;
+	if (path == NULL) return true;
+
+	if ((file = fopen(path, "wb")) == NULL)
+	{
+		printf("can not open capture %s\n", path);
+		return false;
+	}
+	uint32_t version = CAPTURE_VERSION;
+	Write(CAPTURE_MAGIC, 4);
+	Write(&version, sizeof(version));
+	return true;
+}
+
+void CaptureLog::Write(const void* data, size_t size)
+{
+	if (file == NULL) return;
+	if (fwrite(data, 1, size, file) != size)
+	{
+		//disk full, keep what is written and stop
+		printf("capture write failed, capture stopped\n");
+		fclose(file);
+		file = NULL;
+		return;
+	}
+	bytes += size;
+}
+
+void CaptureLog::Ints(CaptureOp op, int a, int b, int c, int d)
+{
+	int32_t values[4] = { a, b, c, d };
+	uint8_t code = (uint8_t)op;
+	Write(&code, 1);
+	Write(values, sizeof(int32_t) * intCount(op));
+}
+
+void CaptureLog::BufferData(unsigned target, unsigned usage, uint64_t size, const void* data)
+{
+	//glBufferData(target, size, NULL, usage) only allocates, no bytes follow
+	Ints(CAPTURE_BUFFER_DATA, (int)target, (int)usage, data != NULL);
+	Write(&size, sizeof(size));
+	if (data != NULL) Write(data, (size_t)size);
+}
+
+void CaptureLog::Pointer(CaptureOp op, int size, unsigned type, int stride, uint64_t offset)
+{
+	Ints(op, size, (int)type, stride);
+	Write(&offset, sizeof(offset));
+}
+
+void CaptureLog::Doubles(CaptureOp op, const double* values, int count)
+{
+	if (count != doubleCount(op)) return;
+	Ints(op);
+	Write(values, sizeof(double) * count);
+}
+
+void CaptureLog::Light(unsigned light, unsigned pname, const float* params)
+{
+	//RT_LIGHT_RANGE passes one value, position and colors four
+	int count = pname == RT_LIGHT_RANGE ? 1 : 4;
+	float values[4] = { 0, 0, 0, 0 };
+	memcpy(values, params, sizeof(float) * count);
+	Ints(CAPTURE_LIGHT, (int)light, (int)pname, count);
+	Write(values, sizeof(values));
+}
+
+void CaptureLog::Material(int type, float rIndex)
+{
+	Ints(CAPTURE_MATERIAL, type);
+	Write(&rIndex, sizeof(float));
+}
+
+void CaptureLog::RateMap(int width, int height, const unsigned char* rates)
+{
+	Ints(CAPTURE_RATE_MAP, width, height);
+	uint64_t size = (uint64_t)width * height;
+	Write(&size, sizeof(size));
+	Write(rates, (size_t)size);
+}
+
+void CaptureLog::Modelview(const float* matrix)
+{
+	if (hasModelview && memcmp(matrix, modelview, sizeof(modelview)) == 0) return;
+	memcpy(modelview, matrix, sizeof(modelview));
+	hasModelview = true;
+	Ints(CAPTURE_MODELVIEW);
+	Write(matrix, sizeof(modelview));
+}
+
+CaptureReader::CaptureReader()
+	:file(NULL)
+{
+}
+
+CaptureReader::~CaptureReader()
+{
+	if (file != NULL) fclose(file);
+}
+
+bool CaptureReader::Open(const char* path)
+{
+	if (file != NULL) fclose(file);
+	if ((file = fopen(path, "rb")) == NULL)
+	{
+		error = std::string("can not open ") + path;
+		return false;
+	}
+
+	char magic[4];
+	uint32_t version = 0;
+	if (!Read(magic, 4) || memcmp(magic, CAPTURE_MAGIC, 4) != 0 || !Read(&version, sizeof(version)))
+	{
+		error = std::string(path) + " is not a capture";
+		return false;
+	}
+	if (version != CAPTURE_VERSION)
+	{
+		error = std::string(path) + " has capture version " + std::to_string(version);
+		return false;
+	}
+	return true;
+}
+
+bool CaptureReader::Read(void* data, size_t size)
+{
+	return file != NULL && fread(data, 1, size, file) == size;
+}
+
+bool CaptureReader::Next(CaptureRecord& record)
+{
+	uint8_t code;
+	if (!Read(&code, 1)) return false;
+	if (code < CAPTURE_INIT || code >= CAPTURE_OP_END)
+	{
+		error = "unknown capture op " + std::to_string(code);
+		return false;
+	}
+	record.op = (CaptureOp)code;
+
+	int32_t ints[4] = { 0, 0, 0, 0 };
+	float floats[16];
+	bool ok = Read(ints, sizeof(int32_t) * intCount(record.op))
+		&& Read(floats, sizeof(float) * floatCount(record.op))
+		&& Read(record.d, sizeof(double) * doubleCount(record.op));
+	for (int k = 0; k < 4; k++) record.i[k] = ints[k];
+	for (int k = 0; k < floatCount(record.op); k++) record.d[k] = floats[k];
+
+	record.offset = 0;
+	record.data.clear();
+	switch (record.op)
+	{
+	case CAPTURE_VERTEX_POINTER:
+	case CAPTURE_COLOR_POINTER:
+	case CAPTURE_NORMAL_POINTER:
+		ok = ok && Read(&record.offset, sizeof(record.offset));
+		break;
+	case CAPTURE_BUFFER_DATA:
+	case CAPTURE_RATE_MAP:
+	{
+		uint64_t size = 0;
+		ok = ok && Read(&size, sizeof(size));
+		if (ok)
+		{
+			record.data.assign((size_t)size, 0);
+			bool bytes = record.op != CAPTURE_BUFFER_DATA || record.i[2] != 0;
+			if (bytes) ok = Read(record.data.data(), (size_t)size);
+		}
+		break;
+	}
+	default:
+		break;
+	}
+
+	if (!ok) error = "capture ends inside a record";
+	return ok;
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include "RTtypes.h"
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+//------ api capture
+// serializes the rt* call stream with buffer contents into a binary file
+// so an application's workload can be replayed headless without it
+// (bench/rtreplay). a file is a header then records, each an op byte and
+// its fixed arguments, rtBufferData adds a byte count and the bytes
+// (no bytes when the application passed NULL data).
+// pointers are recorded as vbo offsets, the only form rtDrawArrays reads.
+// numbers are stored in host byte order.
+
+#define CAPTURE_MAGIC "RTCP"
+#define CAPTURE_VERSION 3
+
+typedef enum
+{
+	CAPTURE_INIT = 1,         //device, output
+	CAPTURE_GEN_BUFFERS,      //n
+	CAPTURE_BIND_BUFFER,      //target, buffer
+	CAPTURE_BUFFER_DATA,      //target, usage, has data, bytes
+	CAPTURE_VERTEX_POINTER,   //size, type, stride, offset
+	CAPTURE_COLOR_POINTER,    //size, type, stride, offset
+	CAPTURE_NORMAL_POINTER,   //type, stride, offset
+	CAPTURE_DRAW_ARRAYS,      //mode, first, count
+	CAPTURE_ENABLE_CLIENT,    //cap
+	CAPTURE_DISABLE_CLIENT,   //cap
+	CAPTURE_ENABLE,           //cap
+	CAPTURE_DISABLE,          //cap
+	CAPTURE_PERSPECTIVE,      //fovy, aspect, near, far
+	CAPTURE_LOOK_AT,          //eye, center, up
+	CAPTURE_LIGHT,            //light, pname, value count, 4 params (unused ones 0)
+	CAPTURE_MATERIAL,         //type, refractive index
+	CAPTURE_BUILD_KDTREE,
+	CAPTURE_INVALIDATE_KDTREE,
+	CAPTURE_MODELVIEW,        //16 floats, column major
+	CAPTURE_FLUSH,
+	CAPTURE_DISPATCH,         //RTdispatch
+	CAPTURE_TRAVERSAL,        //RTtraversal
+	CAPTURE_FETCH,            //RTfetch
+	CAPTURE_SCHEDULE,         //RTschedule
+	CAPTURE_LIGHT_SAMPLING,   //RTlightSampling, shadow rays
+	CAPTURE_ADAPTIVE,         //threshold, max samples
+	CAPTURE_ANTIALIAS,        //edge samples
+	CAPTURE_SAMPLER,          //RTsampler
+	CAPTURE_DENOISE,          //a-trous passes
+	CAPTURE_REPROJECTION,     //refresh share
+	CAPTURE_FOVEATION,        //fovea x, y, radius
+	CAPTURE_RATE_MAP,         //width, height, then byte count + rates
+	CAPTURE_PATH_TERMINATION, //cutoff, ray budget
+	CAPTURE_OP_END            //new ops go above
+} CaptureOp;
+
+//one decoded record, only the fields of its op are set
+struct CaptureRecord
+{
+	CaptureOp op;
+	int i[4];                  //enums, counts, pointer size / stride
+	uint64_t offset;           //pointer offset into the bound vbo
+	double d[16];              //camera doubles, light / modelview floats
+	std::vector<char> data;    //rtBufferData bytes (zeros for NULL data), rate map
+};
+
+class CaptureLog
+{
+public:
+
+	CaptureLog();
+	~CaptureLog();
+
+	//start writing path, NULL closes the file
+	bool Open(const char* path);
+	bool Enabled() const { return file != NULL; }
+
+	void Ints(CaptureOp op, int a = 0, int b = 0, int c = 0, int d = 0);
+	void Op(CaptureOp op) { Ints(op); }
+	void BufferData(unsigned target, unsigned usage, uint64_t size, const void* data);
+	void Pointer(CaptureOp op, int size, unsigned type, int stride, uint64_t offset);
+	void Doubles(CaptureOp op, const double* values, int count);
+	//params holds 1 value for RT_LIGHT_RANGE, else 4
+	void Light(unsigned light, unsigned pname, const float* params);
+	void Material(int type, float rIndex);
+	void RateMap(int width, int height, const unsigned char* rates);
+	//written only when it differs from the last one
+	void Modelview(const float* matrix);
+
+	uint64_t Bytes() const { return bytes; }
+
+private:
+
+	void Write(const void* data, size_t size);
+
+	FILE* file;
+	uint64_t bytes;
+	float modelview[16];
+	bool hasModelview;
+};
+
+//one capture log in program
+CaptureLog& Capture();
+
+class CaptureReader
+{
+public:
+
+	CaptureReader();
+	~CaptureReader();
+
+	bool Open(const char* path);
+	//false at the end of the file or on a damaged record
+	bool Next(CaptureRecord& record);
+	const std::string& Error() const { return error; }
+
+private:
+
+	bool Read(void* data, size_t size);
+
+	FILE* file;
+	std::string error;
+};
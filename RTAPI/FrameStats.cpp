@@ -0,0 +1,94 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+#include <cstring>
+
+//same order as RTframeStats
+static const char* FieldNames[] =
+{
+	"frame", "ingest_ms", "upload_ms", "upload_bytes", "kernel_ms", "acquire_ms",
+	"blit_ms", "build_ms", "primary_rays", "reflect_rays", "refract_rays", "shadow_rays", "frame_ms",
+	"device_bytes", "image_fallbacks"
+};
+
+static_assert(sizeof(FieldNames) / sizeof(FieldNames[0]) == sizeof(RTframeStats) / sizeof(double),
+	"FieldNames must list every RTframeStats field");
+
+FrameStats::FrameStats(unsigned window /* = 256 */)
+	:window(window), next(0), frames(0), log(NULL)
+{
+	memset(&current, 0, sizeof(current));
+	memset(&last, 0, sizeof(last));
+	ring.reserve(window);
+}
+
+FrameStats::~FrameStats()
+{
+	if (log != NULL) fclose(log);
+}
+
+void FrameStats::EndFrame()
+{
+	current.frame = frames++;
+	last = current;
+
+	if (ring.size() < window) ring.push_back(current);
+	else ring[next] = current;
+	next = (next + 1) % window;
+
+	if (log != NULL)
+	{
+		const double* f = (const double*)&current;
+		for (unsigned i = 0; i < FIELDS; i++)
+			fprintf(log, i + 1 < FIELDS ? "%.4f," : "%.4f\n", f[i]);
+	}
+
+	memset(&current, 0, sizeof(current));
+}
+
+void FrameStats::Percentile(double q, RTframeStats* out) const
+{
+	memset(out, 0, sizeof(RTframeStats));
+	if (ring.empty()) return;
+
+	std::vector<double> values(ring.size());
+	double* o = (double*)out;
+	for (unsigned i = 0; i < FIELDS; i++)
+	{
+		for (size_t k = 0; k < ring.size(); k++)
+			values[k] = ((const double*)&ring[k])[i];
+
+		//nearest rank
+		size_t rank = (size_t)(q * (values.size() - 1) + 0.5);
+		std::nth_element(values.begin(), values.begin() + rank, values.end());
+		o[i] = values[rank];
+	}
+}
+
+void FrameStats::Get(RTframeStats* last, RTframeStats* p50, RTframeStats* p99) const
+{
+	if (last != NULL) *last = this->last;
+	if (p50 != NULL) Percentile(0.50, p50);
+	if (p99 != NULL) Percentile(0.99, p99);
+}
+
+bool FrameStats::OpenLog(const char* path)
+{
+	if (log != NULL)
+	{
+		fclose(log);
+		log = NULL;
+	}
+	if (path == NULL) return true;
+
+	log = fopen(path, "w");
+	if (log == NULL)
+	{
+		printf("can not open frame stats log %s\n", path);
+		return false;
+	}
+
+	for (unsigned i = 0; i < FIELDS; i++)
+		fprintf(log, i + 1 < FIELDS ? "%s," : "%s\n", FieldNames[i]);
+	return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "RTtypes.h"
+
+#include <vector>
+#include <cstdio>
+
+//------ frame statistics
+// keeps the stats of the last frames in a ring for rolling percentiles
+// and optionally appends every finished frame to a csv file.
+class FrameStats
+{
+public:
+
+	FrameStats(unsigned window = 256);
+	~FrameStats();
+
+	//stats of the frame being rendered, filled by the api
+	RTframeStats& Current() { return current; }
+
+	//finish the current frame and start a new one
+	void EndFrame();
+
+	//last finished frame and percentiles of every field over the window
+	void Get(RTframeStats* last, RTframeStats* p50, RTframeStats* p99) const;
+
+	//start a csv log, NULL path stops logging
+	bool OpenLog(const char* path);
+
+private:
+
+	static const unsigned FIELDS = sizeof(RTframeStats) / sizeof(double);
+
+	void Percentile(double q, RTframeStats* out) const;
+
+	RTframeStats current;
+	RTframeStats last;
+	std::vector<RTframeStats> ring;
+	unsigned window, next;
+	unsigned frames;
+	FILE* log;
+};
@@ -1,5 +1,6 @@
 #include "KDTree.h"
 #include"KDstruct.h"
+#include "Timer.h"
 
 #include <cmath>
 #include <algorithm>
@@ -59,19 +60,22 @@ namespace KDTREE
 	}
 
 	KDTree::KDTree(int depth, int primnum)
-		:MAXDEPTH(depth), MAXPRIMITIVE(primnum)
+		:root(NULL), MAXDEPTH(depth), MAXPRIMITIVE(primnum), eventBytes(0)
 	{
+		memset(&stats, 0, sizeof(stats));
 	}
 
 	KDTree::~KDTree()
 	{
-		for each(auto node in nodeList) delete node;
+		for (auto node : nodeList) delete node;
 		nodeList.clear();
 	}
 
 	void KDTree::buildTree(std::vector<Triangle>& triangles)
 	{
 		//printf("size tri: %d\n", triangles.size());
+		Timer total, phase;
+		total.start();
 		
 		root = new KDnode;
 		root->id = nodeList.size(); //give its id with last size number of nodelist start from 0
@@ -79,6 +83,7 @@ namespace KDTREE
 
 		std::vector<int>& triList = root->indexList;
 
+		phase.start();
 		BoundingBox& box = root->box;
 		for (int i = 0; i < triangles.size(); i++)
 		{
@@ -87,9 +92,16 @@ namespace KDTREE
 			//put in bounding box
 			triList.push_back(i);
 		}
+		stats.boundsMs = phase.getElapsedTimeInMilliSec();
 
 		recursiveBuildTree(triangles, *root, 0);
 
+		//every node keeps its triangle list until the tree is destroyed
+		stats.scratchBytes = eventBytes;
+		for (auto node : nodeList)
+			stats.scratchBytes += sizeof(KDnode) + node->indexList.capacity() * sizeof(int);
+		stats.totalMs = total.getElapsedTimeInMilliSec();
+
 	}
 
 	void KDTree::recursiveBuildTree(std::vector<Triangle>& triangles, KDnode& node, int depth)
@@ -124,6 +136,8 @@ namespace KDTREE
 		nodeList.push_back(node.right);
 
 		//pass triangles to left & right child
+		Timer phase;
+		phase.start();
 		for (int i = 0; i < node.indexList.size(); i++)
 		{
 			// in left bounding box or right or both        
@@ -141,6 +155,7 @@ namespace KDTREE
 			}
 
 		}
+		stats.classifyMs += phase.getElapsedTimeInMilliSec();
 
 		recursiveBuildTree(triangles, *(node.left), depth + 1);
 		recursiveBuildTree(triangles, *(node.right), depth + 1);
@@ -148,6 +163,8 @@ namespace KDTREE
 
 	splitPlane KDTree::findSplitSAH(std::vector<Triangle>& triangles, KDnode& node)
 	{
+		Timer phase;
+		phase.start();
 		std::vector<int>& triIndices = node.indexList;
 		// 0~2, Axis x, y, z respectively
 		static std::vector<splitPlane> list[3];
@@ -188,6 +205,9 @@ namespace KDTREE
 		{
 			std::sort(list[i].begin(), list[i].end(), sortPredictSAH);
 		}
+		eventBytes = std::max(eventBytes, (list[0].capacity() + list[1].capacity() + list[2].capacity()) * sizeof(splitPlane));
+		stats.edgesMs += phase.getElapsedTimeInMilliSec();
+		phase.start();
 
 		//SAH, surface area width height depth
 		const float* bound_max = node.box.maxb;
@@ -249,6 +269,8 @@ namespace KDTREE
 			}
 		}
 
+		stats.sweepMs += phase.getElapsedTimeInMilliSec();
+
 		if (original_cost < best_cost)
 		{
 			//printf("some nodes no split!\n");
@@ -287,7 +309,10 @@ namespace KDTREE
 
 	void KDTree::convertSharedKDnodes(std::vector<KDNode>& kdnodes, std::vector<int>& triangle_pool)
 	{
+		Timer convert;
+		convert.start();
 		KDNode temp;
+		temp.block = -1;
 		for (int i = 0; i < nodeList.size(); i++)
 		{
 			auto& node = nodeList[i];
@@ -322,6 +347,7 @@ namespace KDTREE
 			}
 
 		}
+		stats.convertMs = convert.getElapsedTimeInMilliSec();
 	}
 
 
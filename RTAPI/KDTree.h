@@ -1,6 +1,7 @@
 #pragma once
 #include "RTstruct.h"
 #include "KDstruct.h"
+#include "KDstats.h"
 #include <vector>
 
 namespace KDTREE
@@ -24,6 +25,9 @@ namespace KDTREE
 
 		void buildTree(std::vector<Triangle>& triangles);
 
+		//phase times and scratch memory of the build (and last convert)
+		const KDBuildStats& BuildStats() const { return stats; }
+
 	private:
 		void optimizeRopes(int& nodeid, Rope s, BoundingBox& aabb);
 		void recursiveBuildTree(std::vector<Triangle>& triangles, KDnode& node, int depth);
@@ -33,6 +37,8 @@ namespace KDTREE
 		std::vector<KDnode*> nodeList;
 		const int MAXDEPTH;
 		const int MAXPRIMITIVE;
+		KDBuildStats stats;
+		size_t eventBytes;   //peak size of the SAH event lists
 	};
 
 	class BoundingBox
@@ -41,7 +47,7 @@ namespace KDTREE
 		BoundingBox()
 		{
 			minb[0] = minb[1] = minb[2] = FLT_MAX;
-			maxb[0] = maxb[1] = maxb[2] = FLT_MIN;
+			maxb[0] = maxb[1] = maxb[2] = -FLT_MAX;
 		}
 
 		void Expand(const Triangle& tri);
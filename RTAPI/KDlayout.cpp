@@ -0,0 +1,85 @@
+#include "KDlayout.h"
+
+#include <cstring>
+
+size_t LayoutKDTopLevels(std::vector<KDNode>& kdnodes, int levels /* = KD_TOP_LEVELS */)
+{
+	if (kdnodes.empty() || levels <= 0) return 0;
+
+	//breadth first ids of the top levels
+	std::vector<int> order;
+	std::vector<int> level(1, 0), below;
+	for (int depth = 0; depth < levels && !level.empty(); depth++)
+	{
+		below.clear();
+		for (int id : level)
+		{
+			order.push_back(id);
+			const KDNode& node = kdnodes[id];
+			if (node.stat == isNode)
+			{
+				below.push_back(node.child_id.x);
+				below.push_back(node.child_id.y);
+			}
+		}
+		level.swap(below);
+	}
+	size_t top = order.size();
+
+	//the rest in their old order
+	std::vector<int> newID(kdnodes.size(), -1);
+	for (size_t i = 0; i < top; i++) newID[order[i]] = (int)i;
+	for (size_t i = 0; i < kdnodes.size(); i++)
+	{
+		if (newID[i] != -1) continue;
+		newID[i] = (int)order.size();
+		order.push_back((int)i);
+	}
+
+	std::vector<KDNode> moved(kdnodes.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		KDNode node = kdnodes[order[i]];
+		if (node.stat == isNode)
+		{
+			node.child_id.x = newID[node.child_id.x];
+			node.child_id.y = newID[node.child_id.y];
+		}
+		moved[i] = node;
+	}
+	kdnodes.swap(moved);
+	return top;
+}
+
+void BuildTriBlocks(std::vector<KDNode>& kdnodes, const std::vector<int>& kdtriangles,
+	const Triangle* triangles, std::vector<TriBlock>& blocks)
+{
+	blocks.clear();
+	for (KDNode& node : kdnodes)
+	{
+		node.block = -1;
+		if (node.stat != isLeaf || node.end <= node.start) continue;
+
+		node.block = (int)blocks.size();
+		for (int i = node.start; i < node.end; i += 4)
+		{
+			//padding lanes are zero, a degenerate triangle never hit
+			TriBlock b;
+			memset(&b, 0, sizeof(b));
+			for (int lane = 0; lane < 4; lane++)
+			{
+				b.ids[lane] = -1;
+				if (i + lane >= node.end) continue;
+
+				int id = kdtriangles[i + lane];
+				const Triangle& t = triangles[id];
+				float4 e1 = t.v1 - t.v0, e2 = t.v2 - t.v0;
+				b.v0x[lane] = t.v0.x; b.v0y[lane] = t.v0.y; b.v0z[lane] = t.v0.z;
+				b.e1x[lane] = e1.x; b.e1y[lane] = e1.y; b.e1z[lane] = e1.z;
+				b.e2x[lane] = e2.x; b.e2y[lane] = e2.y; b.e2z[lane] = e2.z;
+				b.ids[lane] = id;
+			}
+			blocks.push_back(b);
+		}
+	}
+}
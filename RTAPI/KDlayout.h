@@ -0,0 +1,23 @@
+#pragma once
+#include "KDstruct.h"
+#include "RTstruct.h"
+
+#include <vector>
+#include <cstddef>
+
+//------ kd-tree node layout
+// converted trees are depth first, a child below its parent. the kernel
+// caches a prefix of the node array in local memory, so the nodes every
+// ray reads have to come first.
+
+//levels moved to the front, more than any device local memory holds
+#define KD_TOP_LEVELS 16
+
+//moves the nodes of the top levels to the front in breadth first order,
+//the rest keep their depth first order. returns the number of moved nodes,
+//any prefix of them is the top of the tree
+size_t LayoutKDTopLevels(std::vector<KDNode>& kdnodes, int levels = KD_TOP_LEVELS);
+
+//packs the triangles of every leaf into TriBlocks and sets KDNode.block
+void BuildTriBlocks(std::vector<KDNode>& kdnodes, const std::vector<int>& kdtriangles,
+	const Triangle* triangles, std::vector<TriBlock>& blocks);
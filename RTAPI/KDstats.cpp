@@ -0,0 +1,67 @@
+#include "KDstats.h"
+
+#include <algorithm>
+#include <cstring>
+
+static float surfaceArea(const float* b)
+{
+	float w = b[3] - b[0], h = b[4] - b[1], d = b[5] - b[2];
+	return 2.0f * (w * h + h * d + d * w);
+}
+
+KDTreeMetrics MeasureKDTree(const std::vector<KDNode>& kdnodes,
+	const float bound[6], size_t triangles, float traversalCost /* = 1.0f */, float isectCost /* = 80.0f */)
+{
+	KDTreeMetrics m;
+	memset(&m, 0, sizeof(m));
+	m.nodes = kdnodes.size();
+	if (kdnodes.empty()) return m;
+
+	struct Item
+	{
+		int node, depth;
+		float box[6];
+	};
+
+	double rootSA = std::max(surfaceArea(bound), 1e-12f);
+	double interiorSA = 0.0, leafCost = 0.0;
+
+	std::vector<Item> stack;
+	Item root = { 0, 0 };
+	memcpy(root.box, bound, sizeof(root.box));
+	stack.push_back(root);
+
+	while (!stack.empty())
+	{
+		Item it = stack.back();
+		stack.pop_back();
+		const KDNode& node = kdnodes[it.node];
+		m.maxDepth = std::max(m.maxDepth, it.depth);
+
+		if (node.stat == isLeaf)
+		{
+			size_t n = (size_t)std::max(node.end - node.start, 0);
+			m.leaves++;
+			m.references += n;
+			if (n == 0) m.emptyLeaves++;
+			leafCost += (double)n * surfaceArea(it.box);
+			continue;
+		}
+
+		interiorSA += surfaceArea(it.box);
+
+		Item below = { node.child_id.x, it.depth + 1 }, above = { node.child_id.y, it.depth + 1 };
+		memcpy(below.box, it.box, sizeof(it.box));
+		memcpy(above.box, it.box, sizeof(it.box));
+		below.box[3 + node.axis] = node.split;
+		above.box[node.axis] = node.split;
+		stack.push_back(above);
+		stack.push_back(below);
+	}
+
+	size_t filled = m.leaves - m.emptyLeaves;
+	m.avgLeafSize = filled ? (double)m.references / filled : 0.0;
+	m.duplicates = m.references > triangles ? m.references - triangles : 0;
+	m.sahCost = (traversalCost * interiorSA + isectCost * leafCost) / rootSA;
+	return m;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "KDstruct.h"
+
+#include <vector>
+#include <cstddef>
+
+//------ kd-tree build statistics
+// phase times are filled by the builder that made the tree, tree metrics
+// are measured on the converted KDNode arrays so both builders compare alike.
+
+//time in ms per build phase, a phase a builder lacks stays 0
+struct KDBuildStats
+{
+	double totalMs;
+	double boundsMs;      //triangle bounds
+	double edgesMs;       //split candidates init + sort
+	double sweepMs;       //SAH cost sweep
+	double classifyMs;    //triangles to children
+	double leafMs;        //leaf triangle lists
+	double convertMs;     //to KDNode arrays
+
+	size_t scratchBytes;  //working memory alive at the end of the build
+	size_t prims1Bytes;   //pbrt (maxDepth + 1) * N prims1 buffer, part of scratchBytes
+};
+
+struct KDTreeMetrics
+{
+	size_t nodes;
+	size_t leaves;
+	size_t emptyLeaves;
+	size_t references;    //triangle ids in all leaves
+	size_t duplicates;    //references - triangles
+	int maxDepth;
+	double avgLeafSize;   //references per non empty leaf
+	double sahCost;       //traversalCost * interior SA + isectCost * refs * leaf SA, over root SA
+};
+
+//walks the tree from node 0 inside bound (min xyz, max xyz)
+KDTreeMetrics MeasureKDTree(const std::vector<KDNode>& kdnodes,
+	const float bound[6], size_t triangles, float traversalCost = 1.0f, float isectCost = 80.0f);
@@ -4,6 +4,7 @@
 #ifndef __OPENCL_C_VERSION__
 #include <glm\glm.hpp>
 typedef glm::ivec2 int2;
+typedef glm::ivec4 int4;
 typedef glm::vec4 float4;
 //for device
 #else
@@ -39,4 +40,15 @@ ALIGNED_TYPE(struct, 16) __KDNode
 	int start;				//strat triangle id 
 	int end;				//end triangle id
 	int2 child_id;			//s0 left, s1 right
+	int block;              //leaf: first TriBlock of its triangles, -1 if none
 } KDNode;
+
+//four leaf triangles in soa form for the kernel's 4 wide test, a leaf of
+//n triangles owns (n + 3) / 4 blocks from KDNode.block
+ALIGNED_TYPE(struct, 16) __TriBlock
+{
+	float4 v0x, v0y, v0z;
+	float4 e1x, e1y, e1z;   //v1 - v0
+	float4 e2x, e2y, e2z;   //v2 - v0
+	int4 ids;               //triangle ids, -1 pads the last block of a leaf
+} TriBlock;
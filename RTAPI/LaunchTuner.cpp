@@ -0,0 +1,149 @@
+#include "LaunchTuner.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+
+//cache file: one line per tuned launch, tab separated
+//device, driver, variant, width, height, shape w, shape h
+static bool sameLaunch(const TuneKey& a, const TuneKey& b)
+{
+	return a.device == b.device && a.variant == b.variant && a.width == b.width && a.height == b.height;
+}
+
+static bool parseLine(const std::string& line, TuneKey& key, TuneShape& shape)
+{
+	std::vector<std::string> fields;
+	std::stringstream ss(line);
+	std::string field;
+	while (std::getline(ss, field, '\t')) fields.push_back(field);
+	if (fields.size() != 7) return false;
+
+	key.device = fields[0];
+	key.driver = fields[1];
+	key.variant = fields[2];
+	key.width = (unsigned)atoi(fields[3].c_str());
+	key.height = (unsigned)atoi(fields[4].c_str());
+	shape.w = (size_t)atoi(fields[5].c_str());
+	shape.h = (size_t)atoi(fields[6].c_str());
+	return shape.w > 0 && shape.h > 0;
+}
+
+static bool loadShape(const std::string& cache, const TuneKey& key, TuneShape& shape)
+{
+	std::ifstream ifs(cache);
+	std::string line;
+	while (std::getline(ifs, line))
+	{
+		TuneKey k;
+		TuneShape s;
+		if (parseLine(line, k, s) && sameLaunch(k, key) && k.driver == key.driver)
+		{
+			shape = s;
+			return true;
+		}
+	}
+	return false;
+}
+
+//replaces the line of the same launch, whatever driver it was tuned on
+static void storeShape(const std::string& cache, const TuneKey& key, TuneShape shape)
+{
+	std::vector<std::string> lines;
+	{
+		std::ifstream ifs(cache);
+		std::string line;
+		while (std::getline(ifs, line))
+		{
+			TuneKey k;
+			TuneShape s;
+			if (parseLine(line, k, s) && !sameLaunch(k, key)) lines.push_back(line);
+		}
+	}
+
+	std::ofstream ofs(cache, std::ios::trunc);
+	if (!ofs)
+	{
+		printf("can not write tune cache %s\n", cache.c_str());
+		return;
+	}
+	for (const std::string& line : lines) ofs << line << '\n';
+	ofs << key.device << '\t' << key.driver << '\t' << key.variant << '\t' << key.width << '\t' << key.height
+		<< '\t' << shape.w << '\t' << shape.h << '\n';
+}
+
+std::vector<TuneShape> TuneShapes(size_t simdWidth, size_t groupLimit)
+{
+	std::vector<TuneShape> shapes;
+	size_t limit = std::min<size_t>(groupLimit, 256);
+	for (size_t h = 2; h <= 128; h *= 2)
+	{
+		for (size_t w = 2; w <= 128; w *= 2)
+		{
+			size_t size = w * h;
+			if (size > limit || size % std::max<size_t>(simdWidth, 1) != 0) continue;
+			if (w > 4 * h || h > 4 * w) continue;
+			shapes.push_back({ w, h });
+		}
+	}
+	return shapes;
+}
+
+TuneKey MakeTuneKey(cl_device_id device, const std::string& variant, unsigned width, unsigned height)
+{
+	char name[256] = "", driver[256] = "";
+	clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name), name, NULL);
+	clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(driver), driver, NULL);
+
+	TuneKey key;
+	key.device = name;
+	key.driver = driver;
+	key.variant = variant;
+	key.width = width;
+	key.height = height;
+	return key;
+}
+
+LaunchTuner::LaunchTuner()
+	:next(0), frames(0)
+{
+	key.width = key.height = 0;
+	best.w = best.h = 0;
+}
+
+void LaunchTuner::Begin(const std::string& cache, const TuneKey& key, const std::vector<TuneShape>& shapes, TuneShape fallback)
+{
+	this->cache = cache;
+	this->key = key;
+	this->shapes.clear();
+	ms.clear();
+	next = frames = 0;
+	best = fallback;
+	if (shapes.size() < 2 || (!cache.empty() && loadShape(cache, key, best))) return;
+
+	this->shapes = shapes;
+	ms.assign(shapes.size(), DBL_MAX);
+}
+
+TuneShape LaunchTuner::Shape() const
+{
+	return Tuning() ? shapes[next] : best;
+}
+
+void LaunchTuner::Time(double msPerWork)
+{
+	if (!Tuning()) return;
+
+	//best frame of the trials, the first one may still warm caches
+	ms[next] = std::min(ms[next], msPerWork);
+	if (++frames < TUNE_TRIALS) return;
+	frames = 0;
+	if (++next < shapes.size()) return;
+
+	size_t winner = std::min_element(ms.begin(), ms.end()) - ms.begin();
+	best = shapes[winner];
+	if (!cache.empty()) storeShape(cache, key, best);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <CL\cl.h>
+
+//------ work-group shape tuner
+// times the kd-tree kernel with every candidate work-group shape for a few
+// frames and keeps the fastest. winners can be kept in a text file per
+// device, driver version, kernel variant and frame size, so later runs start
+// with them. a new driver misses the file and tunes again.
+
+//frames timed on each shape
+#define TUNE_TRIALS 2
+
+struct TuneShape
+{
+	size_t w, h;
+};
+
+struct TuneKey
+{
+	std::string device, driver;
+	std::string variant;    //fetch path, dispatch, traversal and schedule
+	unsigned width, height;
+};
+
+//power of two shapes of at most 4:1 and 256 work-items whose size is a
+//multiple of simdWidth and fits groupLimit. bigger groups only diverge more
+std::vector<TuneShape> TuneShapes(size_t simdWidth, size_t groupLimit);
+
+//device name and driver version of device
+TuneKey MakeTuneKey(cl_device_id device, const std::string& variant, unsigned width, unsigned height);
+
+class LaunchTuner
+{
+public:
+
+	LaunchTuner();
+
+	//start on key: the shape of the cache file if it has one, else trials of
+	//shapes. empty cache path tunes without storing, empty shapes use fallback
+	void Begin(const std::string& cache, const TuneKey& key, const std::vector<TuneShape>& shapes, TuneShape fallback);
+	const std::string& Variant() const { return key.variant; }
+	bool Tuning() const { return next < shapes.size(); }
+
+	//shape of the next frame
+	TuneShape Shape() const;
+	//kernel ms per row, or per listed pixel, of a frame launched with Shape()
+	void Time(double msPerWork);
+
+private:
+
+	std::string cache;
+	TuneKey key;
+	std::vector<TuneShape> shapes;
+	std::vector<double> ms;   //best ms per work of each shape
+	size_t next;              //shape being timed, shapes.size() when done
+	int frames;               //frames timed on it
+	TuneShape best;
+};
@@ -0,0 +1,127 @@
+#include "LightTree.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+//largest float below 1
+#define ONE_BELOW 0.99999994f
+
+static void buildNode(const std::vector<SphereLight>& lights, std::vector<int>& ids, int first, int last,
+	std::vector<LightNode>& nodes, int at)
+{
+	glm::vec3 lo(FLT_MAX), hi(-FLT_MAX), clo(FLT_MAX), chi(-FLT_MAX);
+	float range = 0.0f;
+	for (int i = first; i < last; i++)
+	{
+		const SphereLight& l = lights[ids[i]];
+		glm::vec3 c(l.ori);
+		lo = glm::min(lo, c - glm::vec3(l.radius));
+		hi = glm::max(hi, c + glm::vec3(l.radius));
+		clo = glm::min(clo, c);
+		chi = glm::max(chi, c);
+		range = std::max(range, l.range);
+	}
+
+	LightNode& node = nodes[at];
+	node.lo = glm::vec4(lo, 0);
+	node.hi = glm::vec4(hi, 0);
+	node.power = (float)(last - first);
+	node.range = range;
+	node.child = -1;
+	node.light = ids[first];
+	if (last - first == 1) return;
+
+	glm::vec3 extent = chi - clo;
+	int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+	int mid = (first + last) / 2;
+	std::nth_element(ids.begin() + first, ids.begin() + mid, ids.begin() + last,
+		[&](int a, int b) { return lights[a].ori[axis] < lights[b].ori[axis]; });
+
+	//children next to each other, node is not touched after the resize
+	int child = (int)nodes.size();
+	nodes[at].child = child;
+	nodes[at].light = -1;
+	nodes.resize(nodes.size() + 2);
+	buildNode(lights, ids, first, mid, nodes, child);
+	buildNode(lights, ids, mid, last, nodes, child + 1);
+}
+
+void BuildLightTree(const std::vector<SphereLight>& lights, std::vector<LightNode>& nodes)
+{
+	nodes.clear();
+	std::vector<int> ids;
+	for (size_t i = 0; i < lights.size(); i++)
+		if (lights[i].enable) ids.push_back((int)i);
+	if (ids.empty()) return;
+
+	nodes.reserve(ids.size() * 2 - 1);
+	nodes.resize(1);
+	buildNode(lights, ids, 0, (int)ids.size(), nodes, 0);
+}
+
+bool LightNodeVisible(const LightNode& node, const glm::vec3& p, const glm::vec3& n)
+{
+	glm::vec3 lo(node.lo), hi(node.hi);
+	glm::vec3 c = (lo + hi) * 0.5f, e = (hi - lo) * 0.5f;
+	//furthest the box reaches in front of the tangent plane
+	float front = glm::dot(c - p, n) + glm::dot(e, glm::abs(n));
+	if (front <= 0.0f) return false;
+
+	glm::vec3 d = glm::max(glm::max(lo - p, p - hi), glm::vec3(0.0f));
+	return glm::dot(d, d) <= node.range * node.range;
+}
+
+float LightNodeImportance(const LightNode& node, const glm::vec3& p, const glm::vec3& n)
+{
+	if (!LightNodeVisible(node, p, n)) return 0.0f;
+
+	glm::vec3 lo(node.lo), hi(node.hi);
+	glm::vec3 toC = (lo + hi) * 0.5f - p;
+	float r = glm::length(hi - lo) * 0.5f;
+	float d = glm::length(toC);
+	if (d <= r) return node.power;
+
+	//cos of the angle to n less the half angle of the sphere
+	float cosT = glm::dot(toC, n) / d;
+	float sinB = r / d;
+	float cosB = std::sqrt(1.0f - sinB * sinB);
+	if (cosT >= cosB) return node.power;
+	float sinT = std::sqrt(std::max(1.0f - cosT * cosT, 0.0f));
+	float cosine = cosT * cosB + sinT * sinB;
+	//visible nodes keep some weight, the estimate stays unbiased
+	return node.power * std::max(cosine, 0.01f);
+}
+
+int SampleLight(const LightNode* nodes, int count, const glm::vec3& p, const glm::vec3& n, float u, float& pdf)
+{
+	pdf = 1.0f;
+	if (count == 0 || LightNodeImportance(nodes[0], p, n) <= 0.0f) return -1;
+
+	u = std::min(u, ONE_BELOW);
+	const LightNode* node = &nodes[0];
+	while (node->child >= 0)
+	{
+		const LightNode* a = &nodes[node->child];
+		const LightNode* b = a + 1;
+		float wa = LightNodeImportance(*a, p, n);
+		float wb = LightNodeImportance(*b, p, n);
+		if (wa + wb <= 0.0f) return -1;
+
+		//u is reused below, rescaled to the picked side
+		float pa = wa / (wa + wb);
+		if (u < pa)
+		{
+			u = std::min(u / pa, ONE_BELOW);
+			pdf *= pa;
+			node = a;
+		}
+		else
+		{
+			u = std::min((u - pa) / (1.0f - pa), ONE_BELOW);
+			pdf *= 1.0f - pa;
+			node = b;
+		}
+	}
+	return node->light;
+}
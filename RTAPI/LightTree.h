@@ -0,0 +1,25 @@
+#pragma once
+#include "RTstruct.h"
+
+#include <vector>
+
+//------ light hierarchy
+// binary bvh over the enabled sphere lights. a node culls its lights for a
+// hit they can not shade (all behind its tangent plane or out of range) and
+// weights them for importance-sampled shadow rays. the same tests are in
+// RayTracing.cl, these serve the native tracer.
+
+//median split on the longest axis of the light centers, root at 0.
+//empty if no light is enabled
+void BuildLightTree(const std::vector<SphereLight>& lights, std::vector<LightNode>& nodes);
+
+//some light below node may shade point p of normal n
+bool LightNodeVisible(const LightNode& node, const glm::vec3& p, const glm::vec3& n);
+
+//sampling weight of node at p: its power scaled by the largest cosine
+//toward its bounding sphere, 0 if culled
+float LightNodeImportance(const LightNode& node, const glm::vec3& p, const glm::vec3& n);
+
+//light picked from the root in proportion to LightNodeImportance with u in
+//[0, 1), pdf is the chance of the pick. -1 if no light can shade p
+int SampleLight(const LightNode* nodes, int count, const glm::vec3& p, const glm::vec3& n, float u, float& pdf);
@@ -0,0 +1,897 @@
+#include "NativeTracer.h"
+#include "LightTree.h"
+#include "Sampler.h"
+#include "RTtypes.h"
+
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define EPSILON 0.001f
+#define TILE_SIZE 16
+#define STACK_SIZE 64
+#define LIGHT_STACK 32
+
+//packet of 8 primary rays covers 4x2 pixels
+#define PACKET_W 4
+#define PACKET_H 2
+
+namespace
+{
+	//---------- 8 wide float, masks are all-ones / all-zero lanes
+#if defined(__AVX2__)
+	struct f8
+	{
+		f8() {}
+		f8(__m256 x) :v(x) {}
+		f8(float x) :v(_mm256_set1_ps(x)) {}
+		static f8 load(const float* p) { return _mm256_loadu_ps(p); }
+		static f8 fromInt(int x) { return _mm256_castsi256_ps(_mm256_set1_epi32(x)); }
+		void store(float* p) const { _mm256_storeu_ps(p, v); }
+		__m256 v;
+	};
+
+	inline f8 operator+(f8 a, f8 b) { return _mm256_add_ps(a.v, b.v); }
+	inline f8 operator-(f8 a, f8 b) { return _mm256_sub_ps(a.v, b.v); }
+	inline f8 operator*(f8 a, f8 b) { return _mm256_mul_ps(a.v, b.v); }
+	inline f8 operator/(f8 a, f8 b) { return _mm256_div_ps(a.v, b.v); }
+	inline f8 operator<(f8 a, f8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+	inline f8 operator<=(f8 a, f8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+	inline f8 operator>(f8 a, f8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+	inline f8 operator>=(f8 a, f8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+	inline f8 operator==(f8 a, f8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+	inline f8 operator&(f8 a, f8 b) { return _mm256_and_ps(a.v, b.v); }
+	inline f8 operator|(f8 a, f8 b) { return _mm256_or_ps(a.v, b.v); }
+	inline f8 andnot(f8 a, f8 b) { return _mm256_andnot_ps(b.v, a.v); }  // a & ~b
+	inline f8 min8(f8 a, f8 b) { return _mm256_min_ps(a.v, b.v); }
+	inline f8 max8(f8 a, f8 b) { return _mm256_max_ps(a.v, b.v); }
+	inline f8 abs8(f8 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+	inline f8 select(f8 mask, f8 a, f8 b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+	inline int movemask(f8 m) { return _mm256_movemask_ps(m.v); }
+#else
+	struct f8
+	{
+		f8() {}
+		f8(float x) { for (int i = 0; i < 8; i++) v[i] = x; }
+		static f8 load(const float* p) { f8 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+		static f8 fromInt(int x) { f8 r; for (int i = 0; i < 8; i++) memcpy(&r.v[i], &x, sizeof(int)); return r; }
+		void store(float* p) const { memcpy(p, v, sizeof(v)); }
+		float v[8];
+	};
+
+	inline uint32_t bits(float x) { uint32_t u; memcpy(&u, &x, sizeof(u)); return u; }
+	inline float unbits(uint32_t u) { float x; memcpy(&x, &u, sizeof(x)); return x; }
+	inline float maskOf(bool b) { return unbits(b ? 0xFFFFFFFFu : 0u); }
+
+#define F8_OP(OP, EXPR) \
+	inline f8 OP(f8 a, f8 b) { f8 r; for (int i = 0; i < 8; i++) { float x = a.v[i], y = b.v[i]; r.v[i] = (EXPR); } return r; }
+
+	F8_OP(operator+, x + y)
+	F8_OP(operator-, x - y)
+	F8_OP(operator*, x * y)
+	F8_OP(operator/, x / y)
+	F8_OP(operator<, maskOf(x < y))
+	F8_OP(operator<=, maskOf(x <= y))
+	F8_OP(operator>, maskOf(x > y))
+	F8_OP(operator>=, maskOf(x >= y))
+	F8_OP(operator==, maskOf(x == y))
+	F8_OP(operator&, unbits(bits(x) & bits(y)))
+	F8_OP(operator|, unbits(bits(x) | bits(y)))
+	F8_OP(andnot, unbits(bits(x) & ~bits(y)))
+	F8_OP(min8, y < x ? y : x)
+	F8_OP(max8, y > x ? y : x)
+#undef F8_OP
+
+	inline f8 abs8(f8 a) { f8 r; for (int i = 0; i < 8; i++) r.v[i] = std::fabs(a.v[i]); return r; }
+	inline f8 select(f8 mask, f8 a, f8 b) { f8 r; for (int i = 0; i < 8; i++) r.v[i] = (bits(mask.v[i]) >> 31) ? a.v[i] : b.v[i]; return r; }
+	inline int movemask(f8 m) { int r = 0; for (int i = 0; i < 8; i++) r |= (bits(m.v[i]) >> 31) << i; return r; }
+#endif
+
+	//---------- scalar ray, mirrors Ray / Record in RayTracing.cl
+	typedef enum { HIT_MISS, HIT_LIGHT, HIT_TRI } HitType;
+	typedef enum { Origin = 0, Reflec, Refrac } RayType;
+
+	struct Record
+	{
+		int primID;
+		HitType prim_type;
+		bool isInPrim;
+		int depth;
+		float t;
+	};
+
+	struct Ray
+	{
+		glm::vec3 ori;
+		glm::vec3 dir;
+		glm::vec3 revdir;
+		glm::vec4 weight;
+		glm::vec4 transparency;
+		glm::vec4 last_prim_color;
+		RayType ray_type;
+		Record rec;
+	};
+
+	struct KdToDo
+	{
+		int nodeid;
+		float tMin, tMax;
+	};
+
+	struct SceneRef
+	{
+		const Info* info;
+		const float* bound;
+		const KDNode* kdnodes;
+		const int* kdtriangles;
+		const Triangle* triangles;
+		const SphereLight* lights;
+		const LightNode* lightNodes;
+		const float* triVerts;
+	};
+
+	Record newRecord()
+	{
+		Record rec;
+		rec.primID = -1;
+		rec.prim_type = HIT_MISS;
+		rec.isInPrim = false;
+		rec.depth = 0;
+		rec.t = FLT_MAX;
+		return rec;
+	}
+
+	bool boxIntersect(const float* bound, const Ray& ray, float& tmin, float& tmax)
+	{
+		tmin = -FLT_MAX;
+		tmax = FLT_MAX;
+		for (int a = 0; a < 3; a++)
+		{
+			float t1 = (bound[a] - ray.ori[a]) * ray.revdir[a];
+			float t2 = (bound[a + 3] - ray.ori[a]) * ray.revdir[a];
+			tmin = std::max(tmin, std::min(t1, t2));
+			tmax = std::min(tmax, std::max(t1, t2));
+		}
+		return tmax > tmin;
+	}
+
+	//same test as TriINTXN, tv is v0, e1, e2
+	bool triIntersect(Record& rec, const Ray& ray, const float* tv, int ID)
+	{
+		if (rec.primID == ID) return false;
+
+		glm::vec3 v0(tv[0], tv[1], tv[2]);
+		glm::vec3 e1(tv[3], tv[4], tv[5]);
+		glm::vec3 e2(tv[6], tv[7], tv[8]);
+
+		glm::vec3 P = glm::cross(ray.dir, e2);
+		float det = glm::dot(e1, P);
+		if (std::fabs(det) < EPSILON) return false;
+		float inv_det = 1.0f / det;
+
+		glm::vec3 T = ray.ori - v0;
+		float uu = glm::dot(T, P) * inv_det;
+		if (uu < 0.0f || uu > 1.0f) return false;
+
+		glm::vec3 Q = glm::cross(T, e1);
+		float vv = glm::dot(ray.dir, Q) * inv_det;
+		if (vv < 0.0f || (uu + vv) > 1.0f) return false;
+
+		float tt = glm::dot(e2, Q) * inv_det;
+		if (tt > EPSILON && tt < rec.t)
+		{
+			rec.primID = ID;
+			rec.prim_type = HIT_TRI;
+			rec.t = tt;
+			return true;
+		}
+		return false;
+	}
+
+	//same test as SphLiINTXN
+	bool lightIntersect(Record& rec, const Ray& ray, const SphereLight& sph, int ID)
+	{
+		glm::vec3 center(sph.ori);
+		float a = glm::dot(ray.dir, ray.dir);
+		float b = 2.0f * glm::dot(ray.dir, ray.ori - center);
+		float c = glm::dot(ray.ori - center, ray.ori - center) - sph.radius * sph.radius;
+		float d = b * b - 4.0f * a * c;
+
+		if (d < 0) return false;
+		float sqrtd = std::sqrt(d);
+		float t1 = (-b - sqrtd) / (a + a);
+		float t2 = (-b + sqrtd) / (a + a);
+
+		if (t1 > 0 && t1 < rec.t)
+		{
+			rec.primID = ID;
+			rec.prim_type = HIT_LIGHT;
+			rec.t = t1;
+			return true;
+		}
+		else if (t2 > 0 && t2 < rec.t)
+		{
+			rec.primID = ID;
+			rec.prim_type = HIT_LIGHT;
+			rec.t = t2;
+			return true;
+		}
+		return false;
+	}
+
+	//same walk as LightTreeINTXN
+	void lightTreeIntersect(const SceneRef& s, const Ray& ray, Record& rec)
+	{
+		if (s.info->lightNodes == 0) return;
+
+		int stack[LIGHT_STACK];
+		int top = 0;
+		int id = 0;
+		for (;;)
+		{
+			const LightNode& node = s.lightNodes[id];
+			float enter = 0.0f, exit = rec.t;
+			for (int a = 0; a < 3; a++)
+			{
+				float t1 = (node.lo[a] - ray.ori[a]) * ray.revdir[a];
+				float t2 = (node.hi[a] - ray.ori[a]) * ray.revdir[a];
+				enter = std::max(enter, std::min(t1, t2));
+				exit = std::min(exit, std::max(t1, t2));
+			}
+			if (enter <= exit)
+			{
+				if (node.child < 0) lightIntersect(rec, ray, s.lights[node.light], node.light);
+				else if (top < LIGHT_STACK)
+				{
+					stack[top++] = node.child + 1;
+					id = node.child;
+					continue;
+				}
+			}
+			if (top == 0) break;
+			id = stack[--top];
+		}
+	}
+
+	//stackKDtreeTraversal from an arbitrary node and ray interval
+	void traverse(const SceneRef& s, int nodeID, float tEntry, float tExit, const Ray& ray, Record& rec)
+	{
+		KdToDo todo[STACK_SIZE];
+		int todoPos = 0;
+
+		while (nodeID != -1)
+		{
+			if (rec.t < tEntry) break;
+
+			const KDNode& node = s.kdnodes[nodeID];
+			if (node.stat == isNode)
+			{
+				int axis = node.axis;
+				float oriv = ray.ori[axis];
+				float dir = ray.dir[axis];
+				float tPlane = (node.split - oriv) * ray.revdir[axis];
+
+				bool belowfirst = (oriv < node.split) || (oriv == node.split && dir <= 0);
+				int firstchild = belowfirst ? node.child_id.x : node.child_id.y;
+				int secondchild = belowfirst ? node.child_id.y : node.child_id.x;
+
+				if (tPlane > tExit || tPlane <= 0) nodeID = firstchild;
+				else if (tPlane < tEntry) nodeID = secondchild;
+				else
+				{
+					todo[todoPos].nodeid = secondchild;
+					todo[todoPos].tMin = tPlane;
+					todo[todoPos].tMax = tExit;
+					++todoPos;
+
+					nodeID = firstchild;
+					tExit = tPlane;
+				}
+			}
+			else
+			{
+				for (int i = node.start; i < node.end; ++i)
+				{
+					int tid = s.kdtriangles[i];
+					triIntersect(rec, ray, s.triVerts + 9 * tid, tid);
+				}
+
+				if (todoPos > 0)
+				{
+					--todoPos;
+					nodeID = todo[todoPos].nodeid;
+					tEntry = todo[todoPos].tMin;
+					tExit = todo[todoPos].tMax;
+				}
+				else break;
+			}
+		}
+	}
+
+	void intersectScene(const SceneRef& s, const Ray& ray, Record& rec)
+	{
+		float tmin, tmax;
+		if (!boxIntersect(s.bound, ray, tmin, tmax)) return;
+		traverse(s, 0, tmin, tmax, ray, rec);
+	}
+
+	//closest triangle hit for 8 rays sharing one origin.
+	//lanes outside laneMask report a miss
+	void packetTraverse(const SceneRef& s, const glm::vec3& origin, const float* dir[3],
+		int laneMask, float* outT, int* outID)
+	{
+		f8 o[3] = { f8(origin.x), f8(origin.y), f8(origin.z) };
+		f8 D[3], I[3];
+		for (int a = 0; a < 3; a++)
+		{
+			D[a] = f8::load(dir[a]);
+			I[a] = f8(1.0f) / D[a];
+		}
+
+		//root box
+		f8 tmin(-FLT_MAX), tmax(FLT_MAX);
+		for (int a = 0; a < 3; a++)
+		{
+			f8 t1 = (f8(s.bound[a]) - o[a]) * I[a];
+			f8 t2 = (f8(s.bound[a + 3]) - o[a]) * I[a];
+			tmin = max8(tmin, min8(t1, t2));
+			tmax = min8(tmax, max8(t1, t2));
+		}
+
+		float laneBits[8];
+		for (int i = 0; i < 8; i++) laneBits[i] = (laneMask >> i) & 1 ? 1.0f : 0.0f;
+		f8 valid = (f8::load(laneBits) > f8(0.0f)) & (tmax > tmin);
+
+		const f8 empty_min(FLT_MAX), empty_max(-FLT_MAX);
+		tmin = select(valid, tmin, empty_min);
+		tmax = select(valid, tmax, empty_max);
+
+		f8 hitT(FLT_MAX);
+		f8 hitID = f8::fromInt(-1);
+
+		struct Entry { int node; f8 tmin, tmax; };
+		Entry stack[STACK_SIZE];
+		int sp = 0;
+		int nodeID = 0;
+
+		auto pop = [&]() -> bool
+		{
+			if (sp == 0) return false;
+			--sp;
+			nodeID = stack[sp].node;
+			tmin = stack[sp].tmin;
+			tmax = stack[sp].tmax;
+			return true;
+		};
+
+		for (;;)
+		{
+			//lanes with an interval in front of their closest hit
+			f8 act = (tmin <= tmax) & (tmin <= hitT);
+			int am = movemask(act);
+			if (am == 0)
+			{
+				if (!pop()) break;
+				continue;
+			}
+
+			const KDNode& node = s.kdnodes[nodeID];
+			if (node.stat == isNode)
+			{
+				int axis = node.axis;
+				f8 split(node.split);
+				f8 tPlane = (split - o[axis]) * I[axis];
+				f8 below = (o[axis] < split) | ((o[axis] == split) & (D[axis] <= f8(0.0f)));
+				int bm = movemask(below & act);
+
+				if (bm != 0 && bm != am)
+				{
+					//lanes disagree on the near child, finish this subtree ray by ray
+					float lmin[8], lmax[8], lt[8], lid[8], ld[3][8];
+					tmin.store(lmin); tmax.store(lmax); hitT.store(lt); hitID.store(lid);
+					for (int a = 0; a < 3; a++) D[a].store(ld[a]);
+
+					for (int l = 0; l < 8; l++)
+					{
+						if (!((am >> l) & 1)) continue;
+						Ray ray;
+						ray.ori = origin;
+						ray.dir = glm::vec3(ld[0][l], ld[1][l], ld[2][l]);
+						ray.revdir = 1.0f / ray.dir;
+						Record rec = newRecord();
+						rec.t = lt[l];
+						memcpy(&rec.primID, &lid[l], sizeof(int));
+						traverse(s, nodeID, lmin[l], lmax[l], ray, rec);
+						lt[l] = rec.t;
+						memcpy(&lid[l], &rec.primID, sizeof(int));
+					}
+					hitT = f8::load(lt);
+					hitID = f8::load(lid);
+
+					if (!pop()) break;
+					continue;
+				}
+
+				int firstchild = bm ? node.child_id.x : node.child_id.y;
+				int secondchild = bm ? node.child_id.y : node.child_id.x;
+
+				f8 firstOnly = (tPlane > tmax) | (tPlane <= f8(0.0f));
+				f8 secondOnly = andnot(tPlane < tmin, firstOnly);
+				f8 needFirst = andnot(act, secondOnly);
+				f8 needSecond = andnot(act, firstOnly);
+				int mf = movemask(needFirst);
+				int ms = movemask(needSecond);
+
+				if (mf && ms)
+				{
+					stack[sp].node = secondchild;
+					stack[sp].tmin = select(needSecond, max8(tmin, tPlane), empty_min);
+					stack[sp].tmax = select(needSecond, tmax, empty_max);
+					++sp;
+
+					nodeID = firstchild;
+					tmax = select(needSecond, tPlane, tmax);
+					tmin = select(needFirst, tmin, empty_min);
+					tmax = select(needFirst, tmax, empty_max);
+				}
+				else if (mf)
+				{
+					nodeID = firstchild;
+					tmin = select(needFirst, tmin, empty_min);
+					tmax = select(needFirst, tmax, empty_max);
+				}
+				else if (ms)
+				{
+					nodeID = secondchild;
+					tmin = select(needSecond, max8(tmin, tPlane), empty_min);
+					tmax = select(needSecond, tmax, empty_max);
+				}
+				else if (!pop()) break;
+			}
+			else
+			{
+				//leaf, every triangle against all active rays
+				for (int i = node.start; i < node.end; ++i)
+				{
+					int tid = s.kdtriangles[i];
+					const float* tv = s.triVerts + 9 * tid;
+
+					f8 e1[3] = { f8(tv[3]), f8(tv[4]), f8(tv[5]) };
+					f8 e2[3] = { f8(tv[6]), f8(tv[7]), f8(tv[8]) };
+
+					f8 Px = D[1] * e2[2] - D[2] * e2[1];
+					f8 Py = D[2] * e2[0] - D[0] * e2[2];
+					f8 Pz = D[0] * e2[1] - D[1] * e2[0];
+					f8 det = e1[0] * Px + e1[1] * Py + e1[2] * Pz;
+					f8 inv_det = f8(1.0f) / det;
+
+					//shared origin, T and Q are the same for every lane
+					glm::vec3 T = origin - glm::vec3(tv[0], tv[1], tv[2]);
+					glm::vec3 Q = glm::cross(T, glm::vec3(tv[3], tv[4], tv[5]));
+
+					f8 uu = (f8(T.x) * Px + f8(T.y) * Py + f8(T.z) * Pz) * inv_det;
+					f8 vv = (D[0] * f8(Q.x) + D[1] * f8(Q.y) + D[2] * f8(Q.z)) * inv_det;
+					f8 tt = (e2[0] * f8(Q.x) + e2[1] * f8(Q.y) + e2[2] * f8(Q.z)) * inv_det;
+
+					f8 hit = act & (abs8(det) >= f8(EPSILON))
+						& (uu >= f8(0.0f)) & (uu <= f8(1.0f))
+						& (vv >= f8(0.0f)) & ((uu + vv) <= f8(1.0f))
+						& (tt > f8(EPSILON)) & (tt < hitT);
+
+					hitT = select(hit, tt, hitT);
+					hitID = select(hit, f8::fromInt(tid), hitID);
+				}
+
+				if (!pop()) break;
+			}
+		}
+
+		float lid[8];
+		hitT.store(outT);
+		hitID.store(lid);
+		memcpy(outID, lid, sizeof(lid));
+	}
+
+	//same as ShadeLight
+	float shadeLight(const SceneRef& s, const SphereLight& sphl, const glm::vec3& hit_point, const glm::vec3& normal, int primID)
+	{
+		glm::vec3 center(sphl.ori);
+		glm::vec3 toLight = center - hit_point;
+		float dist = glm::length(toLight);
+		if (dist > sphl.range) return 0.0f;
+
+		Ray shadowRay;
+		shadowRay.dir = toLight / dist;
+		float dot_prod = glm::dot(normal, shadowRay.dir);
+		if (dot_prod <= 0.0f) return 0.0f;
+		shadowRay.ori = hit_point + shadowRay.dir * EPSILON;
+		shadowRay.revdir = 1.0f / shadowRay.dir;
+
+		Record& shade_rec = shadowRay.rec;
+		shade_rec = newRecord();
+		shade_rec.prim_type = HIT_LIGHT;
+		shade_rec.t = glm::distance(shadowRay.ori, center);
+		shade_rec.primID = primID;
+
+		intersectScene(s, shadowRay, shade_rec);
+		return shade_rec.prim_type == HIT_LIGHT ? dot_prod : 0.0f;
+	}
+
+	//continuePath of the kernel: a new ray is traced while the pixel has
+	//budget left (-1 is no limit) and its weight is at least info.cutoff,
+	//below it progressive frames keep it at odds weight / cutoff
+	bool continuePath(const Info& info, Sampler& sampler, Ray& ray, int& budget)
+	{
+		if (budget == 0) return false;
+		glm::vec4 w = ray.weight * ray.transparency;
+		float weight = std::max(w.x, std::max(w.y, w.z));
+		if (weight < info.cutoff)
+		{
+			if (info.adaptive == ADAPTIVE_OFF) return false;
+			float q = weight / info.cutoff;
+			if (Sample1D(sampler) >= q) return false;
+			ray.weight /= q;
+		}
+		if (budget > 0) --budget;
+		return true;
+	}
+
+	//PathTracing_kdtree ray loop for one pixel.
+	//primary.rec already holds the triangle hit if primaryTraced
+	glm::vec4 shadePixel(const SceneRef& s, const Ray& primary, bool primaryTraced, unsigned x, unsigned y)
+	{
+		const Info& info = *s.info;
+		glm::vec4 pixel(0, 0, 0, 0);
+		Sampler sampler = MakeSampler((RTsampler)info.sampler, x, y, (uint32_t)info.width, (uint32_t)info.samples);
+		int budget = info.rayBudget > 0 ? info.rayBudget : -1;
+
+		int ray_count = 0;
+		Ray ray_queue[16];
+		ray_queue[ray_count++] = primary;
+
+		bool traced = primaryTraced;
+		while (ray_count > 0)
+		{
+			Ray current_ray = ray_queue[--ray_count];
+			Record& current_rec = current_ray.rec;
+
+			//find all triangles intersection
+			if (!traced) intersectScene(s, current_ray, current_rec);
+			traced = false;
+
+			//find the closest light
+			lightTreeIntersect(s, current_ray, current_rec);
+
+			if (current_rec.prim_type == HIT_TRI)
+			{
+				const Triangle& tri = s.triangles[current_rec.primID];
+				glm::vec3 normal = glm::normalize(glm::vec3(tri.n0));
+				glm::vec4 color = tri.m0.color;
+				current_ray.last_prim_color = tri.m0.color;
+
+				//shadow, every light is shaded on its own
+				glm::vec4 acc(0, 0, 0, 0);
+				glm::vec3 hit_point = current_ray.ori + current_ray.dir * current_rec.t;
+
+				if (info.lightSampling == RT_LIGHTS_SAMPLED)
+				{
+					for (int k = 0; k < info.shadowRays; ++k)
+					{
+						float pdf;
+						int id = SampleLight(s.lightNodes, info.lightNodes, hit_point, normal, Sample1D(sampler), pdf);
+						if (id < 0) break;
+						float shade = shadeLight(s, s.lights[id], hit_point, normal, current_rec.primID);
+						acc += shade / (pdf * info.shadowRays) * color;
+					}
+				}
+				else if (info.lightNodes > 0)
+				{
+					int stack[LIGHT_STACK];
+					int top = 0;
+					int id = 0;
+					for (;;)
+					{
+						const LightNode& node = s.lightNodes[id];
+						if (LightNodeVisible(node, hit_point, normal))
+						{
+							if (node.child < 0)
+								acc += shadeLight(s, s.lights[node.light], hit_point, normal, current_rec.primID) * color;
+							else if (top < LIGHT_STACK)
+							{
+								stack[top++] = node.child + 1;
+								id = node.child;
+								continue;
+							}
+						}
+						if (top == 0) break;
+						id = stack[--top];
+					}
+				}
+
+				switch (current_ray.ray_type)
+				{
+				case Origin:
+					pixel += acc * current_ray.weight;
+					break;
+				case Reflec:
+					pixel += acc * current_ray.last_prim_color * current_ray.weight * current_ray.transparency;
+					break;
+				case Refrac:
+					pixel += acc * current_ray.weight * current_ray.transparency;
+					break;
+				}
+
+				//handle reflection & refraction
+				if (info.maxdepth > current_rec.depth)
+				{
+					if (tri.brdf_type == DIELEC)
+					{
+						float refrac;
+						glm::vec3 N;
+						if (current_rec.isInPrim)
+						{
+							refrac = 1.66f;
+							N = -normal;
+						}
+						else
+						{
+							refrac = 1.0f / 1.66f;
+							N = normal;
+						}
+
+						float cosI = -glm::dot(current_ray.dir, N);
+						float cos2T = 1.0f - refrac * refrac * (1.0f - cosI * cosI);
+
+						if (cos2T > 0)
+						{
+							glm::vec3 new_dir = (refrac * current_ray.dir) + (refrac * cosI - std::sqrt(cos2T)) * N;
+							Ray new_ray;
+							new_ray.dir = glm::normalize(new_dir);
+							new_ray.ori = hit_point + new_ray.dir * EPSILON;
+							new_ray.revdir = 1.0f / new_ray.dir;
+							new_ray.last_prim_color = current_ray.last_prim_color;
+							new_ray.weight = current_ray.weight;
+							new_ray.transparency = current_ray.transparency * 0.8f;
+							new_ray.ray_type = Refrac;
+
+							new_ray.rec = newRecord();
+							new_ray.rec.isInPrim = !current_rec.isInPrim;
+							new_ray.rec.depth = current_rec.depth + 1;
+							if (continuePath(info, sampler, new_ray, budget)) ray_queue[ray_count++] = new_ray;
+						}
+					}
+					if (tri.brdf_type == MIRR)
+					{
+						glm::vec3 n0(tri.n0);
+						glm::vec3 new_dir = current_ray.dir - 2.0f * glm::dot(current_ray.dir, n0) * n0;
+						Ray new_ray;
+						new_ray.dir = glm::normalize(new_dir);
+						new_ray.ori = hit_point + new_ray.dir * EPSILON;
+						new_ray.revdir = 1.0f / new_ray.dir;
+						new_ray.last_prim_color = current_ray.last_prim_color;
+						new_ray.weight = current_ray.weight * 0.8f;
+						new_ray.transparency = current_ray.transparency;
+						new_ray.ray_type = Reflec;
+
+						new_ray.rec = newRecord();
+						new_ray.rec.depth = current_rec.depth + 1;
+						if (continuePath(info, sampler, new_ray, budget)) ray_queue[ray_count++] = new_ray;
+					}
+				}
+			}
+			else if (current_rec.prim_type == HIT_LIGHT)
+			{
+				pixel = glm::vec4(1, 1, 1, 1);
+			}
+			else
+			{
+				pixel = glm::vec4(0, 0, 0, 0);
+			}
+		}
+
+		return pixel;
+	}
+
+} // end namespace
+
+NativeTracer::NativeTracer(unsigned width /* = 800 */, unsigned height /* = 600 */, unsigned threads /* = 0 */)
+	:width(width), height(height), generation(0), busy(0), quit(false),
+	info(NULL), camera(NULL), bound(NULL), kdnodes(NULL), kdtriangles(NULL),
+	triangles(NULL), lights(NULL), lightNodes(NULL), frame(NULL)
+{
+	tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+	if (threads == 0) threads = std::thread::hardware_concurrency();
+	if (threads == 0) threads = 1;
+
+	queues = std::vector<TileQueue>(threads);
+	for (unsigned i = 0; i < threads; i++)
+		workers.emplace_back(&NativeTracer::Worker, this, i);
+}
+
+NativeTracer::~NativeTracer()
+{
+	{
+		std::lock_guard<std::mutex> lk(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto& w : workers) w.join();
+}
+
+void NativeTracer::Render(const Info& info, const PinholeCamera& camera, const float bound[6],
+	const std::vector<KDNode>& kdnodes, const std::vector<int>& kdtriangles,
+	const std::vector<Triangle>& triangles, const std::vector<SphereLight>& lights,
+	const std::vector<LightNode>& lightNodes, float* frame)
+{
+	//testing light, no support light disable (same as the kernel)
+	if (info.light_enable == false) return;
+	if (kdnodes.empty() || frame == NULL) return;
+
+	//v0, e1, e2 packed for intersection tests
+	triVerts.resize(triangles.size() * 9);
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		const Triangle& tri = triangles[i];
+		float* tv = &triVerts[i * 9];
+		glm::vec3 v0(tri.v0), v1(tri.v1), v2(tri.v2);
+		glm::vec3 e1 = v1 - v0, e2 = v2 - v0;
+		tv[0] = v0.x; tv[1] = v0.y; tv[2] = v0.z;
+		tv[3] = e1.x; tv[4] = e1.y; tv[5] = e1.z;
+		tv[6] = e2.x; tv[7] = e2.y; tv[8] = e2.z;
+	}
+
+	this->info = &info;
+	this->camera = &camera;
+	this->bound = bound;
+	this->kdnodes = kdnodes.data();
+	this->kdtriangles = kdtriangles.data();
+	this->triangles = triangles.data();
+	this->lights = lights.data();
+	this->lightNodes = lightNodes.data();
+	this->frame = frame;
+
+	//deal tiles to workers in contiguous runs, idle workers steal from the back of others
+	unsigned tileCount = tilesX * tilesY;
+	unsigned n = (unsigned)workers.size();
+	for (unsigned w = 0; w < n; w++)
+	{
+		std::lock_guard<std::mutex> lk(queues[w].lock);
+		queues[w].tiles.clear();
+		for (unsigned t = tileCount * w / n; t < tileCount * (w + 1) / n; t++)
+			queues[w].tiles.push_back(t);
+	}
+
+	std::unique_lock<std::mutex> lk(lock);
+	busy = n;
+	++generation;
+	wake.notify_all();
+	done.wait(lk, [this] { return busy == 0; });
+}
+
+void NativeTracer::Worker(unsigned id)
+{
+	unsigned seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lk(lock);
+			wake.wait(lk, [&] { return quit || generation != seen; });
+			if (quit) return;
+			seen = generation;
+		}
+
+		int tile;
+		while (NextTile(id, tile)) TraceTile(tile);
+
+		std::lock_guard<std::mutex> lk(lock);
+		if (--busy == 0) done.notify_one();
+	}
+}
+
+bool NativeTracer::NextTile(unsigned id, int& tile)
+{
+	unsigned n = (unsigned)queues.size();
+	for (unsigned k = 0; k < n; k++)
+	{
+		TileQueue& q = queues[(id + k) % n];
+		std::lock_guard<std::mutex> lk(q.lock);
+		if (q.tiles.empty()) continue;
+
+		//own queue from the front, stolen work from the back
+		if (k == 0)
+		{
+			tile = q.tiles.front();
+			q.tiles.pop_front();
+		}
+		else
+		{
+			tile = q.tiles.back();
+			q.tiles.pop_back();
+		}
+		return true;
+	}
+	return false;
+}
+
+void NativeTracer::TraceTile(int tile)
+{
+	SceneRef s = { info, bound, kdnodes, kdtriangles, triangles, lights, lightNodes, triVerts.data() };
+
+	glm::vec3 pos(camera->pos);
+	glm::vec3 ul(camera->ulViewPos);
+	glm::vec3 dx(camera->dxUnit);
+	glm::vec3 dy(camera->dyUnit);
+
+	unsigned x0 = (tile % tilesX) * TILE_SIZE;
+	unsigned y0 = (tile / tilesX) * TILE_SIZE;
+	unsigned x1 = std::min(x0 + TILE_SIZE, width);
+	unsigned y1 = std::min(y0 + TILE_SIZE, height);
+
+	for (unsigned py = y0; py < y1; py += PACKET_H)
+	{
+		for (unsigned px = x0; px < x1; px += PACKET_W)
+		{
+			float dirs[3][8];
+			const float* dirp[3] = { dirs[0], dirs[1], dirs[2] };
+			int laneMask = 0;
+
+			for (int l = 0; l < 8; l++)
+			{
+				unsigned x = px + l % PACKET_W;
+				unsigned y = py + l / PACKET_W;
+				glm::vec3 d(0, 0, -1);
+				if (x < x1 && y < y1)
+				{
+					glm::vec3 viewPoint = ul + dx * (float)x - dy * (float)y;
+					d = glm::normalize(viewPoint - pos);
+					laneMask |= 1 << l;
+				}
+				dirs[0][l] = d.x;
+				dirs[1][l] = d.y;
+				dirs[2][l] = d.z;
+			}
+
+			float hitT[8];
+			int hitID[8];
+			packetTraverse(s, pos, dirp, laneMask, hitT, hitID);
+
+			for (int l = 0; l < 8; l++)
+			{
+				if (!((laneMask >> l) & 1)) continue;
+				unsigned x = px + l % PACKET_W;
+				unsigned y = py + l / PACKET_W;
+
+				Ray primary_ray;
+				primary_ray.ori = pos;
+				primary_ray.dir = glm::vec3(dirs[0][l], dirs[1][l], dirs[2][l]);
+				primary_ray.revdir = 1.0f / primary_ray.dir;
+				primary_ray.weight = glm::vec4(1, 1, 1, 1);
+				primary_ray.transparency = glm::vec4(1, 1, 1, 1);
+				primary_ray.last_prim_color = glm::vec4(0, 0, 0, 0);
+				primary_ray.ray_type = Origin;
+				primary_ray.rec = newRecord();
+				if (hitID[l] >= 0)
+				{
+					primary_ray.rec.primID = hitID[l];
+					primary_ray.rec.prim_type = HIT_TRI;
+					primary_ray.rec.t = hitT[l];
+				}
+
+				glm::vec4 pixel = shadePixel(s, primary_ray, true, x, y);
+				float* dst = frame + 4 * (x + y * width);
+				dst[0] = pixel.x;
+				dst[1] = pixel.y;
+				dst[2] = pixel.z;
+				dst[3] = pixel.w;
+			}
+		}
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "RTstruct.h"
+#include "KDstruct.h"
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+//------ native c++ tracer
+// traverses the same kdnodes / kdtriangles arrays as PathTracing_kdtree and
+// reproduces its shading, so it renders without an opencl icd and serves as
+// a reference for the device kernel.
+// primary rays are traced as 8 wide packets (avx2 if compiled with it),
+// 16x16 tiles are spread over all cores with work stealing.
+class NativeTracer
+{
+public:
+
+	NativeTracer(unsigned width = 800, unsigned height = 600, unsigned threads = 0);
+	~NativeTracer();
+
+	//bound is the kd-tree world bound, min xyz then max xyz.
+	//frame is width * height RGBA floats, top row first
+	void Render(const Info& info, const PinholeCamera& camera, const float bound[6],
+		const std::vector<KDNode>& kdnodes, const std::vector<int>& kdtriangles,
+		const std::vector<Triangle>& triangles, const std::vector<SphereLight>& lights,
+		const std::vector<LightNode>& lightNodes, float* frame);
+
+	unsigned ThreadCount() const { return (unsigned)workers.size(); }
+
+private:
+
+	struct TileQueue
+	{
+		std::mutex lock;
+		std::deque<int> tiles;
+	};
+
+	void Worker(unsigned id);
+	bool NextTile(unsigned id, int& tile);
+	void TraceTile(int tile);
+
+	unsigned width, height;
+	unsigned tilesX, tilesY;
+
+	//thread pool
+	std::vector<std::thread> workers;
+	std::vector<TileQueue> queues;
+	std::mutex lock;
+	std::condition_variable wake, done;
+	unsigned generation, busy;
+	bool quit;
+
+	//scene of the current Render call
+	const Info* info;
+	const PinholeCamera* camera;
+	const float* bound;
+	const KDNode* kdnodes;
+	const int* kdtriangles;
+	const Triangle* triangles;
+	const SphereLight* lights;
+	const LightNode* lightNodes;
+	float* frame;
+	std::vector<float> triVerts;    //v0, e1, e2 per triangle for intersection
+};
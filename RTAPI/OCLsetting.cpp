@@ -1,18 +1,37 @@
 #include "OCLsetting.h"
 #include "RTstruct.h"
+#include "KDstruct.h"
+#include "Sampler.h"
 #include <CL\cl_gl.h>
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <GL/glx.h>
+#endif
 #include <fstream>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
 
 #define DEBUG_CL
 #define USE_DEVICE "Intel"
 
 OCLsetting::OCLsetting(unsigned width /* = 800 */, unsigned height /* = 600 */)
-	:isInit(false), platform(NULL), device(NULL), context(NULL),
-	queue(NULL), program(NULL), kernel_PathTracing(NULL)
+	:nodeImgOf(NULL), blockImgOf(NULL), triImgOf(NULL), platform(NULL), device(NULL), context(NULL),
+	queue(NULL), program(NULL), kernel_PathTracing(NULL), kernel_PathTracing_KDtree(NULL),
+	imageProgram(NULL), kernel_PathTracing_KDtree_image(NULL), kernel_AdaptiveWorkList(NULL), kernel_EdgeWorkList(NULL),
+	kernel_DenoiseTemporal(NULL), kernel_DenoiseAtrous(NULL), kernel_CacheDepth(NULL), kernel_CacheScatter(NULL),
+	kernel_CacheWorkList(NULL), kernel_RateWorkList(NULL), kernel_RateFill(NULL), isInit(false), glinterop(false),
+	frameBuf(NULL), triBuf(NULL), sphlBuf(NULL), blockBuf(NULL), nodeBuf(NULL), intxnBuf(NULL), rayCountBuf(NULL),
+	tileCounterBuf(NULL), triCap(0), lightNodeBuf(NULL), lightCap(0), pixelStatBuf(NULL), pixelGeomBuf(NULL), workListBuf(NULL), workCountBuf(NULL), blueNoiseBuf(NULL),
+	radianceBuf(NULL), prevGeomBuf(NULL), historyBuf(NULL), prevHistoryBuf(NULL), cacheBuf(NULL), prevCacheBuf(NULL),
+	cacheDepthBuf(NULL), rateBuf(NULL), nodeImg(NULL), blockImg(NULL), triImg(NULL),
+	simdWidth(1), groupLimit(0), nodeCache(0), persistentGroups(1)
 {
 	ndr[0] = width;
 	ndr[1] = height;
+	filterBuf[0] = filterBuf[1] = NULL;
 }
 
 void OCLsetting::CheckInit()
@@ -41,12 +60,19 @@ bool OCLsetting::FindCLGLInteropDevice(std::vector<cl_platform_id>& plts)
 			cl_context_properties props[] = 
 			{
 				CL_CONTEXT_PLATFORM,(cl_context_properties)platform,
+#ifdef _WIN32
 				CL_GL_CONTEXT_KHR,	(cl_context_properties)wglGetCurrentContext(),
 				CL_WGL_HDC_KHR,		(cl_context_properties)wglGetCurrentDC(),
+#else
+				CL_GL_CONTEXT_KHR,	(cl_context_properties)glXGetCurrentContext(),
+				CL_GLX_DISPLAY_KHR,	(cl_context_properties)glXGetCurrentDisplay(),
+#endif
 				0
 			};
-			printf("%s\n", name);
 			context = clCreateContext(props, 1, &device, NULL, NULL, NULL);
+			//no current gl context (e.g. render node), try next platform
+			if (context == NULL) continue;
+			printf("%s\n", name);
 			clGetDeviceInfo(device, CL_DEVICE_NAME, 256, name, NULL);
 			printf("%s\n", name);
 			return true;
@@ -55,27 +81,32 @@ bool OCLsetting::FindCLGLInteropDevice(std::vector<cl_platform_id>& plts)
 	return false;
 }
 
-void OCLsetting::FindFirstCLDevice(std::vector<cl_platform_id>& plts)
+bool OCLsetting::FindFirstCLDevice(std::vector<cl_platform_id>& plts, cl_device_type type)
 {
 	int pCount = plts.size();
 
 	for (int i = 0; i < pCount; ++i)
 	{
-		//clGetPlatformInfo(plts[i], CL_PLATFORM_NAME, 256, name, NULL);
+		char name[256];
+		clGetPlatformInfo(plts[i], CL_PLATFORM_NAME, 256, name, NULL);
 
 		cl_uint dCount = 0;
-		clGetDeviceIDs(plts[i], CL_DEVICE_TYPE_GPU, 1, &device, &dCount);
+		clGetDeviceIDs(plts[i], type, 1, &device, &dCount);
 		if (dCount != 0)
 		{
 			platform = plts[i];
 			context = clCreateContext(NULL, 1, &device, NULL, NULL, NULL);
-			//clGetDeviceInfo(device, CL_DEVICE_NAME, 256, name, NULL);
-			break;
+			if (context == NULL) continue;
+			printf("%s\n", name);
+			clGetDeviceInfo(device, CL_DEVICE_NAME, 256, name, NULL);
+			printf("%s\n", name);
+			return true;
 		}
 	}
+	return false;
 }
 
-void OCLsetting::InitCL(bool clglinterop /*= true*/)
+bool OCLsetting::InitCL(bool clglinterop /*= true*/, cl_device_type type /*= CL_DEVICE_TYPE_GPU*/)
 {
 	isInit = true;
 
@@ -85,26 +116,123 @@ void OCLsetting::InitCL(bool clglinterop /*= true*/)
 	std::vector<cl_platform_id> plts(pCount);
 	clGetPlatformIDs(pCount, plts.data(), NULL);
 
-	char name[256];
-
 	bool find = false;
 	
-	//if clglinterop enabled, find clglinterop device
-	if (clglinterop == true) find = FindCLGLInteropDevice(plts);
+	//if clglinterop enabled, find clglinterop device (gpu only)
+	if (clglinterop == true && (type & CL_DEVICE_TYPE_GPU)) find = FindCLGLInteropDevice(plts);
+	glinterop = find;
 
 	//if clglinterop disable and not find clglinterop device, find first one.
-	if(find == false) FindFirstCLDevice(plts);
-	
-#ifdef DEBUG_CL
-	if (context == NULL)
+	//gpu first, then cpu devices such as pocl
+	if (find == false && (type & CL_DEVICE_TYPE_GPU)) find = FindFirstCLDevice(plts, CL_DEVICE_TYPE_GPU);
+	if (find == false && (type & CL_DEVICE_TYPE_CPU)) find = FindFirstCLDevice(plts, CL_DEVICE_TYPE_CPU);
+
+	if (find == false)
 	{
-		printf("context failed.\n");
-		system("pause");
-		exit(0);
+		printf("no opencl device found.\n");
+		return false;
 	}
+	return SetupCL();
+}
+
+bool OCLsetting::InitCL(cl_device_id dev)
+{
+	isInit = true;
+	glinterop = false;
+
+	device = dev;
+	clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &platform, NULL);
+	context = clCreateContext(NULL, 1, &device, NULL, NULL, NULL);
+
+	char name[256];
+	clGetDeviceInfo(device, CL_DEVICE_NAME, 256, name, NULL);
+	printf("%s\n", name);
 
+	return SetupCL();
+}
+
+//cl_khr_pci_bus_info, older headers lack it
+#ifndef CL_DEVICE_PCI_BUS_INFO_KHR
+#define CL_DEVICE_PCI_BUS_INFO_KHR 0x410F
 #endif
 
+//what tells one physical device from another across platforms: the name of
+//a cpu (vendor runtime and pocl), vendor and pci slot of a gpu. empty if a
+//gpu can not say, then it is never taken for another
+static std::string deviceKey(cl_device_id d, cl_device_type type)
+{
+	char name[256];
+	clGetDeviceInfo(d, CL_DEVICE_NAME, 256, name, NULL);
+	if (type == CL_DEVICE_TYPE_CPU) return name;
+
+	size_t size = 0;
+	clGetDeviceInfo(d, CL_DEVICE_EXTENSIONS, 0, NULL, &size);
+	std::string extensions(size, '\0');
+	if (size > 0) clGetDeviceInfo(d, CL_DEVICE_EXTENSIONS, size, &extensions[0], NULL);
+	if (extensions.find("cl_khr_pci_bus_info") == std::string::npos) return "";
+
+	//domain, bus, device, function
+	cl_uint pci[4] = { 0, 0, 0, 0 };
+	cl_uint vendor = 0;
+	if (clGetDeviceInfo(d, CL_DEVICE_PCI_BUS_INFO_KHR, sizeof(pci), pci, NULL) != CL_SUCCESS) return "";
+	clGetDeviceInfo(d, CL_DEVICE_VENDOR_ID, sizeof(vendor), &vendor, NULL);
+	char key[64];
+	snprintf(key, sizeof(key), "%x/%x:%x:%x.%x", vendor, pci[0], pci[1], pci[2], pci[3]);
+	return key;
+}
+
+std::vector<cl_device_id> OCLsetting::ListDevices(cl_device_type type)
+{
+	cl_uint pCount = 0;
+	clGetPlatformIDs(0, nullptr, &pCount);
+	std::vector<cl_platform_id> plts(pCount);
+	clGetPlatformIDs(pCount, plts.data(), NULL);
+
+	std::vector<cl_device_id> devs;
+	std::vector<std::string> keys;
+	cl_device_type order[] = { CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_CPU };
+	for (cl_device_type t : order)
+	{
+		if ((type & t) == 0) continue;
+		for (cl_platform_id plt : plts)
+		{
+			cl_uint dCount = 0;
+			clGetDeviceIDs(plt, t, 0, NULL, &dCount);
+			if (dCount == 0) continue;
+			std::vector<cl_device_id> found(dCount);
+			clGetDeviceIDs(plt, t, dCount, found.data(), NULL);
+
+			for (cl_device_id d : found)
+			{
+				//e.g. a cpu seen by both the vendor runtime and pocl, two
+				//gpus of one model stay apart
+				std::string key = deviceKey(d, t);
+				if (!key.empty() && std::find(keys.begin(), keys.end(), key) != keys.end()) continue;
+				if (!key.empty()) keys.push_back(key);
+				devs.push_back(d);
+			}
+		}
+	}
+	return devs;
+}
+
+//build log of program on device, sized by the runtime
+static std::string BuildLog(cl_program program, cl_device_id device)
+{
+	size_t size = 0;
+	clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &size);
+	std::string log(size, '\0');
+	if (size > 0) clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, size, &log[0], NULL);
+	return log;
+}
+
+bool OCLsetting::SetupCL()
+{
+	if (context == NULL)
+	{
+		printf("context failed.\n");
+		return false;
+	}
 
 #ifdef NV_CL12
 
@@ -115,14 +243,11 @@ void OCLsetting::InitCL(bool clglinterop /*= true*/)
 	queue = clCreateCommandQueueWithProperties(context, device, cqprop, NULL);
 #endif
 
-#ifdef DEBUG_CL
 	if (queue == NULL)
 	{
 		printf("queue failed.\n");
-		system("pause");
-		exit(0);
+		return false;
 	}
-#endif
 
 	//read cl code from file
 	std::ifstream ifs1("RayTracing.cl");
@@ -131,17 +256,50 @@ void OCLsetting::InitCL(bool clglinterop /*= true*/)
 	const char* sources[] = { clcode1.data() };
 	int errr;
 	program = clCreateProgramWithSource(context, 1, sources, lengths, &errr);
+	if (program == NULL)
+	{
+		printf("RayTracing.cl not loaded (%d).\n", errr);
+		return false;
+	}
 	errr = clBuildProgram(program, 1, &device, "", NULL, NULL);
+	if (errr != CL_SUCCESS)
+	{
+		printf("RayTracing.cl build failed (%d).\n%s\n", errr, BuildLog(program, device).c_str());
+		return false;
+	}
 
 #ifdef DEBUG_CL
-	char logs[2048];
-	clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, sizeof(char) * 2048, logs, 0);
-	printf("%s\n", logs);
+	printf("%s\n", BuildLog(program, device).c_str());
 
 #endif
 
 	//create kernel
 	kernel_PathTracing_KDtree = clCreateKernel(program, "PathTracing_kdtree", NULL);
+	clGetKernelWorkGroupInfo(kernel_PathTracing_KDtree, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(size_t), &simdWidth, NULL);
+	clGetKernelWorkGroupInfo(kernel_PathTracing_KDtree, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &groupLimit, NULL);
+	nodeCache = LocalNodeCache(device, kernel_PathTracing_KDtree);
+	persistentGroups = PersistentGroups(device);
+	kernel_AdaptiveWorkList = clCreateKernel(program, "AdaptiveWorkList", NULL);
+	kernel_EdgeWorkList = clCreateKernel(program, "EdgeWorkList", NULL);
+	kernel_DenoiseTemporal = clCreateKernel(program, "DenoiseTemporal", NULL);
+	kernel_DenoiseAtrous = clCreateKernel(program, "DenoiseAtrous", NULL);
+	kernel_CacheDepth = clCreateKernel(program, "CacheDepth", NULL);
+	kernel_CacheScatter = clCreateKernel(program, "CacheScatter", NULL);
+	kernel_CacheWorkList = clCreateKernel(program, "CacheWorkList", NULL);
+	kernel_RateWorkList = clCreateKernel(program, "RateWorkList", NULL);
+	kernel_RateFill = clCreateKernel(program, "RateFill", NULL);
+
+	//image fetch variant, image1d_buffer needs opencl 1.2 images
+	cl_bool images = CL_FALSE;
+	clGetDeviceInfo(device, CL_DEVICE_IMAGE_SUPPORT, sizeof(images), &images, NULL);
+	if (images == CL_TRUE)
+	{
+		imageProgram = clCreateProgramWithSource(context, 1, sources, lengths, &errr);
+		if (clBuildProgram(imageProgram, 1, &device, "-DFETCH_IMAGE", NULL, NULL) == CL_SUCCESS)
+			kernel_PathTracing_KDtree_image = clCreateKernel(imageProgram, "PathTracing_kdtree", NULL);
+		else
+			printf("image fetch kernel failed to build, buffers only.\n");
+	}
 
 	//frame buffer
 	float fill = 0.0f;
@@ -149,8 +307,181 @@ void OCLsetting::InitCL(bool clglinterop /*= true*/)
 	frameBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, fsize, NULL, NULL);
 	clEnqueueFillBuffer(queue, frameBuf, &fill, sizeof(float), 0, fsize, 0, NULL, NULL);
 
-	//sphere light buffer
-	sphlBuf = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(SphereLight) * 8, NULL, NULL);
+	//sphere light buffer and its hierarchy
+	ReserveLights(8);
+
+	//intersection count buffer
+	intxnBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int) * ndr[0] * ndr[1] * 2, NULL, NULL);
+
+	//ray counters
+	cl_uint zero = 0;
+	rayCountBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * 4, NULL, NULL);
+	clEnqueueFillBuffer(queue, rayCountBuf, &zero, sizeof(cl_uint), 0, sizeof(cl_uint) * 4, 0, NULL, NULL);
+
+	//persistent tile queue
+	tileCounterBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, NULL);
+
+	//blue noise sampler mask
+	const std::vector<uint32_t>& mask = BlueNoiseMask();
+	blueNoiseBuf = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint) * mask.size(), (void*)mask.data(), NULL);
+	return true;
+}
+
+size_t OCLsetting::LocalNodeCache(cl_device_id device, cl_kernel kernel)
+{
+	cl_device_local_mem_type type = CL_GLOBAL;
+	cl_ulong deviceBytes = 0, kernelBytes = 0;
+	clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_TYPE, sizeof(type), &type, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(deviceBytes), &deviceBytes, NULL);
+	clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_LOCAL_MEM_SIZE, sizeof(kernelBytes), &kernelBytes, NULL);
+	if (type != CL_LOCAL) return 0;
+
+	//other half left so more than one work-group fits a compute unit
+	cl_ulong budget = deviceBytes / 2;
+	if (budget <= kernelBytes) return 0;
+	return (size_t)((budget - kernelBytes) / sizeof(KDNode));
+}
+
+cl_mem OCLsetting::BufferImage(cl_context context, cl_device_id device, cl_mem buffer, size_t texels, cl_channel_order order)
+{
+	size_t maxTexels = 0;
+	clGetDeviceInfo(device, CL_DEVICE_IMAGE_MAX_BUFFER_SIZE, sizeof(maxTexels), &maxTexels, NULL);
+	if (buffer == NULL || texels == 0 || texels > maxTexels) return NULL;
+
+	cl_image_format format = { order, CL_SIGNED_INT32 };
+	cl_image_desc desc;
+	memset(&desc, 0, sizeof(desc));
+	desc.image_type = CL_MEM_OBJECT_IMAGE1D_BUFFER;
+	desc.image_width = texels;
+	desc.buffer = buffer;
+	cl_int err;
+	cl_mem image = clCreateImage(context, CL_MEM_READ_ONLY, &format, &desc, NULL, &err);
+	return err == CL_SUCCESS ? image : NULL;
+}
+
+bool OCLsetting::FetchImages(size_t nodes, size_t blocks)
+{
+	if (kernel_PathTracing_KDtree_image == NULL) return false;
+
+	struct View { cl_mem* image; cl_mem* of; cl_mem buffer; size_t texels; cl_channel_order order; };
+	View views[] = {
+		{ &nodeImg, &nodeImgOf, nodeBuf, nodes * sizeof(KDNode) / 16, CL_RGBA },
+		{ &blockImg, &blockImgOf, blockBuf, blocks * sizeof(TriBlock) / 16, CL_RGBA },
+		{ &triImg, &triImgOf, triBuf, triCap * sizeof(Triangle) / 16, CL_RGBA } };
+
+	bool ok = true;
+	for (View& v : views)
+	{
+		//a view keeps its buffer alive, drop it once the buffer was replaced
+		if (*v.of != v.buffer && *v.image != NULL)
+		{
+			clReleaseMemObject(*v.image);
+			*v.image = NULL;
+		}
+		if (*v.image == NULL)
+		{
+			*v.image = BufferImage(context, device, v.buffer, v.texels, v.order);
+			*v.of = v.buffer;
+		}
+		ok = ok && *v.image != NULL;
+	}
+	return ok;
+}
+
+void OCLsetting::ReserveLights(size_t lights)
+{
+	if (lights <= lightCap) return;
+	if (sphlBuf != NULL) clReleaseMemObject(sphlBuf);
+	if (lightNodeBuf != NULL) clReleaseMemObject(lightNodeBuf);
+
+	//a binary tree over n lights has 2n - 1 nodes
+	lightCap = lights;
+	sphlBuf = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(SphereLight) * lightCap, NULL, NULL);
+	lightNodeBuf = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(LightNode) * (2 * lightCap - 1), NULL, NULL);
+}
+
+void OCLsetting::ReserveWorkList()
+{
+	if (workListBuf != NULL) return;
+	workListBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * ndr[0] * ndr[1], NULL, NULL);
+	workCountBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, NULL);
+}
+
+void OCLsetting::ReserveAdaptive()
+{
+	ReserveWorkList();
+	if (pixelStatBuf == NULL)
+		pixelStatBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(PixelStat) * ndr[0] * ndr[1], NULL, NULL);
+}
+
+void OCLsetting::ReserveGeometry()
+{
+	if (pixelGeomBuf == NULL)
+		pixelGeomBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(PixelGeom) * ndr[0] * ndr[1], NULL, NULL);
+}
+
+void OCLsetting::ReserveAntialias()
+{
+	ReserveWorkList();
+	ReserveGeometry();
+}
+
+void OCLsetting::ReserveRadiance()
+{
+	if (radianceBuf == NULL)
+		radianceBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float4) * ndr[0] * ndr[1], NULL, NULL);
+}
+
+void OCLsetting::ReserveDenoise()
+{
+	ReserveGeometry();
+	ReserveRadiance();
+	if (prevGeomBuf != NULL) return;
+	size_t pixels = ndr[0] * ndr[1];
+	prevGeomBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(PixelGeom) * pixels, NULL, NULL);
+	historyBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(PixelHistory) * pixels, NULL, NULL);
+	prevHistoryBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(PixelHistory) * pixels, NULL, NULL);
+	filterBuf[0] = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float4) * pixels, NULL, NULL);
+	filterBuf[1] = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float4) * pixels, NULL, NULL);
+}
+
+void OCLsetting::ReserveReprojection()
+{
+	ReserveWorkList();
+	if (cacheBuf != NULL) return;
+	size_t pixels = ndr[0] * ndr[1];
+	cacheBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(PixelCache) * pixels, NULL, NULL);
+	prevCacheBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(PixelCache) * pixels, NULL, NULL);
+	cacheDepthBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * pixels, NULL, NULL);
+}
+
+size_t OCLsetting::RateTiles() const
+{
+	return ((ndr[0] + RATE_TILE - 1) / RATE_TILE) * ((ndr[1] + RATE_TILE - 1) / RATE_TILE);
+}
+
+void OCLsetting::ReserveRates()
+{
+	ReserveWorkList();
+	ReserveRadiance();
+	if (rateBuf == NULL)
+		rateBuf = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_uchar) * RateTiles(), NULL, NULL);
+}
+
+size_t OCLsetting::DispatchTile() const
+{
+	//smallest power of two square that fills the simd width, 4 to 16 wide
+	size_t tile = 4;
+	while (tile < 16 && tile * tile < simdWidth) tile *= 2;
+	while (tile > 1 && tile * tile > groupLimit) tile /= 2;
+	return tile > 1 ? tile : 0;
+}
+
+size_t OCLsetting::PersistentGroups(cl_device_id device)
+{
+	cl_uint units = 1;
+	clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(units), &units, NULL);
+	return (size_t)std::max(units, 1u) * 4;
 }
 
 OCLsetting::~OCLsetting()
@@ -158,6 +489,42 @@ OCLsetting::~OCLsetting()
 	if (frameBuf != NULL) clReleaseMemObject(frameBuf);
 	if (triBuf != NULL) clReleaseMemObject(triBuf);
 	if (sphlBuf != NULL) clReleaseMemObject(sphlBuf);
+	if (lightNodeBuf != NULL) clReleaseMemObject(lightNodeBuf);
+	if (blockBuf != NULL) clReleaseMemObject(blockBuf);
+	if (nodeBuf != NULL) clReleaseMemObject(nodeBuf);
+	if (intxnBuf != NULL) clReleaseMemObject(intxnBuf);
+	if (rayCountBuf != NULL) clReleaseMemObject(rayCountBuf);
+	if (tileCounterBuf != NULL) clReleaseMemObject(tileCounterBuf);
+	if (pixelStatBuf != NULL) clReleaseMemObject(pixelStatBuf);
+	if (pixelGeomBuf != NULL) clReleaseMemObject(pixelGeomBuf);
+	if (workListBuf != NULL) clReleaseMemObject(workListBuf);
+	if (workCountBuf != NULL) clReleaseMemObject(workCountBuf);
+	if (blueNoiseBuf != NULL) clReleaseMemObject(blueNoiseBuf);
+	if (radianceBuf != NULL) clReleaseMemObject(radianceBuf);
+	if (prevGeomBuf != NULL) clReleaseMemObject(prevGeomBuf);
+	if (historyBuf != NULL) clReleaseMemObject(historyBuf);
+	if (prevHistoryBuf != NULL) clReleaseMemObject(prevHistoryBuf);
+	if (filterBuf[0] != NULL) clReleaseMemObject(filterBuf[0]);
+	if (filterBuf[1] != NULL) clReleaseMemObject(filterBuf[1]);
+	if (cacheBuf != NULL) clReleaseMemObject(cacheBuf);
+	if (prevCacheBuf != NULL) clReleaseMemObject(prevCacheBuf);
+	if (cacheDepthBuf != NULL) clReleaseMemObject(cacheDepthBuf);
+	if (rateBuf != NULL) clReleaseMemObject(rateBuf);
+	if (nodeImg != NULL) clReleaseMemObject(nodeImg);
+	if (blockImg != NULL) clReleaseMemObject(blockImg);
+	if (triImg != NULL) clReleaseMemObject(triImg);
+	if (kernel_PathTracing_KDtree_image != NULL) clReleaseKernel(kernel_PathTracing_KDtree_image);
+	if (imageProgram != NULL) clReleaseProgram(imageProgram);
+	if (kernel_AdaptiveWorkList != NULL) clReleaseKernel(kernel_AdaptiveWorkList);
+	if (kernel_EdgeWorkList != NULL) clReleaseKernel(kernel_EdgeWorkList);
+	if (kernel_DenoiseTemporal != NULL) clReleaseKernel(kernel_DenoiseTemporal);
+	if (kernel_DenoiseAtrous != NULL) clReleaseKernel(kernel_DenoiseAtrous);
+	if (kernel_CacheDepth != NULL) clReleaseKernel(kernel_CacheDepth);
+	if (kernel_CacheScatter != NULL) clReleaseKernel(kernel_CacheScatter);
+	if (kernel_CacheWorkList != NULL) clReleaseKernel(kernel_CacheWorkList);
+	if (kernel_RateWorkList != NULL) clReleaseKernel(kernel_RateWorkList);
+	if (kernel_RateFill != NULL) clReleaseKernel(kernel_RateFill);
+	if (kernel_PathTracing_KDtree != NULL) clReleaseKernel(kernel_PathTracing_KDtree);
 	if (kernel_PathTracing != NULL) clReleaseKernel(kernel_PathTracing);
 	if (program != NULL) clReleaseProgram(program);
 	if (queue != NULL) clReleaseCommandQueue(queue);
@@ -7,16 +7,42 @@ class OCLsetting
 {
 private:
 	bool FindCLGLInteropDevice(std::vector<cl_platform_id>& plts);
-	void FindFirstCLDevice(std::vector<cl_platform_id>& plts);
+	bool FindFirstCLDevice(std::vector<cl_platform_id>& plts, cl_device_type type);
+	//queue, program, kernels and per device buffers of the chosen context, false on failure
+	bool SetupCL();
+	//buffers the image views were made of
+	cl_mem nodeImgOf, blockImgOf, triImgOf;
+	void ReserveWorkList();
+	void ReserveGeometry();
+	void ReserveRadiance();
 
 public:
 
 	OCLsetting(unsigned width = 800, unsigned height = 600);
 	~OCLsetting();
 
-	void InitCL(bool clglinterop = true);
+	//type may combine CL_DEVICE_TYPE_GPU | CL_DEVICE_TYPE_CPU, gpu is preferred
+	//false when no device was found or the context, queue or program failed
+	bool InitCL(bool clglinterop = true, cl_device_type type = CL_DEVICE_TYPE_GPU);
+	//init on the given device, no gl interop
+	bool InitCL(cl_device_id dev);
 	void CheckInit();
 
+	//every device of all platforms matching type, gpus first.
+	//a cpu exposed by several platforms is listed once, so is a gpu that
+	//reports its pci slot (cl_khr_pci_bus_info)
+	static std::vector<cl_device_id> ListDevices(cl_device_type type);
+	//kd-tree nodes kernel can keep in local memory: half of the device
+	//local memory less what the kernel declares. 0 where local memory
+	//is global memory anyway (cpu devices)
+	static size_t LocalNodeCache(cl_device_id device, cl_kernel kernel);
+	//work-groups a persistent launch starts, a few per compute unit so
+	//each one stays busy while some wait on memory
+	static size_t PersistentGroups(cl_device_id device);
+	//read only image1d_buffer of texels int32 channels over buffer,
+	//NULL if the device has no such images or buffer is too long for one
+	static cl_mem BufferImage(cl_context context, cl_device_id device, cl_mem buffer, size_t texels, cl_channel_order order);
+
 	cl_platform_id platform;
 	cl_device_id device;
 	cl_context context;
@@ -24,13 +50,85 @@ public:
 	cl_program program;
 	cl_kernel kernel_PathTracing;
 	cl_kernel kernel_PathTracing_KDtree;
+	//same kernel built with FETCH_IMAGE, NULL without image support
+	cl_program imageProgram;
+	cl_kernel kernel_PathTracing_KDtree_image;
+	//work lists of the pixels adaptive sampling still traces and of the
+	//edge pixels antialiasing traces again
+	cl_kernel kernel_AdaptiveWorkList;
+	cl_kernel kernel_EdgeWorkList;
+	//temporal and a-trous passes of the denoiser
+	cl_kernel kernel_DenoiseTemporal;
+	cl_kernel kernel_DenoiseAtrous;
+	//reprojection cache: nearest cached hit of each pixel, the cache moved
+	//to the new view and the work list of pixels it leaves to trace
+	cl_kernel kernel_CacheDepth;
+	cl_kernel kernel_CacheScatter;
+	cl_kernel kernel_CacheWorkList;
+	//variable-rate tracing: block corners into the work list, then the rest
+	//of each block from its corner
+	cl_kernel kernel_RateWorkList;
+	cl_kernel kernel_RateFill;
 	//kernel ndrange
 	size_t ndr[2];
 
 	//check if init all cl setting
 	bool isInit;
+	//context shares the current gl context
+	bool glinterop;
 
 	// cl buffer or image for kernel
-	cl_mem frameBuf, triBuf, sphlBuf, kdtriBuf;
+	cl_mem frameBuf, triBuf, sphlBuf, blockBuf;
+	cl_mem nodeBuf, intxnBuf;
+	//4 uint ray counters: primary, reflect, refract, shadow
+	cl_mem rayCountBuf;
+	//next tile of a persistent launch, cleared before each one
+	cl_mem tileCounterBuf;
+	//triangles triBuf can hold
+	size_t triCap;
+	//light hierarchy of the lights in sphlBuf
+	cl_mem lightNodeBuf;
+	//lights sphlBuf can hold, lightNodeBuf holds the nodes of a tree over them
+	size_t lightCap;
+	//grows sphlBuf and lightNodeBuf to lights, contents are lost
+	void ReserveLights(size_t lights);
+	//adaptive sampling: running estimate per frame pixel. antialiasing:
+	//first hit per frame pixel. both: the work list and its length.
+	//NULL until ReserveAdaptive, ReserveAntialias or ReserveDenoise
+	cl_mem pixelStatBuf, pixelGeomBuf, workListBuf, workCountBuf;
+	void ReserveAdaptive();
+	void ReserveAntialias();
+	//BlueNoiseMask of the blue noise sampler
+	cl_mem blueNoiseBuf;
+	//denoiser: the traced frame, first hits and history of the frame before
+	//(swapped with pixelGeomBuf and historyBuf every frame) and the
+	//ping-pong of the a-trous passes. NULL until ReserveDenoise, the traced
+	//frame also until ReserveRates
+	cl_mem radianceBuf, prevGeomBuf, historyBuf, prevHistoryBuf;
+	cl_mem filterBuf[2];
+	void ReserveDenoise();
+	//reprojection cache of this frame and the one before (swapped every
+	//frame) and the nearest distance per pixel. NULL until ReserveReprojection
+	cl_mem cacheBuf, prevCacheBuf, cacheDepthBuf;
+	void ReserveReprojection();
+	//variable-rate tracing: a rate per RATE_TILE square of the frame, written
+	//every frame. NULL until ReserveRates
+	cl_mem rateBuf;
+	size_t RateTiles() const;
+	void ReserveRates();
+	//image views of nodeBuf, blockBuf and triBuf for the image kernel
+	cl_mem nodeImg, blockImg, triImg;
+	//makes the views of the current buffers, false if one can not be made
+	bool FetchImages(size_t nodes, size_t blocks);
+
+	//preferred work-group size multiple of the kd-tree kernel (simd width)
+	//and its work-group size limit
+	size_t simdWidth, groupLimit;
+	//side of the square work-group for tiled dispatch, 0 if scanline only
+	size_t DispatchTile() const;
+	//LocalNodeCache of the kd-tree kernel
+	size_t nodeCache;
+	//PersistentGroups of the device
+	size_t persistentGroups;
 
 };
\ No newline at end of file
@@ -3,6 +3,28 @@
 //emissive, diffuse, dielectric (palstic), mirror
 typedef enum { EMIS, DIFF, DIELEC, MIRR } BRDFType;
 
+//Info.adaptive: off, accumulate over every pixel, or over the work list
+//of pixels still noisy
+typedef enum { ADAPTIVE_OFF, ADAPTIVE_FULL, ADAPTIVE_LIST } AdaptivePass;
+
+//Info.antialias: off, a first pass keeping the hits edges are found from,
+//or jittered rays over the work list of edge pixels
+typedef enum { AA_OFF, AA_GBUFFER, AA_LIST } AntialiasPass;
+
+//Info.reproject: off, a traced frame filling the cache, or the cache
+//moved to the new view with the work list of pixels it can not fill
+typedef enum { REPROJECT_OFF, REPROJECT_FULL, REPROJECT_LIST } ReprojectPass;
+
+//side of the blue noise mask, its ranks are fractions of 2^32 in steps of
+//BLUE_NOISE_STEP
+#define BLUE_NOISE_SIZE 64
+#define BLUE_NOISE_STEP (0xffffffffu / (BLUE_NOISE_SIZE * BLUE_NOISE_SIZE) + 1)
+
+//variable-rate tracing: one rate per RATE_TILE square of pixels, rate r
+//traces one pixel of each 2^r square block. bands start on whole tiles
+#define RATE_TILE 16
+#define RATE_MAX 2
+
 //for host
 #ifndef __OPENCL_C_VERSION__
 	#include <glm\glm.hpp>
@@ -12,7 +34,8 @@ typedef enum { EMIS, DIFF, DIELEC, MIRR } BRDFType;
 	typedef enum { MISS, LIGHT, TRI, SPH } PrimType;
 #endif
 
-#if defined(_MSC_VER)
+//host structs must match the device layout, where float4 is 16 byte aligned
+#ifndef __OPENCL_C_VERSION__
 #define _CL_ALIGNED_(x) alignas(x)
 #else 
 #define _CL_ALIGNED_(x) 
@@ -35,6 +58,31 @@ typedef struct __Info
 	int samples;
 	int maxdepth;
 	int light_enable;  //1 enable, 0 disable
+	int width;         //frame size, launches may be padded past it
+	int height;
+	int dispatch;      //RTdispatch, pixel order of the work-items
+	int traversal;     //RTtraversal of the primary rays
+	int cachedNodes;   //top kd-tree nodes copied to local memory
+	int schedule;      //RTschedule of the work-groups
+	int first;         //rows first .. first + rows - 1 of the frame are traced
+	int rows;
+	int lightNodes;    //light hierarchy size, pl_SIZE is the light count
+	int lightSampling; //RTlightSampling of the shadow rays
+	int shadowRays;    //per hit with RT_LIGHTS_SAMPLED
+	int adaptive;      //AdaptivePass of the launch
+	int pass;          //samples the pixels have of this view, 0 restarts them
+	float threshold;   //relative error of a converged pixel, 0 turns adaptive off
+	int maxSamples;    //a pixel converges at this many samples
+	int antialias;     //AntialiasPass of the launch
+	int aaSamples;     //jittered rays of an edge pixel, 0 turns antialiasing off
+	int sampler;       //RTsampler of jitter and light picks
+	int denoise;       //a-trous passes of the denoiser, 0 turns it off
+	int history;       //the band's denoiser history is of the frame before
+	int reproject;     //ReprojectPass of the launch
+	float refresh;     //share of the cached pixels traced again every frame
+	int variableRate;  //1 when the rate map sets the pixels traced and their depth
+	float cutoff;      //paths whose weight falls below it end, 0 keeps them to maxdepth
+	int rayBudget;     //reflection and refraction rays of a pixel, 0 is no limit
 } Info;
 
 typedef struct __Material
@@ -51,6 +99,11 @@ typedef struct __Triangle
 	Material m0, m1, m2;
 } Triangle;
 
+#ifndef __OPENCL_C_VERSION__
+static_assert(sizeof(Material) == 32, "Material differs from the device layout");
+static_assert(sizeof(Triangle) == 208, "Triangle differs from the device layout");
+#endif
+
 typedef struct __Sphere
 {
 	CL_VEC4_ALIGN float4 ori;
@@ -64,6 +117,56 @@ typedef struct __SphereLight
 	Material mat;
 	float  radius;
 	int enable;
+	float  range;      //no light past it, FLT_MAX by default
 } SphereLight;
 
+#ifndef __OPENCL_C_VERSION__
+static_assert(sizeof(SphereLight) == 64, "SphereLight differs from the device layout");
+#endif
+
+//node of the light hierarchy, built over the enabled lights every flush.
+//the two children of a node are next to each other
+typedef struct __LightNode
+{
+	CL_VEC4_ALIGN float4 lo;   //bounds of the light spheres below
+	CL_VEC4_ALIGN float4 hi;
+	float power;               //lights below, every light shades the same
+	float range;               //largest range below
+	int child;                 //first child, -1 for a leaf
+	int light;                 //light of a leaf
+} LightNode;
+
+//running estimate of a pixel while the view stays still
+typedef struct __PixelStat
+{
+	CL_VEC4_ALIGN float4 sum;  //rgb sum of the samples, w sample count
+	CL_VEC4_ALIGN float4 lum;  //x sum of their luminance, y of its square
+} PixelStat;
+
+//first hit of a pixel, compared with its neighbours' to find edges and
+//guide the denoiser
+typedef struct __PixelGeom
+{
+	CL_VEC4_ALIGN float4 normal;  //xyz normal of a triangle hit, w distance
+	CL_VEC4_ALIGN float4 albedo;  //color of a triangle hit, else white
+	int prim;                     //triangle, -2 - light for a light, -1 missed
+	int pad[3];
+} PixelGeom;
+
+//traced pixel kept for the frames after, found again by its first hit
+typedef struct __PixelCache
+{
+	CL_VEC4_ALIGN float4 color;     //xyz radiance, w frames since traced
+	CL_VEC4_ALIGN float4 position;  //xyz first hit, w 0 if nothing cached
+	PixelGeom geom;
+} PixelCache;
+
+//denoiser history of a pixel, blended over the frames its surface stayed
+//in view
+typedef struct __PixelHistory
+{
+	CL_VEC4_ALIGN float4 color;    //xyz albedo divided out, w frames blended
+	CL_VEC4_ALIGN float4 moments;  //x luminance, y its square
+} PixelHistory;
+
 
@@ -0,0 +1,110 @@
+#pragma once
+
+//enums shared by the public api (RayTracing.h) and its implementation
+
+/*
+//four tpye: emissive, diffuse, dielectic, mirror,
+// only dielectic type must provide a refractive index
+*/
+typedef enum { RT_MAT_DIFFUSE, RT_MAT_DIELECTRIC, RT_MAT_MIRROR } RTenum;
+
+/*
+// device policy for rtInit
+// RT_DEVICE_ANY prefers a gpu and falls back to cpu devices (e.g. pocl)
+// RT_DEVICE_NATIVE traces with the multi-threaded c++ tracer, no opencl needed
+// RT_DEVICE_ALL splits every frame over all gpu and cpu devices
+*/
+typedef enum { RT_DEVICE_GPU, RT_DEVICE_CPU, RT_DEVICE_ANY, RT_DEVICE_NATIVE, RT_DEVICE_ALL } RTdevice;
+
+/*
+// RT_OUTPUT_WINDOW draws the frame into the current gl context, through
+// cl gl interop if available or a pbo upload otherwise.
+// RT_OUTPUT_HEADLESS never touches gl, read the frame with rtReadPixelsEXT
+*/
+typedef enum { RT_OUTPUT_WINDOW, RT_OUTPUT_HEADLESS } RToutput;
+
+/*
+// pixel order of the kernel work-items, the image is the same in all modes
+// RT_DISPATCH_SCANLINE maps work-items to rows, work-group shape left to the driver
+// RT_DISPATCH_TILE launches square work-groups sized to the device simd width
+// RT_DISPATCH_MORTON tiles walked in z-order, so every simd slice is a near square block
+*/
+typedef enum { RT_DISPATCH_SCANLINE, RT_DISPATCH_TILE, RT_DISPATCH_MORTON } RTdispatch;
+
+/*
+// kd-tree traversal of the primary rays, secondary and shadow rays always go alone
+// RT_TRAVERSAL_SINGLE every work-item walks the tree with its own stack
+// RT_TRAVERSAL_PACKET a work-group walks it together on one stack in local memory
+*/
+typedef enum { RT_TRAVERSAL_SINGLE, RT_TRAVERSAL_PACKET } RTtraversal;
+
+/*
+// how work-groups of the kd-tree kernel get their pixels
+// RT_SCHEDULE_NDRANGE one work-group per tile, the launch covers the band
+// RT_SCHEDULE_PERSISTENT a launch that just fills the device, work-groups
+//   pull tiles from an atomic counter until the band is done
+*/
+typedef enum { RT_SCHEDULE_NDRANGE, RT_SCHEDULE_PERSISTENT } RTschedule;
+
+/*
+// shadow rays of a hit, lights behind it or out of range are always culled
+// RT_LIGHTS_ALL one shadow ray to every light that can shade the hit
+// RT_LIGHTS_SAMPLED a fixed number of shadow rays to lights picked down the
+//   light hierarchy in proportion to what they can add, weighted by the odds
+*/
+typedef enum { RT_LIGHTS_ALL, RT_LIGHTS_SAMPLED } RTlightSampling;
+
+/*
+// sample sequence of subpixel jitter and light picks, indexed by pixel and sample
+// RT_SAMPLER_RANDOM hashed random numbers
+// RT_SAMPLER_STRATIFIED one sample in each cell of a 4x4 grid every 16 samples
+// RT_SAMPLER_SOBOL sobol points, owen scrambled per pixel
+// RT_SAMPLER_R2 the r2 sequence, shifted per pixel
+// RT_SAMPLER_BLUE_NOISE a 64x64 blue noise mask, stepped by r2 per sample
+*/
+typedef enum { RT_SAMPLER_RANDOM, RT_SAMPLER_STRATIFIED, RT_SAMPLER_SOBOL, RT_SAMPLER_R2, RT_SAMPLER_BLUE_NOISE } RTsampler;
+
+//light count and the rtLightfv pname of the light range
+#define RT_MAX_LIGHTS 4096
+#define RT_LIGHT_RANGE 0x120A
+
+/*
+// how the kernel reads kd-tree nodes, leaf lists and triangles
+// RT_FETCH_BUFFER global memory buffers
+// RT_FETCH_IMAGE image1d_buffer views of them, read through the texture cache
+// RT_FETCH_AUTO times both on every device after a build and keeps the faster
+*/
+typedef enum { RT_FETCH_BUFFER, RT_FETCH_IMAGE, RT_FETCH_AUTO } RTfetch;
+
+/*
+// per frame measurements of rtFlush, times in milliseconds.
+// all fields are doubles so rtGetFrameStatsEXT can give percentiles of each.
+// ingest  : rtDrawArrays vertex collection since the last flush
+// upload  : triangle and light transfer to every device
+// kernel  : longest device kernel (or native render) of the frame
+// acquire : cl gl acquire + release
+// blit    : pbo upload and full screen quad
+// build   : kd-tree build, counted in the frame that follows it
+// frame   : time between the ends of two flushes
+// rays    : traced by the kernels, shadow rays include every light test
+// deviceBytes : buffers and images the library holds on all devices
+// imageFallbacks : devices that read buffers because their image views could not be made
+*/
+typedef struct
+{
+	double frame;
+	double ingestMs;
+	double uploadMs;
+	double uploadBytes;
+	double kernelMs;
+	double acquireMs;
+	double blitMs;
+	double buildMs;
+	double primaryRays;
+	double reflectRays;
+	double refractRays;
+	double shadowRays;
+	double frameMs;
+	double deviceBytes;
+	double imageFallbacks;
+} RTframeStats;
@@ -7,6 +7,86 @@
 
 #define MAX_COUNT 48
 
+//Info.dispatch, same values as RTdispatch
+#define DISPATCH_SCANLINE 0
+#define DISPATCH_TILE 1
+#define DISPATCH_MORTON 2
+
+//Info.schedule, same values as RTschedule
+#define SCHEDULE_NDRANGE 0
+#define SCHEDULE_PERSISTENT 1
+
+//Info.traversal, same values as RTtraversal
+#define TRAVERSAL_SINGLE 0
+#define TRAVERSAL_PACKET 1
+
+//shared stack entries of a packet, pbrt trees stay well below
+#define PACKET_STACK 64
+
+//Info.lightSampling, same values as RTlightSampling
+#define LIGHTS_ALL 0
+#define LIGHTS_SAMPLED 1
+
+//Info.sampler, same values as RTsampler
+#define SAMPLER_RANDOM 0
+#define SAMPLER_STRATIFIED 1
+#define SAMPLER_SOBOL 2
+#define SAMPLER_R2 3
+#define SAMPLER_BLUE_NOISE 4
+
+//strata of a stratified dimension, a 4x4 grid for a pair
+#define STRATA 16
+
+//r2 steps and the golden ratio as 32 bit fractions
+#define R2_X 3242174889u
+#define R2_Y 2447445413u
+#define GOLDEN 2654435769u
+
+//light hierarchy stack, deeper than any tree of 4096 lights
+#define LIGHT_STACK 32
+
+//largest float below 1
+#define ONE_BELOW 0.99999994f
+
+//adaptive sampling judges darker pixels against this luminance, black
+//noise would otherwise never converge
+#define ADAPTIVE_FLOOR 0.05f
+
+//neighbouring first hits further apart than this are an edge: cosine
+//between their normals, distance relative to the nearer one
+#define EDGE_NORMAL_COS 0.9f
+#define EDGE_DEPTH 0.05f
+
+//denoiser: least weight of the new frame in the history, history the
+//variance is taken over the neighbours below, albedo channels divided by
+#define DENOISE_ALPHA 0.2f
+#define DENOISE_MIN_HISTORY 4.0f
+#define DENOISE_MIN_ALBEDO 0.05f
+//a-trous edge stopping: power of the normal cosine, relative depth per
+//pixel of tap distance, standard deviations of luminance, albedo distance
+#define DENOISE_NORMAL 64.0f
+#define DENOISE_DEPTH 0.02f
+#define DENOISE_LUM 4.0f
+#define DENOISE_ALBEDO 8.0f
+
+//reprojection cache: frames a pixel is reused at most, cached neighbours
+//it needs, how much further than theirs its hit may be
+#define REPROJECT_MAX_AGE 32.0f
+#define REPROJECT_MIN_NEIGHBOURS 4
+#define REPROJECT_GAP 0.1f
+
+//kd-tree data of the traversal, plain buffers or, built with FETCH_IMAGE,
+//int32 image1d_buffer views of the same bytes read through the texture cache
+#ifdef FETCH_IMAGE
+	#define NODE_BUF read_only image1d_buffer_t
+	#define BLOCK_BUF read_only image1d_buffer_t
+	#define TRI_BUF read_only image1d_buffer_t
+#else
+	#define NODE_BUF global KDNode*
+	#define BLOCK_BUF global TriBlock*
+	#define TRI_BUF global Triangle*
+#endif
+
 #define PUSH_RAY(queue, ray, count) \
 	queue[count++] = ray; \
 
@@ -40,12 +120,70 @@ typedef struct __Ray
 	
 } Ray;
 
+//work-group state of packetKDtreeTraversal, in local memory
+typedef struct __PacketStack
+{
+	KDNode node;         //current node, fetched once for the group
+	float8 box;          //its bounds
+	int nodeID;          //-1 once the stack is empty
+	int top;
+	int vote[2];         //some ray needs the child below / above the split
+	int stackNode[PACKET_STACK];
+	float8 stackBox[PACKET_STACK];
+} PacketStack;
+
+//dimensions of one sample of a pixel, every draw takes the next pair:
+//subpixel jitter first, then one light pick per shaded hit
+typedef struct __Sampler
+{
+	int kind;            //SAMPLER_*
+	uint2 pixel;
+	uint index;          //sample of the pixel
+	uint dim;            //next dimension pair
+	uint scramble;       //per pixel
+	global const uint* blueNoise;
+} Sampler;
+
 float4 barycentricFinder(const float4* v0, const float4* v1, const float4* v2, const float2* uv);
-void stackKDtreeTraversal(float8* kdbound, global KDNode* kdnodes, global Triangle* triangles, global int* tri_list, Record* rec, const Ray* ray);
+KDNode loadNode(NODE_BUF kdnodes, int id);
+TriBlock loadBlock(BLOCK_BUF blocks, int id);
+Triangle loadTriangle(TRI_BUF triangles, int id);
+KDNode fetchNode(NODE_BUF kdnodes, local KDNode* nodeCache, int cachedNodes, int id);
+void stackKDtreeTraversal(float8* kdbound, NODE_BUF kdnodes, local KDNode* nodeCache, int cachedNodes, BLOCK_BUF blocks, Record* rec, const Ray* ray);
 void stacklessRopesKDtreeTraversal(global KDNode* kdnodes, global Triangle* triangles, Record* rec, const Ray* ray);
+void packetKDtreeTraversal(float8* kdbound, NODE_BUF kdnodes, local KDNode* nodeCache, int cachedNodes, BLOCK_BUF blocks, Record* rec, const Ray* ray, bool active, local PacketStack* ps);
 bool AABBINTXN(float2* boxt, const Ray* ray, const KDNode* node, float8* bound);
 bool TriINTXN(Record* rec, const Ray* ray, const Triangle* tri, uint ID);
+bool TriBlockINTXN(Record* rec, const Ray* ray, const TriBlock* block);
 bool SphLiINTXN(Record* rec, const Ray* ray, const SphereLight* sph, uint ID);
+void LightTreeINTXN(Record* rec, const Ray* ray, global const LightNode* lightNodes, int count, global const SphereLight* sphereLights);
+bool LightNodeVisible(const LightNode* node, float4 p, float4 n);
+float LightNodeImportance(const LightNode* node, float4 p, float4 n);
+int SampleLight(global const LightNode* lightNodes, int count, float4 p, float4 n, float u, float* pdf);
+float ShadeLight(float8* nodeBound, NODE_BUF kdnodes, local KDNode* nodeCache, int cachedNodes, BLOCK_BUF blocks,
+	const SphereLight* sphl, float4 hit_point, float4 normal, uint primID, uint* shadowRays);
+uint rngHash(uint x);
+float unitFloat(uint x);
+uint reverseBits(uint x);
+uint owenScramble(uint x, uint seed);
+uint sobol1(uint index);
+Sampler makeSampler(int kind, uint2 pixel, uint width, uint index, global const uint* blueNoise);
+float2 sample2D(Sampler* s);
+float sample1D(Sampler* s);
+uint compactBits(uint v);
+uint2 localPixel(int dispatch);
+uint2 dispatchPixel(int dispatch);
+uint nextGroupTile(global uint* tileCounter, local uint* groupTile);
+void appendWork(bool add, uint offset, local uint* groupCount, local uint* groupBase, global uint* workList, global uint* workCount);
+bool geomEdge(const PixelGeom* a, const PixelGeom* b);
+float luminance(float3 c);
+float3 firstHitPoint(PinholeCamera camera, uint2 pixelID, float t);
+bool projectPoint(PinholeCamera camera, float3 p, float2* pixel);
+bool sameSurface(const PixelGeom* a, const PixelGeom* b, float depth);
+bool cacheTarget(Info info, PinholeCamera camera, const PixelCache* c, uint* target, float* depth);
+int pixelRate(Info info, global const uchar* rates, uint2 pixel);
+bool continuePath(Info info, Sampler* sampler, Ray* ray, int* budget);
+uint2 rateAnchor(uint2 pixel, int rate);
 
 float4 barycentricFinder(const float4* v0, const float4* v1, const float4* v2, const float2* uv)
 {
@@ -54,12 +192,86 @@ float4 barycentricFinder(const float4* v0, const float4* v1, const float4* v2, c
 }
 
 
+KDNode loadNode(NODE_BUF kdnodes, int id)
+{
+#ifdef FETCH_IMAGE
+	//texels: stat, axis, split, start | end, child ids, block
+	int4 a = read_imagei(kdnodes, 2 * id);
+	int4 b = read_imagei(kdnodes, 2 * id + 1);
+	KDNode node;
+	node.stat = (NodeStat)a.x;
+	node.axis = (Axis)a.y;
+	node.split = as_float(a.z);
+	node.start = a.w;
+	node.end = b.x;
+	node.child_id = (int2)(b.y, b.z);
+	node.block = b.w;
+	return node;
+#else
+	return kdnodes[id];
+#endif
+}
+
+TriBlock loadBlock(BLOCK_BUF blocks, int id)
+{
+#ifdef FETCH_IMAGE
+	//10 texels: v0, e1, e2 by axis, then the ids
+	int base = id * (int)(sizeof(TriBlock) / 16);
+	TriBlock b;
+	b.v0x = as_float4(read_imagei(blocks, base));
+	b.v0y = as_float4(read_imagei(blocks, base + 1));
+	b.v0z = as_float4(read_imagei(blocks, base + 2));
+	b.e1x = as_float4(read_imagei(blocks, base + 3));
+	b.e1y = as_float4(read_imagei(blocks, base + 4));
+	b.e1z = as_float4(read_imagei(blocks, base + 5));
+	b.e2x = as_float4(read_imagei(blocks, base + 6));
+	b.e2y = as_float4(read_imagei(blocks, base + 7));
+	b.e2z = as_float4(read_imagei(blocks, base + 8));
+	b.ids = read_imagei(blocks, base + 9);
+	return b;
+#else
+	return blocks[id];
+#endif
+}
+
+Triangle loadTriangle(TRI_BUF triangles, int id)
+{
+#ifdef FETCH_IMAGE
+	//13 texels: brdf, v0 v1 v2, n0 n1 n2, then color and index of m0 m1 m2
+	int base = id * (int)(sizeof(Triangle) / 16);
+	Triangle tri;
+	tri.brdf_type = (BRDFType)read_imagei(triangles, base).x;
+	tri.v0 = as_float4(read_imagei(triangles, base + 1));
+	tri.v1 = as_float4(read_imagei(triangles, base + 2));
+	tri.v2 = as_float4(read_imagei(triangles, base + 3));
+	tri.n0 = as_float4(read_imagei(triangles, base + 4));
+	tri.n1 = as_float4(read_imagei(triangles, base + 5));
+	tri.n2 = as_float4(read_imagei(triangles, base + 6));
+	tri.m0.color = as_float4(read_imagei(triangles, base + 7));
+	tri.m0.rIndex = as_float(read_imagei(triangles, base + 8).x);
+	tri.m1.color = as_float4(read_imagei(triangles, base + 9));
+	tri.m1.rIndex = as_float(read_imagei(triangles, base + 10).x);
+	tri.m2.color = as_float4(read_imagei(triangles, base + 11));
+	tri.m2.rIndex = as_float(read_imagei(triangles, base + 12).x);
+	return tri;
+#else
+	return triangles[id];
+#endif
+}
+
+//the top levels come from the work-group's copy in local memory
+KDNode fetchNode(NODE_BUF kdnodes, local KDNode* nodeCache, int cachedNodes, int id)
+{
+	return (id < cachedNodes) ? nodeCache[id] : loadNode(kdnodes, id);
+}
+
 struct kdToDo
 { 
-	int nodeid, tMin, tMax;
+	int nodeid;
+	float tMin, tMax;
 };
 
-void stackKDtreeTraversal(float8* kdbound, global KDNode* kdnodes, global Triangle* triangles, global int* tri_list, Record* rec, const Ray* ray)
+void stackKDtreeTraversal(float8* kdbound, NODE_BUF kdnodes, local KDNode* nodeCache, int cachedNodes, BLOCK_BUF blocks, Record* rec, const Ray* ray)
 {
 	//test intersection
 	float2 t_entry_exit;
@@ -67,7 +279,7 @@ void stackKDtreeTraversal(float8* kdbound, global KDNode* kdnodes, global Triang
 	//current box intersection record
 	KDNode node;
 	int nodeID = 0;
-	node = kdnodes[nodeID];
+	node = fetchNode(kdnodes, nodeCache, cachedNodes, nodeID);
 	float tPlane;
 
 	bool hit = AABBINTXN(&t_entry_exit, ray, &node, kdbound);
@@ -85,7 +297,7 @@ void stackKDtreeTraversal(float8* kdbound, global KDNode* kdnodes, global Triang
 
 		if(rec->t < t_entry_exit.s0) break;
 
-		node = kdnodes[nodeID];
+		node = fetchNode(kdnodes, nodeCache, cachedNodes, nodeID);
 
 		//hit & is node, continue track child
 		if(node.stat == isNode)
@@ -131,18 +343,17 @@ void stackKDtreeTraversal(float8* kdbound, global KDNode* kdnodes, global Triang
 				t_entry_exit.s1 = tPlane;
 			}
 		}
-		else  //isleaf, intersect triangles in the node
+		else  //isleaf, intersect triangles in the node, four at a time
 		{
-			Triangle tri;
-			int tid;
+			TriBlock block;
+			int count = node.end - node.start;
 			hit = false;
-			for(int i = node.start;i < node.end;++i)
+			for(int i = 0;i < count;i += 4)
 			{
-				tid = tri_list[i];
-				tri = triangles[tid];
-				hit |= TriINTXN(rec, ray, &tri, tid);
-				rec->INTXN.s0 += 1;
+				block = loadBlock(blocks, node.block + i / 4);
+				hit |= TriBlockINTXN(rec, ray, &block);
 			}
+			rec->INTXN.s0 += count;
 
 			if(todoPos > 0)
 			{
@@ -162,6 +373,126 @@ void stacklessRopesKDtreeTraversal(global KDNode* kdnodes, global Triangle* tria
 	return;
 }
 
+//primary rays of a work-group walk the tree together. they all start at the
+//camera, so the near child is the same for the group. a node is fetched once
+//for the group and visited if any ray needs it, the stack of node ids and
+//boxes is shared, a ray only keeps its [tmin, tmax] and recomputes it from
+//the box after a pop. every work-item of the group must call it
+void packetKDtreeTraversal(float8* kdbound, NODE_BUF kdnodes, local KDNode* nodeCache, int cachedNodes, BLOCK_BUF blocks, Record* rec, const Ray* ray, bool active, local PacketStack* ps)
+{
+	bool leader = (get_local_id(0) == 0 && get_local_id(1) == 0);
+	if (leader)
+	{
+		ps->node = fetchNode(kdnodes, nodeCache, cachedNodes, 0);
+		ps->box = *kdbound;
+		ps->nodeID = 0;
+		ps->top = 0;
+		ps->vote[0] = ps->vote[1] = 0;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	float2 t_entry_exit = (float2)(0, 0);
+	bool in = false;
+	bool popped = true;
+
+	while (ps->nodeID != -1)
+	{
+		KDNode node = ps->node;
+		float8 box = ps->box;
+		if (popped) in = active && AABBINTXN(&t_entry_exit, ray, &node, &box) && t_entry_exit.s1 > 0;
+		in = in && rec->t >= t_entry_exit.s0;
+
+		//group decision, the same in every work-item
+		int next = -1;
+		float8 nextBox = box;
+		bool wantNear = false, wantFar = false;
+
+		if (node.stat == isNode)
+		{
+			float oriv = VEC4(ray->ori, node.axis);
+			float dir = VEC4(ray->dir, node.axis);
+			float revd = VEC4(ray->revdir, node.axis);
+			float tPlane = (node.split - oriv) * revd;
+
+			//children this ray needs, as in stackKDtreeTraversal
+			int belowfirst = (oriv < node.split) || (oriv == node.split && dir <= 0);
+			bool needFirst = true, needSecond = false;
+			float2 firstT = t_entry_exit, secondT = t_entry_exit;
+			if (tPlane > t_entry_exit.s1 || tPlane <= 0) {}
+			else if (tPlane < t_entry_exit.s0)
+			{
+				needFirst = false;
+				needSecond = true;
+			}
+			else
+			{
+				needSecond = true;
+				firstT.s1 = tPlane;
+				secondT.s0 = tPlane;
+			}
+			bool needBelow = belowfirst ? needFirst : needSecond;
+			bool needAbove = belowfirst ? needSecond : needFirst;
+			if (in && needBelow) atomic_or(&ps->vote[0], 1);
+			if (in && needAbove) atomic_or(&ps->vote[1], 1);
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			//shared origin picks the near child
+			bool nearBelow = oriv <= node.split;
+			wantNear = ps->vote[nearBelow ? 0 : 1] != 0;
+			wantFar = ps->vote[nearBelow ? 1 : 0] != 0;
+
+			float8 belowBox = box, aboveBox = box;
+			if (node.axis == Xaxis) { belowBox.s4 = node.split; aboveBox.s0 = node.split; }
+			else if (node.axis == Yaxis) { belowBox.s5 = node.split; aboveBox.s1 = node.split; }
+			else { belowBox.s6 = node.split; aboveBox.s2 = node.split; }
+
+			bool toBelow = wantNear ? nearBelow : !nearBelow;
+			if (wantNear || wantFar)
+			{
+				next = toBelow ? node.child_id.s0 : node.child_id.s1;
+				nextBox = toBelow ? belowBox : aboveBox;
+				in = in && (toBelow ? needBelow : needAbove);
+				t_entry_exit = (toBelow == (bool)belowfirst) ? firstT : secondT;
+			}
+			//far child waits on the shared stack
+			if (leader && wantNear && wantFar)
+			{
+				ps->stackNode[ps->top] = nearBelow ? node.child_id.s1 : node.child_id.s0;
+				ps->stackBox[ps->top] = nearBelow ? aboveBox : belowBox;
+				ps->top++;
+			}
+		}
+		else if (in)  //isleaf, intersect triangles in the node
+		{
+			int count = node.end - node.start;
+			for (int i = 0; i < count; i += 4)
+			{
+				TriBlock block = loadBlock(blocks, node.block + i / 4);
+				TriBlockINTXN(rec, ray, &block);
+			}
+			rec->INTXN.s0 += count;
+		}
+
+		//everyone has read node, box and votes
+		barrier(CLK_LOCAL_MEM_FENCE);
+		popped = (next == -1);
+		if (leader)
+		{
+			ps->vote[0] = ps->vote[1] = 0;
+			if (popped && ps->top > 0)
+			{
+				--ps->top;
+				next = ps->stackNode[ps->top];
+				nextBox = ps->stackBox[ps->top];
+			}
+			if (next != -1) ps->node = fetchNode(kdnodes, nodeCache, cachedNodes, next);
+			ps->box = nextBox;
+			ps->nodeID = next;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+
 bool AABBINTXN(float2* boxt, const Ray* ray, const KDNode* node, float8* bound)
 {
 	float tmin, tmax, t_ori, tentry;
@@ -224,6 +555,44 @@ bool TriINTXN(Record* rec, const Ray* ray, const Triangle* tri, uint ID)
 	return false;
 }
 
+//TriINTXN on the four triangles of a block at once, lanes are triangles.
+//the closest hit wins, the first lane on equal t as in a sequential loop
+bool TriBlockINTXN(Record* rec, const Ray* ray, const TriBlock* b)
+{
+	float4 dx = (float4)(ray->dir.x), dy = (float4)(ray->dir.y), dz = (float4)(ray->dir.z);
+
+	//P = cross(dir, e2)
+	float4 px = dy * b->e2z - dz * b->e2y;
+	float4 py = dz * b->e2x - dx * b->e2z;
+	float4 pz = dx * b->e2y - dy * b->e2x;
+	float4 det = b->e1x * px + b->e1y * py + b->e1z * pz;
+	float4 inv_det = native_recip(det);
+
+	float4 tx = ray->ori.x - b->v0x, ty = ray->ori.y - b->v0y, tz = ray->ori.z - b->v0z;
+	float4 uu = (tx * px + ty * py + tz * pz) * inv_det;
+
+	//Q = cross(T, e1)
+	float4 qx = ty * b->e1z - tz * b->e1y;
+	float4 qy = tz * b->e1x - tx * b->e1z;
+	float4 qz = tx * b->e1y - ty * b->e1x;
+	float4 vv = (dx * qx + dy * qy + dz * qz) * inv_det;
+	float4 tt = (b->e2x * qx + b->e2y * qy + b->e2z * qz) * inv_det;
+
+	int4 hit = (fabs(det) >= EPSILON) & (uu >= 0.0f) & (uu <= 1.0f) & (vv >= 0.0f) & ((uu + vv) <= 1.0f)
+		& (tt > EPSILON) & (tt < rec->t) & (b->ids >= 0) & (b->ids != (int4)((int)rec->primID));
+	if (!any(hit)) return false;
+
+	tt = select((float4)(FLT_MAX), tt, hit);
+	float2 half_t = fmin(tt.s01, tt.s23);
+	float t = fmin(half_t.s0, half_t.s1);
+	int lane = (tt.s0 == t) ? 0 : ((tt.s1 == t) ? 1 : ((tt.s2 == t) ? 2 : 3));
+
+	rec->primID = VEC4(b->ids, lane);
+	rec->prim_type = TRI;
+	rec->t = t;
+	return true;
+}
+
 // Sphere Light Intersection
 bool SphLiINTXN(Record* rec, const Ray* ray, const SphereLight* sph, uint ID)
 {
@@ -255,32 +624,414 @@ bool SphLiINTXN(Record* rec, const Ray* ray, const SphereLight* sph, uint ID)
 	else return false;
 }
 
-kernel void PathTracing_kdtree(
-	Info	info,
-	PinholeCamera	camera,
-	write_only image2d_t frame,
-	float8	nodeBound,
-	global	KDNode*	kdnodes,
-	global  int*  kdtri_list,
-	global	Triangle*	triangles,
-	global	SphereLight*	sphereLights,	
-	global int2* INTXN)
+//closest light sphere along ray, through the light hierarchy
+void LightTreeINTXN(Record* rec, const Ray* ray, global const LightNode* lightNodes, int count, global const SphereLight* sphereLights)
 {
-	//testing light, no support light disable
-	if(info.light_enable == false) return;
-	
-	//---image infomation
-	uint W = get_global_id(0);
-	uint H = get_global_id(1);
-	uint Width = get_global_size(0);
-	uint Height = get_global_size(1);
-	uint offset = W + Width * H;
-	INTXN[offset] = (int2)(0, 0);
+	if (count == 0) return;
+
+	int stack[LIGHT_STACK];
+	int top = 0;
+	int id = 0;
+	while (true)
+	{
+		LightNode node = lightNodes[id];
+		float4 t1 = (node.lo - ray->ori) * ray->revdir;
+		float4 t2 = (node.hi - ray->ori) * ray->revdir;
+		float4 tmin = fmin(t1, t2);
+		float4 tmax = fmax(t1, t2);
+		float enter = fmax(fmax(tmin.x, tmin.y), fmax(tmin.z, 0.0f));
+		float exit = fmin(fmin(tmax.x, tmax.y), fmin(tmax.z, rec->t));
+		if (enter <= exit)
+		{
+			if (node.child < 0)
+			{
+				const SphereLight sphl = sphereLights[node.light];
+				SphLiINTXN(rec, ray, &sphl, node.light);
+				rec->INTXN.s1 += 1;
+			}
+			else if (top < LIGHT_STACK)
+			{
+				stack[top++] = node.child + 1;
+				id = node.child;
+				continue;
+			}
+		}
+		if (top == 0) break;
+		id = stack[--top];
+	}
+}
+
+//some light below node may shade point p of normal n: the box reaches in
+//front of the tangent plane and lies within the range of its lights
+bool LightNodeVisible(const LightNode* node, float4 p, float4 n)
+{
+	float3 c = (node->lo + node->hi).xyz * 0.5f;
+	float3 e = (node->hi - node->lo).xyz * 0.5f;
+	float front = dot(c - p.xyz, n.xyz) + dot(e, fabs(n.xyz));
+	if (front <= 0.0f) return false;
+
+	float3 d = fmax(fmax(node->lo.xyz - p.xyz, p.xyz - node->hi.xyz), 0.0f);
+	return dot(d, d) <= node->range * node->range;
+}
+
+//sampling weight of node at p: its power scaled by the largest cosine
+//toward its bounding sphere. visible nodes keep some weight, so the
+//sampled estimate stays unbiased
+float LightNodeImportance(const LightNode* node, float4 p, float4 n)
+{
+	if (!LightNodeVisible(node, p, n)) return 0.0f;
+
+	float3 toC = (node->lo + node->hi).xyz * 0.5f - p.xyz;
+	float r = length((node->hi - node->lo).xyz) * 0.5f;
+	float d = length(toC);
+	if (d <= r) return node->power;
+
+	//cos of the angle to n less the half angle of the sphere
+	float cosT = dot(toC, n.xyz) / d;
+	float sinB = r / d;
+	float cosB = sqrt(1.0f - sinB * sinB);
+	if (cosT >= cosB) return node->power;
+	float sinT = sqrt(fmax(1.0f - cosT * cosT, 0.0f));
+	return node->power * fmax(cosT * cosB + sinT * sinB, 0.01f);
+}
+
+//light picked from the root in proportion to LightNodeImportance with u in
+//[0, 1), pdf is the chance of the pick. -1 if no light can shade p
+int SampleLight(global const LightNode* lightNodes, int count, float4 p, float4 n, float u, float* pdf)
+{
+	*pdf = 1.0f;
+	if (count == 0) return -1;
+	LightNode node = lightNodes[0];
+	if (LightNodeImportance(&node, p, n) <= 0.0f) return -1;
+
+	u = fmin(u, ONE_BELOW);
+	while (node.child >= 0)
+	{
+		LightNode a = lightNodes[node.child];
+		LightNode b = lightNodes[node.child + 1];
+		float wa = LightNodeImportance(&a, p, n);
+		float wb = LightNodeImportance(&b, p, n);
+		if (wa + wb <= 0.0f) return -1;
+
+		//u is reused below, rescaled to the picked side
+		float pa = wa / (wa + wb);
+		if (u < pa)
+		{
+			u = fmin(u / pa, ONE_BELOW);
+			*pdf *= pa;
+			node = a;
+		}
+		else
+		{
+			u = fmin((u - pa) / (1.0f - pa), ONE_BELOW);
+			*pdf *= 1.0f - pa;
+			node = b;
+		}
+	}
+	return node.light;
+}
+
+//diffuse term of one light at a hit, 0 if the light is behind the hit,
+//out of range or blocked. only lights in front cost a shadow ray
+float ShadeLight(float8* nodeBound, NODE_BUF kdnodes, local KDNode* nodeCache, int cachedNodes, BLOCK_BUF blocks,
+	const SphereLight* sphl, float4 hit_point, float4 normal, uint primID, uint* shadowRays)
+{
+	float4 toLight = (float4)((sphl->ori - hit_point).xyz, 0);
+	float dist = length(toLight);
+	if (dist > sphl->range) return 0.0f;
+
+	Ray shadowRay;
+	shadowRay.dir = toLight / dist;
+	float dot_prod = dot(normal, shadowRay.dir);
+	if (dot_prod <= 0.0f) return 0.0f;
+	shadowRay.ori = hit_point + shadowRay.dir * EPSILON;
+	shadowRay.revdir = native_recip(shadowRay.dir);
+
+	Record* shade_rec = &shadowRay.rec;
+	shade_rec->prim_type = LIGHT;
+	shade_rec->t = distance(shadowRay.ori, sphl->ori);
+	shade_rec->primID = primID;
+	shade_rec->INTXN = (int2)(0, 0);
+	stackKDtreeTraversal(nodeBound, kdnodes, nodeCache, cachedNodes, blocks, shade_rec, &shadowRay);
+	(*shadowRays)++;
+	return shade_rec->prim_type == LIGHT ? dot_prod : 0.0f;
+}
+
+//integer hash, good enough to decorrelate pixels. the sampling below is
+//mirrored in Sampler.cpp for the native tracer
+uint rngHash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+float unitFloat(uint x)
+{
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+uint reverseBits(uint x)
+{
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+	x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+	x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+	x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+	return x;
+}
+
+//owen scrambling of the bits of x, the hash of laine and karras
+uint owenScramble(uint x, uint seed)
+{
+	x = reverseBits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverseBits(x);
+}
+
+//second sobol dimension, the first is reverseBits
+uint sobol1(uint index)
+{
+	uint x = 0;
+	for (uint v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+		if (index & 1) x ^= v;
+	return x;
+}
+
+Sampler makeSampler(int kind, uint2 pixel, uint width, uint index, global const uint* blueNoise)
+{
+	Sampler s;
+	s.kind = kind;
+	s.pixel = pixel;
+	s.index = index;
+	s.dim = 0;
+	s.scramble = rngHash(pixel.x + width * pixel.y);
+	s.blueNoise = blueNoise;
+	return s;
+}
+
+float2 sample2D(Sampler* s)
+{
+	uint dimSeed = rngHash(s->dim++ * GOLDEN + 1);
+	uint seed = rngHash(s->scramble ^ dimSeed);
+	if (s->kind == SAMPLER_STRATIFIED)
+	{
+		//cells of every STRATA samples in bit reversed z-order, quadrants
+		//fill first. a shuffle per run of STRATA keeps them stratified
+		uint shuffle = rngHash(seed ^ (s->index / STRATA));
+		uint cell = (reverseBits(s->index % STRATA) >> 28) ^ (shuffle % STRATA);
+		uint r = rngHash(shuffle ^ rngHash(s->index));
+		return ((float2)((float)compactBits(cell), (float)compactBits(cell >> 1)) + (float2)(unitFloat(r), unitFloat(rngHash(r)))) * 0.25f;
+	}
+	if (s->kind == SAMPLER_SOBOL)
+	{
+		//shuffled and scrambled per pixel and dimension pair
+		uint i = owenScramble(s->index, seed);
+		uint a = rngHash(seed);
+		uint b = rngHash(a);
+		return (float2)(unitFloat(owenScramble(reverseBits(i), a)), unitFloat(owenScramble(sobol1(i), b)));
+	}
+	if (s->kind == SAMPLER_R2)
+	{
+		uint r = rngHash(seed);
+		return (float2)(unitFloat(seed + s->index * R2_X), unitFloat(r + s->index * R2_Y));
+	}
+	if (s->kind == SAMPLER_BLUE_NOISE)
+	{
+		//the mask shifted per dimension pair, stepped by r2 per sample
+		uint other = rngHash(dimSeed);
+		uint u = s->blueNoise[((s->pixel.y + (dimSeed >> 8)) % BLUE_NOISE_SIZE) * BLUE_NOISE_SIZE + (s->pixel.x + dimSeed) % BLUE_NOISE_SIZE];
+		uint v = s->blueNoise[((s->pixel.y + (other >> 8)) % BLUE_NOISE_SIZE) * BLUE_NOISE_SIZE + (s->pixel.x + other) % BLUE_NOISE_SIZE];
+		return (float2)(unitFloat(u * BLUE_NOISE_STEP + s->index * R2_X), unitFloat(v * BLUE_NOISE_STEP + s->index * R2_Y));
+	}
+	uint r = rngHash(seed ^ rngHash(s->index));
+	return (float2)(unitFloat(r), unitFloat(rngHash(r)));
+}
+
+//first of the next pair
+float sample1D(Sampler* s)
+{
+	return sample2D(s).x;
+}
+
+//every other bit of v, from bit 0
+uint compactBits(uint v)
+{
+	v &= 0x55555555;
+	v = (v | (v >> 1)) & 0x33333333;
+	v = (v | (v >> 2)) & 0x0f0f0f0f;
+	v = (v | (v >> 4)) & 0x00ff00ff;
+	v = (v | (v >> 8)) & 0x0000ffff;
+	return v;
+}
+
+//pixel of this work-item inside its work-group. tile dispatch launches
+//2d work-groups, so a wavefront covers a block of rows. morton dispatch
+//also walks the work-group in z-order, any power of two simd width gets a
+//near square block. power of two rectangles are walked as a row or column
+//of z-ordered squares
+uint2 localPixel(int dispatch)
+{
+	uint2 lid = (uint2)(get_local_id(0), get_local_id(1));
+	if (dispatch != DISPATCH_MORTON) return lid;
+
+	uint2 size = (uint2)(get_local_size(0), get_local_size(1));
+	uint side = min(size.x, size.y);
+	uint id = lid.x + lid.y * size.x;
+	uint square = id / (side * side);
+	id %= side * side;
+	uint2 pixel = (uint2)(compactBits(id), compactBits(id >> 1));
+	return pixel + (size.x >= size.y ? (uint2)(square * side, 0) : (uint2)(0, square * side));
+}
+
+//pixel of this work-item in an ndrange launch
+uint2 dispatchPixel(int dispatch)
+{
+	uint2 origin = (uint2)(get_global_id(0), get_global_id(1)) - (uint2)(get_local_id(0), get_local_id(1));
+	return origin + localPixel(dispatch);
+}
+
+//appends offset to the work list if add, every work-item of the group
+//calls it. one atomic per group keeps the group's pixels together
+void appendWork(bool add, uint offset, local uint* groupCount, local uint* groupBase, global uint* workList, global uint* workCount)
+{
+	bool leader = (get_local_id(0) == 0 && get_local_id(1) == 0);
+	if (leader) *groupCount = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	uint slot = 0;
+	if (add) slot = atomic_inc(groupCount);
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if (leader) *groupBase = atomic_add(workCount, *groupCount);
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if (add) workList[*groupBase + slot] = offset;
+}
+
+//first hits a and b of neighbouring pixels are on two sides of an edge
+bool geomEdge(const PixelGeom* a, const PixelGeom* b)
+{
+	if (a->prim != b->prim) return true;
+	if (a->prim < 0) return false;
+	if (dot(a->normal.xyz, b->normal.xyz) < EDGE_NORMAL_COS) return true;
+	return fabs(a->normal.w - b->normal.w) > EDGE_DEPTH * fmin(a->normal.w, b->normal.w);
+}
+
+float luminance(float3 c)
+{
+	return dot(c, (float3)(0.2126f, 0.7152f, 0.0722f));
+}
+
+//first hit of the unjittered ray through pixelID at distance t
+float3 firstHitPoint(PinholeCamera camera, uint2 pixelID, float t)
+{
+	float3 viewPoint = (camera.ulViewPos + camera.dxUnit * pixelID.x - camera.dyUnit * pixelID.y).xyz;
+	return camera.pos.xyz + normalize(viewPoint - camera.pos.xyz) * t;
+}
+
+//pixel coordinates of point p on the view plane of camera, pixel centers
+//are whole. false if p is behind the camera
+bool projectPoint(PinholeCamera camera, float3 p, float2* pixel)
+{
+	float3 o = (camera.ulViewPos - camera.pos).xyz;
+	float3 dx = camera.dxUnit.xyz, dy = camera.dyUnit.xyz;
+	float3 n = cross(dx, dy);
+	float3 d = p - camera.pos.xyz;
+	float h = dot(o, n), dn = dot(d, n);
+	if (h * dn <= 0.0f) return false;
+	float3 q = d * (h / dn) - o;
+	*pixel = (float2)(dot(q, dx) / dot(dx, dx), -dot(q, dy) / dot(dy, dy));
+	return true;
+}
+
+//first hit a is on the surface b saw, depth is the distance of a from
+//b's camera
+bool sameSurface(const PixelGeom* a, const PixelGeom* b, float depth)
+{
+	if (a->prim < 0 || b->prim < 0) return a->prim == b->prim;
+	if (dot(a->normal.xyz, b->normal.xyz) < EDGE_NORMAL_COS) return false;
+	return fabs(b->normal.w - depth) <= EDGE_DEPTH * depth;
+}
 
+//pixel of the band the cached hit c falls on in camera, and its distance
+bool cacheTarget(Info info, PinholeCamera camera, const PixelCache* c, uint* target, float* depth)
+{
+	float2 at;
+	if (c->position.w == 0.0f || !projectPoint(camera, c->position.xyz, &at)) return false;
+	int2 q = convert_int2_sat_rtn(at + 0.5f);
+	if (q.x < 0 || q.x >= info.width || q.y < info.first || q.y >= info.first + info.rows) return false;
+	*target = q.x + info.width * q.y;
+	*depth = distance(c->position.xyz, camera.pos.xyz);
+	return true;
+}
+
+//rate of the tile of pixel, 0 without a rate map
+int pixelRate(Info info, global const uchar* rates, uint2 pixel)
+{
+	if (info.variableRate == 0) return 0;
+	uint tilesX = (info.width + RATE_TILE - 1) / RATE_TILE;
+	return min((int)rates[pixel.x / RATE_TILE + tilesX * (pixel.y / RATE_TILE)], RATE_MAX);
+}
+
+//traced pixel of the block of pixel, its top left corner
+uint2 rateAnchor(uint2 pixel, int rate)
+{
+	return pixel & ~((1u << rate) - 1);
+}
+
+//next tile of a persistent work-group, the leader takes it for the group
+uint nextGroupTile(global uint* tileCounter, local uint* groupTile)
+{
+	if (get_local_id(0) == 0 && get_local_id(1) == 0) *groupTile = atomic_inc(tileCounter);
+	barrier(CLK_LOCAL_MEM_FENCE);
+	uint tile = *groupTile;
+	//all have read it before the next atomic
+	barrier(CLK_LOCAL_MEM_FENCE);
+	return tile;
+}
+
+//a new reflection or refraction ray is traced while the pixel has budget
+//left (-1 is no limit) and its weight is at least info.cutoff. below it,
+//progressive frames keep the ray at odds weight / cutoff and scale it up
+//by as much, so their mean stays the same
+bool continuePath(Info info, Sampler* sampler, Ray* ray, int* budget)
+{
+	if (*budget == 0) return false;
+	float4 w = ray->weight * ray->transparency;
+	float weight = fmax(w.x, fmax(w.y, w.z));
+	if (weight < info.cutoff)
+	{
+		if (info.adaptive == ADAPTIVE_OFF) return false;
+		float q = weight / info.cutoff;
+		if (sample1D(sampler) >= q) return false;
+		ray->weight /= q;
+	}
+	if (*budget > 0) --*budget;
+	return true;
+}
+
+//color of one ray through pixelID offset by jitter within the pixel.
+//inactive items trace nothing, but join the packet traversal
+float4 traceSample(uint2 pixelID, float2 jitter, bool active, Sampler* sampler, Info info, PinholeCamera camera,
+	float8 nodeBound, NODE_BUF kdnodes, BLOCK_BUF triBlocks, TRI_BUF triangles,
+	global SphereLight* sphereLights, global LightNode* lightNodes, global int2* INTXN, local KDNode* nodeCache,
+	local PacketStack* packet, PixelGeom* geom, int* budget, uint4* traced)
+{
 	//---view point calculation
-	float4 viewPoint = camera.ulViewPos + camera.dxUnit *  W - camera.dyUnit *  H;
+	uint W = pixelID.x;
+	uint H = pixelID.y;
+	uint offset = W + info.width * H;
+	float4 viewPoint = camera.ulViewPos + camera.dxUnit * (W + jitter.x) - camera.dyUnit * (H + jitter.y);
 	//---carry intensity
 	float4 pixel = (float4)(0, 0, 0, 0);
+	geom->prim = -1;
+	geom->normal = (float4)(0, 0, 0, FLT_MAX);
+	geom->albedo = (float4)(1, 1, 1, 0);
 	
 	//---generate current ray
 	Ray primary_ray;
@@ -299,79 +1050,110 @@ kernel void PathTracing_kdtree(
 	new_rec->isInPrim = false;
 	new_rec->depth = 0;
 	new_rec->t = FLT_MAX;
+	new_rec->INTXN = (int2)(0, 0);
+
+	//---primary rays of the work-group traverse as one packet,
+	//padding items join it without a ray
+	bool packetPrimary = (info.traversal == TRAVERSAL_PACKET);
+	if (packetPrimary)
+		packetKDtreeTraversal(&nodeBound, kdnodes, nodeCache, info.cachedNodes, triBlocks, new_rec, &primary_ray, active, packet);
 	
 	//-------recursive ray tracing(for loop version)
 	int ray_count = 0;
 	Ray ray_queue[16];
 	
-	PUSH_RAY(ray_queue, primary_ray, ray_count);
+	//padding items only join the counter barriers
+	if (active) PUSH_RAY(ray_queue, primary_ray, ray_count);
 	
 	Ray current_ray;
 	Record* current_rec;
-	Ray shadowRay;
-	Record* shade_rec = &shadowRay.rec;
+	uint shadowRays = 0;
 
 	while(ray_count > 0)
 	{
 		POP_RAY(ray_queue, current_ray, ray_count);
 		current_rec = &current_ray.rec;
+		if (current_ray.ray_type == Origin) traced->s0++;
+		else if (current_ray.ray_type == Reflec) traced->s1++;
+		else traced->s2++;
 		
-		//find all triangles intersection
-		stackKDtreeTraversal(&nodeBound, kdnodes, triangles, kdtri_list, &current_ray.rec, &current_ray);
-		//find all light intersection
-		for (int i = 0; i < info.pl_SIZE; ++i)
+		//find all triangles intersection, secondary rays alone
+		if (!(packetPrimary && current_ray.ray_type == Origin))
+			stackKDtreeTraversal(&nodeBound, kdnodes, nodeCache, info.cachedNodes, triBlocks, &current_ray.rec, &current_ray);
+		//find the closest light
+		LightTreeINTXN(current_rec, &current_ray, lightNodes, info.lightNodes, sphereLights);
+		//first hit of the sample, edges are found between these
+		if (current_ray.ray_type == Origin)
 		{
-			const SphereLight sphl = sphereLights[i];
-			if (true == sphl.enable){
-				SphLiINTXN(&current_ray.rec, &current_ray, &sphl, i);
-				current_rec->INTXN.s1 += 1;
-			}
+			geom->prim = current_rec->prim_type == TRI ? (int)current_rec->primID
+				: (current_rec->prim_type == LIGHT ? -2 - (int)current_rec->primID : -1);
+			geom->normal = (float4)(0, 0, 0, current_rec->t);
 		}
 		
 		//check hit primitive
 		if (current_rec->prim_type == TRI)
 		{
-			Triangle tri = triangles[current_rec->primID];
+			Triangle tri = loadTriangle(triangles, current_rec->primID);
 			
 			//get triangle normal, barycentric 
 			//float4 normal = normalize(barycentricFinder(&tri.n0, &tri.n1, &tri.n2, &rec.uv));
 			float4 normal = (float4)(normalize(tri.n0.xyz), 0);
+			if (current_ray.ray_type == Origin)
+			{
+				geom->normal.xyz = normal.xyz;
+				geom->albedo = tri.m0.color;
+			}
 
 			//get triangle color, barycentric 
 			//float4 color = barycentricFinder(&tri.m0.color, &tri.m1.color, &tri.m2.color, &rec.uv);
 			float4 color = tri.m0.color;	
 			current_ray.last_prim_color = tri.m0.color;
 			
-			//test shadow
-			bool is_in_shade = false;
+			//test shadow, every light is shaded on its own
 			float4 acc = (float4)(0, 0, 0, 0);
 			float4 hit_point = current_ray.ori + current_ray.dir * current_rec->t;
 			
-			//shadow, compute every light source
-			for (int i = 0; i < info.pl_SIZE; ++i)
+			if (info.lightSampling == LIGHTS_SAMPLED)
+			{
+				//a few lights picked by what they can add, weighted by the odds
+				for (int s = 0; s < info.shadowRays; ++s)
+				{
+					float pdf;
+					int id = SampleLight(lightNodes, info.lightNodes, hit_point, normal, sample1D(sampler), &pdf);
+					if (id < 0) break;
+					const SphereLight sphl = sphereLights[id];
+					float shade = ShadeLight(&nodeBound, kdnodes, nodeCache, info.cachedNodes, triBlocks,
+						&sphl, hit_point, normal, current_rec->primID, &shadowRays);
+					acc += shade / (pdf * info.shadowRays) * color;
+				}
+			}
+			else if (info.lightNodes > 0)
 			{
-				const SphereLight sphl = sphereLights[i];
-				if (!sphl.enable) continue;
-				
-				shadowRay.dir = (float4)(normalize((sphl.ori - hit_point).xyz), 0);
-				shadowRay.ori = hit_point + shadowRay.dir * EPSILON;
-				shadowRay.revdir = native_recip(shadowRay.dir);
-				
-				shade_rec->prim_type = LIGHT;
-				shade_rec->t = distance(shadowRay.ori, sphl.ori);
-				shade_rec->primID = current_rec->primID;
-				
-
-				stackKDtreeTraversal(&nodeBound, kdnodes, triangles, kdtri_list, shade_rec, &shadowRay);
-				if (shade_rec->prim_type != LIGHT) is_in_shade = true;
-
-				// Calculate diffuse shading
-				float dot_prod = dot(normal, shadowRay.dir);
-
-				if(dot_prod > 0 && !is_in_shade)
+				//every light of the hierarchy not culled for this hit
+				int stack[LIGHT_STACK];
+				int top = 0;
+				int id = 0;
+				while (true)
 				{
-					acc += dot_prod * color;
-				}	
+					LightNode node = lightNodes[id];
+					if (LightNodeVisible(&node, hit_point, normal))
+					{
+						if (node.child < 0)
+						{
+							const SphereLight sphl = sphereLights[node.light];
+							acc += ShadeLight(&nodeBound, kdnodes, nodeCache, info.cachedNodes, triBlocks,
+								&sphl, hit_point, normal, current_rec->primID, &shadowRays) * color;
+						}
+						else if (top < LIGHT_STACK)
+						{
+							stack[top++] = node.child + 1;
+							id = node.child;
+							continue;
+						}
+					}
+					if (top == 0) break;
+					id = stack[--top];
+				}
 			}
 			
 			switch(current_ray.ray_type)
@@ -427,7 +1209,7 @@ kernel void PathTracing_kdtree(
 						new_rec->isInPrim = !current_rec->isInPrim;
 						new_rec->depth = current_rec->depth + 1;
 						new_rec->t = FLT_MAX;
-						PUSH_RAY(ray_queue, new_ray, ray_count);						
+						if (continuePath(info, sampler, &new_ray, budget)) PUSH_RAY(ray_queue, new_ray, ray_count);						
 					}
 				}
 				if(tri.brdf_type == MIRR)  //reflection
@@ -448,7 +1230,7 @@ kernel void PathTracing_kdtree(
 					new_rec->isInPrim = false;
 					new_rec->depth = current_rec->depth + 1;
 					new_rec->t = FLT_MAX;
-					PUSH_RAY(ray_queue, new_ray, ray_count);
+					if (continuePath(info, sampler, &new_ray, budget)) PUSH_RAY(ray_queue, new_ray, ray_count);
 				}
 			}
 		}
@@ -464,7 +1246,555 @@ kernel void PathTracing_kdtree(
 		INTXN[offset] += current_rec->INTXN;
 	}
 	//-------recursive ray tracing(for loop version)
+	traced->s3 += shadowRays;
+	return pixel;
+}
+
+//one pixel of the band, every work-item of the group calls it together
+//for the packet traversal. traced counts primary, reflect, refract, shadow
+void tracePixel(uint2 pixelID, Info info, PinholeCamera camera, write_only image2d_t frame,
+	float8 nodeBound, NODE_BUF kdnodes, BLOCK_BUF triBlocks, TRI_BUF triangles,
+	global SphereLight* sphereLights, global LightNode* lightNodes, global int2* INTXN, local KDNode* nodeCache,
+	local PacketStack* packet, global PixelStat* pixelStats, global PixelGeom* pixelGeoms, global const uint* blueNoise,
+	global float4* radiance, global PixelCache* cache, global const uchar* rates, uint4* traced)
+{
+	//---image infomation, launches are padded past the band
+	uint W = pixelID.x;
+	uint H = pixelID.y;
+	bool active = (W < info.width && H >= info.first && H < info.first + info.rows);
+	uint offset = W + info.width * H;
+	if (active) INTXN[offset] = (int2)(0, 0);
+	//coarse blocks bounce less, each rate halves the depth
+	if (active) info.maxdepth >>= pixelRate(info, rates, pixelID);
+	//jitter and shadow ray picks of this pixel, adaptive sequences run over
+	//the samples the pixel has since the view stopped
+	uint index = info.adaptive != ADAPTIVE_OFF ? (uint)info.pass : (uint)info.samples;
+	PixelGeom geom;
+	float4 pixel;
+	//shared by the samples of an edge pixel
+	int budget = info.rayBudget > 0 ? info.rayBudget : -1;
+
+	if (info.antialias == AA_LIST)
+	{
+		//---edge pixel, jittered rays on consecutive samples of the sequence
+		pixel = (float4)(0, 0, 0, 0);
+		for (int s = 0; s < info.aaSamples; ++s)
+		{
+			Sampler sampler = makeSampler(info.sampler, pixelID, info.width, index * info.aaSamples + s, blueNoise);
+			float2 jitter = sample2D(&sampler);
+			pixel += traceSample(pixelID, jitter, active, &sampler, info, camera, nodeBound, kdnodes, triBlocks,
+				triangles, sphereLights, lightNodes, INTXN, nodeCache, packet, &geom, &budget, traced);
+		}
+		pixel /= info.aaSamples;
+	}
+	else
+	{
+		//adaptive samples spread over the pixel
+		Sampler sampler = makeSampler(info.sampler, pixelID, info.width, index, blueNoise);
+		float2 jitter = (float2)(0.0f, 0.0f);
+		if (info.adaptive != ADAPTIVE_OFF) jitter = sample2D(&sampler);
+		pixel = traceSample(pixelID, jitter, active, &sampler, info, camera, nodeBound, kdnodes, triBlocks,
+			triangles, sphereLights, lightNodes, INTXN, nodeCache, packet, &geom, &budget, traced);
+		if (active && (info.antialias == AA_GBUFFER || info.denoise > 0)) pixelGeoms[offset] = geom;
+	}
+
+	//---adaptive, the frame shows the mean of the pixel's samples
+	if (active && info.adaptive != ADAPTIVE_OFF)
+	{
+		PixelStat stat = pixelStats[offset];
+		if (info.pass == 0)
+		{
+			stat.sum = (float4)(0, 0, 0, 0);
+			stat.lum = (float4)(0, 0, 0, 0);
+		}
+		float lum = luminance(pixel.xyz);
+		stat.sum += (float4)(pixel.xyz, 1.0f);
+		stat.lum += (float4)(lum, lum * lum, 0, 0);
+		pixelStats[offset] = stat;
+		pixel = (float4)(stat.sum.xyz / stat.sum.w, 1.0f);
+	}
 
 	int2 coord = (int2)(W, H);
-	write_imagef(frame, coord, pixel);
+	if (active) write_imagef(frame, coord, pixel);
+	//the denoiser and the rate fill read the frame back, the image may be
+	//write only
+	if (active && (info.denoise > 0 || info.variableRate)) radiance[offset] = pixel;
+	//the unjittered ray into the cache, anti-aliased edges are traced again
+	if (active && info.reproject != REPROJECT_OFF && info.antialias != AA_LIST)
+	{
+		PixelCache c;
+		c.color = (float4)(pixel.xyz, 0.0f);
+		c.position = (float4)(firstHitPoint(camera, pixelID, geom.normal.w), geom.prim != -1 ? 1.0f : 0.0f);
+		c.geom = geom;
+		cache[offset] = c;
+	}
+}
+
+kernel void PathTracing_kdtree(
+	Info	info,
+	PinholeCamera	camera,
+	write_only image2d_t frame,
+	float8	nodeBound,
+	NODE_BUF	kdnodes,
+	BLOCK_BUF	triBlocks,
+	TRI_BUF	triangles,
+	global	SphereLight*	sphereLights,	
+	global int2* INTXN,
+	global uint* rayCount,   //primary, reflect, refract, shadow
+	local KDNode* nodeCache, //info.cachedNodes top nodes
+	global uint* tileCounter, //next tile of a persistent launch, 0 at launch
+	global LightNode* lightNodes, //hierarchy of the enabled sphereLights
+	global PixelStat* pixelStats, //per pixel of the frame, adaptive only
+	global uint* workList,   //pixel offsets of a work list launch
+	global uint* workCount,  //entries of workList
+	global PixelGeom* pixelGeoms, //first hits of an AA_GBUFFER launch
+	global const uint* blueNoise, //BLUE_NOISE_SIZE squared mask ranks
+	global float4* radiance, //frame for the denoiser and the rate fill
+	global PixelCache* cache, //traced pixels of a reprojecting launch
+	global const uchar* rates) //rate map of a variableRate launch
+{
+	//testing light, no support light disable
+	if(info.light_enable == false) return;
+
+	//---top of the kd-tree into local memory, every work-item copies a share
+	uint groupSize = get_local_size(0) * get_local_size(1);
+	uint localID = get_local_id(0) + get_local_id(1) * get_local_size(0);
+	for (uint i = localID; i < info.cachedNodes; i += groupSize) nodeCache[i] = loadNode(kdnodes, i);
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	local PacketStack packet;
+	uint4 traced = (uint4)(0, 0, 0, 0);
+
+	local uint groupTile;
+	if (info.adaptive == ADAPTIVE_LIST || info.antialias == AA_LIST || info.reproject == REPROJECT_LIST || info.variableRate)
+	{
+		//---persistent work-groups take group sized runs of the listed pixels,
+		//items past the end idle as padding
+		uint count = *workCount;
+		uint tiles = (count + groupSize - 1) / groupSize;
+		while (true)
+		{
+			uint tile = nextGroupTile(tileCounter, &groupTile);
+			if (tile >= tiles) break;
+
+			uint entry = tile * groupSize + localID;
+			uint2 pixelID = (uint2)(info.width, 0);
+			if (entry < count)
+			{
+				uint offset = workList[entry];
+				pixelID = (uint2)(offset % info.width, offset / info.width);
+			}
+			tracePixel(pixelID, info, camera, frame, nodeBound, kdnodes, triBlocks,
+				triangles, sphereLights, lightNodes, INTXN, nodeCache, &packet, pixelStats, pixelGeoms, blueNoise, radiance, cache, rates, &traced);
+		}
+	}
+	else if (info.schedule == SCHEDULE_PERSISTENT)
+	{
+		//---a launch that just fills the device, work-groups take tiles of
+		//the band until none is left, so no group idles in the tail
+		uint2 size = (uint2)(get_local_size(0), get_local_size(1));
+		uint tilesX = (info.width + size.x - 1) / size.x;
+		uint tiles = tilesX * ((info.rows + size.y - 1) / size.y);
+		while (true)
+		{
+			uint tile = nextGroupTile(tileCounter, &groupTile);
+			if (tile >= tiles) break;
+
+			uint2 origin = (uint2)(tile % tilesX, tile / tilesX) * size + (uint2)(0, (uint)info.first);
+			tracePixel(origin + localPixel(info.dispatch), info, camera, frame, nodeBound, kdnodes, triBlocks,
+				triangles, sphereLights, lightNodes, INTXN, nodeCache, &packet, pixelStats, pixelGeoms, blueNoise, radiance, cache, rates, &traced);
+		}
+	}
+	else
+	{
+		tracePixel(dispatchPixel(info.dispatch), info, camera, frame, nodeBound, kdnodes, triBlocks,
+			triangles, sphereLights, lightNodes, INTXN, nodeCache, &packet, pixelStats, pixelGeoms, blueNoise, radiance, cache, rates, &traced);
+	}
+
+	//---ray counters, summed per work-group before one global atomic each
+	local uint groupTraced[4];
+	bool leader = (get_local_id(0) == 0 && get_local_id(1) == 0);
+	if (leader) groupTraced[0] = groupTraced[1] = groupTraced[2] = groupTraced[3] = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	atomic_add(&groupTraced[0], traced.s0);
+	atomic_add(&groupTraced[1], traced.s1);
+	atomic_add(&groupTraced[2], traced.s2);
+	atomic_add(&groupTraced[3], traced.s3);
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if (leader)
+	{
+		atomic_add(&rayCount[0], groupTraced[0]);
+		atomic_add(&rayCount[1], groupTraced[1]);
+		atomic_add(&rayCount[2], groupTraced[2]);
+		atomic_add(&rayCount[3], groupTraced[3]);
+	}
+
+}
+
+//work list of an ADAPTIVE_LIST launch: one work-item per pixel of the band
+//appends the pixels still noisy, converged ones are written from their
+//running estimate
+kernel void AdaptiveWorkList(
+	Info	info,
+	write_only image2d_t frame,
+	global PixelStat* pixelStats,
+	global uint* workList,
+	global uint* workCount)
+{
+	uint W = get_global_id(0);
+	uint H = get_global_id(1);
+	bool active = (W < info.width && H < info.first + info.rows);
+	uint offset = W + info.width * H;
+
+	//relative standard error of the mean luminance
+	bool noisy = false;
+	PixelStat stat;
+	if (active)
+	{
+		stat = pixelStats[offset];
+		float n = stat.sum.w;
+		float mean = stat.lum.x / n;
+		float var = fmax(stat.lum.y / n - mean * mean, 0.0f) * n / fmax(n - 1.0f, 1.0f);
+		noisy = n < info.maxSamples && sqrt(var / n) > info.threshold * fmax(mean, ADAPTIVE_FLOOR);
+	}
+
+	local uint groupCount, groupBase;
+	appendWork(noisy, offset, &groupCount, &groupBase, workList, workCount);
+	if (active && !noisy) write_imagef(frame, (int2)(W, H), (float4)(stat.sum.xyz / stat.sum.w, 1.0f));
+}
+
+//work list of an AA_LIST launch: pixels of the band whose first hit is on
+//another primitive, or far off in normal or depth, from a neighbour's.
+//neighbours outside the band were traced by another device
+kernel void EdgeWorkList(
+	Info	info,
+	global PixelGeom* pixelGeoms,
+	global uint* workList,
+	global uint* workCount,
+	global const uchar* rates)
+{
+	int W = get_global_id(0);
+	int H = get_global_id(1);
+	bool active = (W < info.width && H < info.first + info.rows);
+	uint offset = W + info.width * H;
+
+	//coarse tiles are not worth the extra rays
+	bool edge = false;
+	if (active && pixelRate(info, rates, (uint2)(W, H)) == 0)
+	{
+		PixelGeom g = pixelGeoms[offset];
+		int2 steps[4] = { (int2)(1, 0), (int2)(-1, 0), (int2)(0, 1), (int2)(0, -1) };
+		for (int k = 0; k < 4 && !edge; ++k)
+		{
+			int x = W + steps[k].x;
+			int y = H + steps[k].y;
+			if (x < 0 || x >= info.width || y < info.first || y >= info.first + info.rows) continue;
+			PixelGeom n = pixelGeoms[x + info.width * y];
+			edge = geomEdge(&g, &n);
+		}
+	}
+
+	local uint groupCount, groupBase;
+	appendWork(edge, offset, &groupCount, &groupBase, workList, workCount);
+}
+
+//---denoiser, the first hits guide it: a temporal pass blends each pixel
+//into the history of its surface, then a-trous passes of growing step
+//filter what noise is left. colors are filtered with the first hit's
+//albedo divided out, so textures stay sharp
+
+//history of the pixels whose first hit was in view the frame before, the
+//filtered color and luminance variance out
+kernel void DenoiseTemporal(
+	Info	info,
+	PinholeCamera	camera,
+	PinholeCamera	prevCamera,
+	global float4* radiance,
+	global PixelGeom* pixelGeoms,
+	global PixelGeom* prevGeoms,        //first hits of the frame before
+	global PixelHistory* history,       //of the frame before
+	global PixelHistory* nextHistory,   //of this frame
+	global float4* filtered)            //xyz color, w luminance variance
+{
+	int W = get_global_id(0);
+	int H = get_global_id(1);
+	if (W >= info.width || H >= info.first + info.rows) return;
+	uint offset = W + info.width * H;
+	PixelGeom g = pixelGeoms[offset];
+	float3 color = radiance[offset].xyz / fmax(g.albedo.xyz, DENOISE_MIN_ALBEDO);
+	float lum = luminance(color);
+
+	//---reproject, the history must have seen the same surface. rows of
+	//the band only, others were on another device
+	PixelHistory h;
+	h.color = (float4)(0, 0, 0, 0);
+	h.moments = (float4)(0, 0, 0, 0);
+	float2 at;
+	float3 p = firstHitPoint(camera, (uint2)(W, H), g.normal.w);
+	if (info.history && g.prim != -1 && projectPoint(prevCamera, p, &at))
+	{
+		int2 q = convert_int2_sat_rtn(at + 0.5f);
+		if (q.x >= 0 && q.x < info.width && q.y >= info.first && q.y < info.first + info.rows)
+		{
+			uint prev = q.x + info.width * q.y;
+			PixelGeom pg = prevGeoms[prev];
+			if (sameSurface(&g, &pg, distance(p, prevCamera.pos.xyz))) h = history[prev];
+		}
+	}
+
+	//---blend, the first frames of a history weigh the same
+	float frames = fmin(h.color.w + 1.0f, 255.0f);
+	float alpha = fmax(DENOISE_ALPHA, 1.0f / frames);
+	PixelHistory next;
+	next.color = (float4)(mix(h.color.xyz, color, alpha), frames);
+	next.moments = (float4)(mix(h.moments.xy, (float2)(lum, lum * lum), alpha), 0, 0);
+	nextHistory[offset] = next;
+
+	//---variance of a short history from the neighbours on its surface,
+	//raised as the history is not to be trusted yet
+	float variance = fmax(next.moments.y - next.moments.x * next.moments.x, 0.0f);
+	if (frames < DENOISE_MIN_HISTORY)
+	{
+		float2 m = (float2)(0, 0);
+		float count = 0.0f;
+		for (int dy = -1; dy <= 1; ++dy)
+		{
+			for (int dx = -1; dx <= 1; ++dx)
+			{
+				int x = W + dx, y = H + dy;
+				if (x < 0 || x >= info.width || y < info.first || y >= info.first + info.rows) continue;
+				PixelGeom ng = pixelGeoms[x + info.width * y];
+				if (!sameSurface(&g, &ng, g.normal.w)) continue;
+				float l = luminance(radiance[x + info.width * y].xyz / fmax(ng.albedo.xyz, DENOISE_MIN_ALBEDO));
+				m += (float2)(l, l * l);
+				count += 1.0f;
+			}
+		}
+		m /= count;
+		variance = fmax(m.y - m.x * m.x, 0.0f) * DENOISE_MIN_HISTORY / frames;
+	}
+	filtered[offset] = (float4)(next.color.xyz, variance);
+}
+
+//a-trous pass with taps step = 2^pass pixels apart, weighted by the b3
+//spline and how alike the taps' first hits and luminance are. the last
+//pass multiplies the albedo back into the frame
+kernel void DenoiseAtrous(
+	Info	info,
+	int		pass,
+	global PixelGeom* pixelGeoms,
+	global float4* input,    //xyz color, w luminance variance
+	global float4* output,
+	write_only image2d_t frame)
+{
+	int W = get_global_id(0);
+	int H = get_global_id(1);
+	if (W >= info.width || H >= info.first + info.rows) return;
+	uint offset = W + info.width * H;
+	PixelGeom g = pixelGeoms[offset];
+	float4 c = input[offset];
+	int step = 1 << pass;
+
+	//luminance stopping scaled by the deviation of the pixel's neighbourhood
+	float variance = 0.0f, vw = 0.0f;
+	for (int dy = -1; dy <= 1; ++dy)
+	{
+		for (int dx = -1; dx <= 1; ++dx)
+		{
+			int x = W + dx, y = H + dy;
+			if (x < 0 || x >= info.width || y < info.first || y >= info.first + info.rows) continue;
+			float k = (dx == 0 ? 0.5f : 0.25f) * (dy == 0 ? 0.5f : 0.25f);
+			variance += k * input[x + info.width * y].w;
+			vw += k;
+		}
+	}
+	float sigmaL = DENOISE_LUM * sqrt(variance / vw) + 1e-4f;
+	float lum = luminance(c.xyz);
+
+	const float b3[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+	float4 sum = (float4)(0, 0, 0, 0);
+	float weights = 0.0f;
+	for (int dy = -2; dy <= 2; ++dy)
+	{
+		for (int dx = -2; dx <= 2; ++dx)
+		{
+			int x = W + dx * step, y = H + dy * step;
+			if (x < 0 || x >= info.width || y < info.first || y >= info.first + info.rows) continue;
+			uint q = x + info.width * y;
+			PixelGeom qg = pixelGeoms[q];
+			float4 qc = input[q];
+
+			float w = b3[abs(dx)] * b3[abs(dy)];
+			if (g.prim < 0 || qg.prim < 0)
+			{
+				if (g.prim != qg.prim) continue;
+			}
+			else
+			{
+				float taps = (float)(step * max(abs(dx), abs(dy)));
+				w *= pow(fmax(dot(g.normal.xyz, qg.normal.xyz), 0.0f), DENOISE_NORMAL);
+				w *= exp(-fabs(g.normal.w - qg.normal.w) / (DENOISE_DEPTH * g.normal.w * taps + 1e-4f));
+			}
+			w *= exp(-fabs(lum - luminance(qc.xyz)) / sigmaL);
+			w *= exp(-DENOISE_ALBEDO * distance(g.albedo.xyz, qg.albedo.xyz));
+			sum += (float4)(w * qc.xyz, w * w * qc.w);
+			weights += w;
+		}
+	}
+	float4 result = (float4)(sum.xyz / weights, sum.w / (weights * weights));
+
+	if (pass + 1 < info.denoise) output[offset] = result;
+	else write_imagef(frame, (int2)(W, H), (float4)(result.xyz * fmax(g.albedo.xyz, DENOISE_MIN_ALBEDO), 1.0f));
+}
+
+//---reprojection cache, the pixels traced the frame before move to the
+//pixels their hits fall on in the new view. the nearest hit of a pixel
+//wins, pixels none falls on are traced again
+
+//nearest distance of the cached hits falling on each pixel of the band,
+//cacheDepth is all ones at launch. clears the cache of this frame
+kernel void CacheDepth(
+	Info	info,
+	PinholeCamera	camera,
+	global PixelCache* prevCache,
+	global uint* cacheDepth,   //float bits, ordered as the floats are
+	global PixelCache* cache)
+{
+	int W = get_global_id(0);
+	int H = get_global_id(1);
+	if (W >= info.width || H >= info.first + info.rows) return;
+	uint offset = W + info.width * H;
+	cache[offset].position.w = 0.0f;
+
+	PixelCache c = prevCache[offset];
+	uint target;
+	float depth;
+	if (cacheTarget(info, camera, &c, &target, &depth)) atomic_min(&cacheDepth[target], as_uint(depth));
+}
+
+//the nearest cached hit of each pixel into the cache of this frame
+kernel void CacheScatter(
+	Info	info,
+	PinholeCamera	camera,
+	global PixelCache* prevCache,
+	global uint* cacheDepth,
+	global PixelCache* cache)
+{
+	int W = get_global_id(0);
+	int H = get_global_id(1);
+	if (W >= info.width || H >= info.first + info.rows) return;
+	uint offset = W + info.width * H;
+
+	PixelCache c = prevCache[offset];
+	uint target;
+	float depth;
+	if (cacheTarget(info, camera, &c, &target, &depth) && as_uint(depth) == cacheDepth[target])
+	{
+		c.color.w += 1.0f;
+		c.geom.normal.w = depth;
+		cache[target] = c;
+	}
+}
+
+//work list of a REPROJECT_LIST launch: pixels without a cached hit, old
+//ones, a random share refreshed every frame and hits seen through a gap
+//of nearer ones. the others are written from the cache. coarse tiles of
+//the rate map trace their blocks' corners, the fill does the rest
+kernel void CacheWorkList(
+	Info	info,
+	write_only image2d_t frame,
+	global PixelCache* cache,
+	global PixelGeom* pixelGeoms,
+	global float4* radiance,
+	global uint* workList,
+	global uint* workCount,
+	global const uchar* rates)
+{
+	int W = get_global_id(0);
+	int H = get_global_id(1);
+	bool active = (W < info.width && H < info.first + info.rows);
+	uint offset = W + info.width * H;
+
+	bool trace = false;
+	int rate = active ? pixelRate(info, rates, (uint2)(W, H)) : 0;
+	if (rate > 0) trace = active && all(rateAnchor((uint2)(W, H), rate) == (uint2)(W, H));
+	else if (active)
+	{
+		PixelCache c = cache[offset];
+		trace = c.position.w == 0.0f || c.color.w >= REPROJECT_MAX_AGE
+			|| unitFloat(rngHash(offset ^ rngHash(info.samples))) < info.refresh;
+		if (!trace)
+		{
+			float depth = 0.0f;
+			int count = 0;
+			for (int dy = -1; dy <= 1; ++dy)
+			{
+				for (int dx = -1; dx <= 1; ++dx)
+				{
+					int x = W + dx, y = H + dy;
+					if ((dx == 0 && dy == 0) || x < 0 || x >= info.width || y < info.first || y >= info.first + info.rows) continue;
+					PixelCache n = cache[x + info.width * y];
+					if (n.position.w == 0.0f) continue;
+					depth += n.geom.normal.w;
+					count++;
+				}
+			}
+			trace = count < REPROJECT_MIN_NEIGHBOURS || c.geom.normal.w > depth / count * (1.0f + REPROJECT_GAP);
+		}
+		if (!trace)
+		{
+			write_imagef(frame, (int2)(W, H), (float4)(c.color.xyz, 1.0f));
+			if (info.antialias == AA_GBUFFER || info.denoise > 0) pixelGeoms[offset] = c.geom;
+			if (info.denoise > 0 || info.variableRate) radiance[offset] = (float4)(c.color.xyz, 1.0f);
+		}
+	}
+
+	local uint groupCount, groupBase;
+	appendWork(trace, offset, &groupCount, &groupBase, workList, workCount);
+}
+
+//---variable-rate tracing, tiles of the rate map trace one pixel of each
+//2x2 or 4x4 block. the others take its color before the frame is shown
+
+//work list of a variableRate launch, the block corners of the band
+kernel void RateWorkList(
+	Info	info,
+	global const uchar* rates,
+	global uint* workList,
+	global uint* workCount)
+{
+	int W = get_global_id(0);
+	int H = get_global_id(1);
+	bool active = (W < info.width && H < info.first + info.rows);
+	uint2 pixel = (uint2)(W, H);
+	bool trace = active && all(rateAnchor(pixel, pixelRate(info, rates, pixel)) == pixel);
+
+	local uint groupCount, groupBase;
+	appendWork(trace, W + info.width * H, &groupCount, &groupBase, workList, workCount);
+}
+
+//pixels of coarse blocks from their corner, with its first hit for the
+//edge pass and the denoiser. a traced frame's stale cache entries go
+kernel void RateFill(
+	Info	info,
+	global const uchar* rates,
+	global float4* radiance,
+	global PixelGeom* pixelGeoms,
+	global PixelCache* cache,
+	write_only image2d_t frame)
+{
+	int W = get_global_id(0);
+	int H = get_global_id(1);
+	if (W >= info.width || H >= info.first + info.rows) return;
+	uint2 pixel = (uint2)(W, H);
+	uint2 anchor = rateAnchor(pixel, pixelRate(info, rates, pixel));
+	if (all(anchor == pixel)) return;
+	uint offset = W + info.width * H;
+	uint from = anchor.x + info.width * anchor.y;
+
+	float4 color = radiance[from];
+	write_imagef(frame, (int2)(W, H), color);
+	if (info.denoise > 0) radiance[offset] = color;
+	if (info.antialias == AA_GBUFFER || info.denoise > 0) pixelGeoms[offset] = pixelGeoms[from];
+	if (info.reproject == REPROJECT_FULL) cache[offset].position.w = 0.0f;
 }
@@ -1,9 +1,15 @@
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 #include <random>
 #include <fstream>
 #include <unordered_map>
 #include <vector>
+#include <deque>
 #include <array>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
 
 #define GLM_SWIZZLE
 #include <glm\gtc\type_ptr.hpp>
@@ -16,25 +22,56 @@
 
 
 #include "Timer.h"
+#include "RTtypes.h"
 #include "RTstruct.h"
 #include "KDstruct.h"
 #include "OCLsetting.h"
+#include "NativeTracer.h"
+#include "FrameStats.h"
+#include "TraceEvent.h"
+#include "Capture.h"
+#include "KDlayout.h"
+#include "LaunchTuner.h"
+#include "LightTree.h"
 #include "pbrt_kdtree\kdtreeaccel.h"
 
-static cl_mem INTXN = NULL;
 static std::vector<int> INTXNDATA(800 * 600 * 2);
 
 #define LIGHT_RADIUS 1.0f
+//pbo count for frame upload without cl gl interop
+#define PBO_RING 3
+//fewest rows a device renders in split frame mode, keeps its timing measurable.
+//bands also start on multiples of it, so dispatch tiles never straddle two devices
+#define MIN_BAND_ROWS 16
+//weight of the newest kernel time in the smoothed device throughput
+#define BAND_SMOOTHING 0.3
 
 //debug tool
 #define DEBUGSTRING 0
 #define DEBUG(x) if (DEBUGSTRING) { std::cerr << x << std::endl; } 
 
-typedef enum { RT_MAT_DIFFUSE, RT_MAT_DIELECTRIC, RT_MAT_MIRROR } RTenum;
+bool rtInit(RTdevice device = RT_DEVICE_GPU, RToutput output = RT_OUTPUT_WINDOW);
 
 static Timer timer;
 static unsigned WIDTH = 800, HEIGHT = 600;
 static bool isInit = false;
+static bool initFailed = false;  //no opencl device came up, frames draw nothing
+static RToutput outputMode = RT_OUTPUT_WINDOW;
+static bool nativeMode = false;   //RT_DEVICE_NATIVE, no opencl at all
+static RTdevice initDevice = RT_DEVICE_GPU;
+static glm::mat4 headlessModelview(1.0f);   //rtModelviewEXT, no gl matrix stack headless
+static bool captureTreePending = false;     //capture began with a built tree
+static RTfetch fetchMode = RT_FETCH_AUTO;
+static std::string tuneCache;   //empty, tuned shapes are not kept across runs
+static bool tuneLaunch = true;  //false, square tiles
+static unsigned adaptivePass = 0;   //samples the pixels have of the still view
+static PinholeCamera denoiseCamera;  //camera of the last denoised frame
+//variable-rate tracing: fovea x, y and radius of the radial rate map, 0
+//radius is off, or the application's map in its place
+static glm::vec3 fovea(0.5f, 0.5f, 0.0f);
+static std::vector<unsigned char> appRates;
+static int appRatesWidth = 0, appRatesHeight = 0;
+static std::vector<cl_uchar> rateMap;   //per RATE_TILE tile of the frame
 
 class RTCamera
 {
@@ -115,11 +152,13 @@ public:
 		{
 			if (binary != NULL)
 			{
-				delete binary;
+				delete[] binary;
 			}
 			binary = new char[size];
 		}
-		memcpy(binary, data, size);
+		this->size = size;
+		if (data != NULL) memcpy(binary, data, size);
+		else memset(binary, 0, size);
 	}
 	//data size
 	unsigned size;
@@ -148,10 +187,14 @@ public:
 	void setVertexData(glm::vec4& vertex, unsigned index);
 	void setNormalData(glm::vec4& normal, unsigned index);
 
+	//light of GL_LIGHT0 + i, NULL past RT_MAX_LIGHTS
+	SphereLight* Light(GLenum light);
+	static SphereLight DefaultLight();
+
 	//enable cap
 	std::unordered_map<GLenum, bool> capability;
-	//gl buffer storage
-	std::vector<RawBuffer> glbuffers;
+	//gl buffer storage, a deque keeps bindVBO valid while buffers are added
+	std::deque<RawBuffer> glbuffers;
 
 	//for now rendering data given to cl kernel
 	Info info;
@@ -159,18 +202,23 @@ public:
 
 	//frame 
 	GLuint frame_texture;
-	cl_mem frame_texture_img;
+	cl_mem frame_texture_img;             // gl texture with interop, otherwise plain cl image
 	std::vector<float> frameData;         // 4 float per pixel 
+	GLuint pbo[PBO_RING];                 // upload ring without interop
+	unsigned pboIndex;
 
 	std::vector<Triangle> triangleData;
-	std::array<SphereLight, 8> pointLight; //light structure fixed number 8
+	std::vector<SphereLight> pointLight;   //GL_LIGHT0 + i, grown on first use
+	std::vector<LightNode> lightNodes;     //hierarchy of the enabled lights
 	bool isTreeBuild;
 
 	//kd-tree
 	std::vector<KDNode> kdnodes;
 	std::vector<int> kdtriangles;
-	cl_mem node_buf;
-	cl_mem trilist_buf;
+	//nodes of the top levels, in front of kdnodes
+	size_t kdTopNodes;
+	//leaf triangles in soa blocks of four, what the kernel tests
+	std::vector<TriBlock> triBlocks;
 
 	//for binding buffer
 	RawBuffer* bindVBO;
@@ -183,7 +231,7 @@ public:
 };
 
 rtCore::rtCore()
-	:rtCam(), isTreeBuild(false)
+	:rtCam(), isTreeBuild(false), kdTopNodes(0), frame_texture(0), frame_texture_img(NULL), pboIndex(0)
 {
 	//frameData.resize(WIDTH * HEIGHT * 4, 0.0f);  // init value 0
 	
@@ -198,32 +246,60 @@ rtCore::rtCore()
 	capability.emplace(GL_NORMAL_ARRAY, false);
 	capability.emplace(GL_COLOR_MATERIAL, false);
 	capability.emplace(GL_LIGHTING, false);         //5
-	capability.emplace(GL_LIGHT0, false);           //6
-	capability.emplace(GL_LIGHT1, false);
-	capability.emplace(GL_LIGHT2, false);
-	capability.emplace(GL_LIGHT3, false);
-	capability.emplace(GL_LIGHT4, false);
-	capability.emplace(GL_LIGHT5, false);
-	capability.emplace(GL_LIGHT6, false);
-	capability.emplace(GL_LIGHT7, false);        
 
 	//info
 	info.samples = 1;
 	info.tri_SIZE = 0;
 	info.pl_SIZE = 8;  
 	info.maxdepth = 8;
+	info.width = WIDTH;
+	info.height = HEIGHT;
+	info.dispatch = RT_DISPATCH_MORTON;
+	info.traversal = RT_TRAVERSAL_PACKET;
+	info.cachedNodes = 0;
+	info.schedule = RT_SCHEDULE_NDRANGE;
+	info.first = 0;
+	info.rows = HEIGHT;
+	info.lightNodes = 0;
+	info.lightSampling = RT_LIGHTS_ALL;
+	info.shadowRays = 1;
+	info.adaptive = ADAPTIVE_OFF;
+	info.pass = 0;
+	info.threshold = 0.0f;
+	info.maxSamples = 64;
+	info.antialias = AA_OFF;
+	info.aaSamples = 0;
+	info.sampler = RT_SAMPLER_SOBOL;
+	info.denoise = 0;
+	info.history = 0;
+	info.reproject = REPROJECT_OFF;
+	info.refresh = 1.0f;
+	info.variableRate = 0;
+	info.cutoff = 0.0f;
+	info.rayBudget = 0;
+
+	//the gl lights, more are added by use
+	pointLight.resize(8, DefaultLight());
+}
 
-	//point light
-	Material m;
-	m.color = glm::vec4(1, 1, 1, 1);
-	m.rIndex = 1;
-	for (int i = 0; i < 8; ++i)
-	{
-		pointLight[i].ori = glm::vec4(0, 0, 0, 0);
-		pointLight[i].radius = LIGHT_RADIUS;
-		pointLight[i].mat = m;
-		pointLight[i].enable = false;
-	}
+SphereLight rtCore::DefaultLight()
+{
+	SphereLight pl;
+	pl.ori = glm::vec4(0, 0, 0, 0);
+	pl.radius = LIGHT_RADIUS;
+	pl.mat.color = glm::vec4(1, 1, 1, 1);
+	pl.mat.rIndex = 1;
+	pl.enable = false;
+	pl.range = FLT_MAX;
+	return pl;
+}
+
+SphereLight* rtCore::Light(GLenum light)
+{
+	if (light < GL_LIGHT0 || light >= GL_LIGHT0 + RT_MAX_LIGHTS) return NULL;
+	unsigned index = light - GL_LIGHT0;
+	if (index >= pointLight.size()) pointLight.resize(index + 1, DefaultLight());
+	return &pointLight[index];
 }
 
 rtCore::~rtCore()
@@ -307,30 +383,525 @@ static OCLsetting Ocl(WIDTH, HEIGHT);
 static rtCore Core;
 //static KDTREE::KDTree kdtree(48, 16); //depth 20 , prim per node 32
 static std::shared_ptr<KdTreeAccel> pbrt_kdtree;
+static std::unique_ptr<NativeTracer> Native;
+static FrameStats Stats;
+
+//------ split frame
+// every opencl device renders a band of rows into its own frame image.
+// with one device the band is the whole frame, with RT_DEVICE_ALL the bands
+// are resized each frame from the measured kernel time of every device.
+struct rtBand
+{
+	OCLsetting* ocl;
+	cl_mem image;
+	unsigned first, rows;
+	double ms;          //kernel time of the last frame
+	double rowsPerMs;   //smoothed throughput, 0 until measured
+	RTfetch fetch;      //fetch path of the device, RT_FETCH_AUTO while timing both
+	double fetchMs[2];  //kernel ms per row summed over timed frames, buffer / image
+	int fetchFrames[2];
+	LaunchTuner tuner;  //work-group shape of the kd-tree kernel
+	LaunchTuner aaTuner;  //work-group shape of its AA_LIST relaunch
+	bool history;       //denoiser history of the band is of the frame before
+	bool cached;        //reprojection cache of the band is of the frame before
+};
+static std::vector<std::unique_ptr<OCLsetting>> Peers;  //devices besides Ocl
+static std::vector<rtBand> Bands;                       //Bands[0] is Ocl
 
-/////////// implement plugining api  ///////////
+//duration of a profiled command in ms, traces and releases the event
+static double eventMs(cl_event e, const char* name, int device)
+{
+	cl_ulong start = 0, end = 0;
+	clWaitForEvents(1, &e);
+	Trace().Device(name, e, device);
+	clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+	clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+	clReleaseEvent(e);
+	return (end - start) * 1e-6;
+}
 
-void rtInit()
+//bytes of every buffer and image held on the devices
+static double deviceBytes()
 {
-	if (isInit == true) return;
-	isInit = true;
+	double bytes = 0.0;
+	for (rtBand& b : Bands)
+	{
+		cl_mem mems[] = { b.image, b.ocl->frameBuf, b.ocl->triBuf, b.ocl->sphlBuf, b.ocl->blockBuf,
+			b.ocl->nodeBuf, b.ocl->intxnBuf, b.ocl->rayCountBuf, b.ocl->lightNodeBuf,
+			b.ocl->pixelStatBuf, b.ocl->pixelGeomBuf, b.ocl->workListBuf, b.ocl->blueNoiseBuf,
+			b.ocl->radianceBuf, b.ocl->prevGeomBuf, b.ocl->historyBuf, b.ocl->prevHistoryBuf,
+			b.ocl->filterBuf[0], b.ocl->filterBuf[1], b.ocl->cacheBuf, b.ocl->prevCacheBuf, b.ocl->cacheDepthBuf,
+			b.ocl->rateBuf };
+		for (cl_mem m : mems)
+		{
+			size_t size = 0;
+			if (m != NULL) clGetMemObjectInfo(m, CL_MEM_SIZE, sizeof(size_t), &size, NULL);
+			bytes += size;
+		}
+	}
+	return bytes;
+}
+
+//denoiser passes of the band after its kd-tree launches, the last writes
+//band.image. this frame's first hits and history are the next one's
+static void enqueueDenoise(rtBand& band, const Info& info, std::vector<cl_event>& events)
+{
+	OCLsetting& cl = *band.ocl;
+	size_t offset[2] = { 0, band.first };
+	size_t size[2] = { WIDTH, band.rows };
+
+	cl_event e;
+	clSetKernelArg(cl.kernel_DenoiseTemporal, 0, sizeof(Info), &info);
+	clSetKernelArg(cl.kernel_DenoiseTemporal, 1, sizeof(PinholeCamera), &Core.rtCam.camera);
+	clSetKernelArg(cl.kernel_DenoiseTemporal, 2, sizeof(PinholeCamera), &denoiseCamera);
+	clSetKernelArg(cl.kernel_DenoiseTemporal, 3, sizeof(cl_mem), &cl.radianceBuf);
+	clSetKernelArg(cl.kernel_DenoiseTemporal, 4, sizeof(cl_mem), &cl.pixelGeomBuf);
+	clSetKernelArg(cl.kernel_DenoiseTemporal, 5, sizeof(cl_mem), &cl.prevGeomBuf);
+	clSetKernelArg(cl.kernel_DenoiseTemporal, 6, sizeof(cl_mem), &cl.prevHistoryBuf);
+	clSetKernelArg(cl.kernel_DenoiseTemporal, 7, sizeof(cl_mem), &cl.historyBuf);
+	clSetKernelArg(cl.kernel_DenoiseTemporal, 8, sizeof(cl_mem), &cl.filterBuf[0]);
+	clEnqueueNDRangeKernel(cl.queue, cl.kernel_DenoiseTemporal, 2, offset, size, NULL, 0, NULL, &e);
+	events.push_back(e);
+
+	for (int pass = 0; pass < info.denoise; pass++)
+	{
+		clSetKernelArg(cl.kernel_DenoiseAtrous, 0, sizeof(Info), &info);
+		clSetKernelArg(cl.kernel_DenoiseAtrous, 1, sizeof(int), &pass);
+		clSetKernelArg(cl.kernel_DenoiseAtrous, 2, sizeof(cl_mem), &cl.pixelGeomBuf);
+		clSetKernelArg(cl.kernel_DenoiseAtrous, 3, sizeof(cl_mem), &cl.filterBuf[pass % 2]);
+		clSetKernelArg(cl.kernel_DenoiseAtrous, 4, sizeof(cl_mem), &cl.filterBuf[(pass + 1) % 2]);
+		clSetKernelArg(cl.kernel_DenoiseAtrous, 5, sizeof(cl_mem), &band.image);
+		clEnqueueNDRangeKernel(cl.queue, cl.kernel_DenoiseAtrous, 2, offset, size, NULL, 0, NULL, &e);
+		events.push_back(e);
+	}
+
+	std::swap(cl.pixelGeomBuf, cl.prevGeomBuf);
+	std::swap(cl.historyBuf, cl.prevHistoryBuf);
+}
+
+//last frame's cache of the band moved to this view, then the pixels it can
+//not fill into the work list. the others are written from the cache
+static void enqueueCache(rtBand& band, const Info& info, const size_t offset[2], const size_t size[2], std::vector<cl_event>& events)
+{
+	OCLsetting& cl = *band.ocl;
+	cl_uint none = 0xffffffff;
+	clEnqueueFillBuffer(cl.queue, cl.cacheDepthBuf, &none, sizeof(cl_uint), 0, sizeof(cl_uint) * cl.ndr[0] * cl.ndr[1], 0, NULL, NULL);
+
+	cl_event e;
+	cl_kernel moves[] = { cl.kernel_CacheDepth, cl.kernel_CacheScatter };
+	for (cl_kernel kernel : moves)
+	{
+		clSetKernelArg(kernel, 0, sizeof(Info), &info);
+		clSetKernelArg(kernel, 1, sizeof(PinholeCamera), &Core.rtCam.camera);
+		clSetKernelArg(kernel, 2, sizeof(cl_mem), &cl.prevCacheBuf);
+		clSetKernelArg(kernel, 3, sizeof(cl_mem), &cl.cacheDepthBuf);
+		clSetKernelArg(kernel, 4, sizeof(cl_mem), &cl.cacheBuf);
+		clEnqueueNDRangeKernel(cl.queue, kernel, 2, offset, size, NULL, 0, NULL, &e);
+		events.push_back(e);
+	}
+
+	clSetKernelArg(cl.kernel_CacheWorkList, 0, sizeof(Info), &info);
+	clSetKernelArg(cl.kernel_CacheWorkList, 1, sizeof(cl_mem), &band.image);
+	clSetKernelArg(cl.kernel_CacheWorkList, 2, sizeof(cl_mem), &cl.cacheBuf);
+	clSetKernelArg(cl.kernel_CacheWorkList, 3, sizeof(cl_mem), &cl.pixelGeomBuf);
+	clSetKernelArg(cl.kernel_CacheWorkList, 4, sizeof(cl_mem), &cl.radianceBuf);
+	clSetKernelArg(cl.kernel_CacheWorkList, 5, sizeof(cl_mem), &cl.workListBuf);
+	clSetKernelArg(cl.kernel_CacheWorkList, 6, sizeof(cl_mem), &cl.workCountBuf);
+	clSetKernelArg(cl.kernel_CacheWorkList, 7, sizeof(cl_mem), &cl.rateBuf);
+	clEnqueueNDRangeKernel(cl.queue, cl.kernel_CacheWorkList, 2, offset, size, NULL, 0, NULL, &e);
+	events.push_back(e);
+}
+
+//rate of every RATE_TILE tile of the frame into rateMap, false when no
+//map is in use. a tile takes the rate of its point nearest the fovea
+static bool buildRateMap()
+{
+	if (appRates.empty() && fovea.z <= 0.0f) return false;
+	unsigned tilesX = (WIDTH + RATE_TILE - 1) / RATE_TILE;
+	unsigned tilesY = (HEIGHT + RATE_TILE - 1) / RATE_TILE;
+	rateMap.resize(tilesX * tilesY);
+	glm::vec2 center(fovea.x * WIDTH, fovea.y * HEIGHT);
+	for (unsigned y = 0; y < tilesY; y++)
+	{
+		for (unsigned x = 0; x < tilesX; x++)
+		{
+			int rate;
+			if (!appRates.empty())
+			{
+				//the application's map stretched over the frame
+				unsigned ax = x * appRatesWidth / tilesX;
+				unsigned ay = y * appRatesHeight / tilesY;
+				rate = appRates[ay * appRatesWidth + ax];
+			}
+			else
+			{
+				glm::vec2 lo(x * RATE_TILE, y * RATE_TILE);
+				float d = glm::length(glm::clamp(center, lo, lo + glm::vec2(RATE_TILE)) - center) / HEIGHT;
+				rate = d <= fovea.z ? 0 : (d <= 2.0f * fovea.z ? 1 : 2);
+			}
+			rateMap[y * tilesX + x] = (cl_uchar)std::min(rate, RATE_MAX);
+		}
+	}
+	return true;
+}
+
+//finish the frame statistics, frame time runs from flush end to flush end
+static void endFrameStats()
+{
+	static Timer frameClock;
+	static bool firstFrame = true;
+	if (!firstFrame) Stats.Current().frameMs = frameClock.getElapsedTimeInMilliSec();
+	firstFrame = false;
+	frameClock.start();
+	Stats.EndFrame();
+}
+
+//plain cl image, read back by rtReadPixelsEXT or the pbo ring
+static cl_mem createFrameImage(cl_context context)
+{
+	cl_image_format format = { CL_RGBA, CL_FLOAT };
+	cl_image_desc desc;
+	memset(&desc, 0, sizeof(desc));
+	desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+	desc.image_width = WIDTH;
+	desc.image_height = HEIGHT;
+	return clCreateImage(context, CL_MEM_WRITE_ONLY, &format, &desc, NULL, NULL);
+}
+
+//frames timed on each fetch path before RT_FETCH_AUTO keeps one
+#define FETCH_TRIALS 4
+
+static void resetFetch(rtBand& band)
+{
+	band.fetch = RT_FETCH_AUTO;
+	band.fetchMs[0] = band.fetchMs[1] = 0.0;
+	band.fetchFrames[0] = band.fetchFrames[1] = 0;
+}
+
+//fetch path of the band's next frame, auto alternates until both are timed
+static bool fetchImage(rtBand& band)
+{
+	if (fetchMode != RT_FETCH_AUTO) return fetchMode == RT_FETCH_IMAGE;
+	if (band.fetch != RT_FETCH_AUTO) return band.fetch == RT_FETCH_IMAGE;
+	return band.fetchFrames[1] < band.fetchFrames[0];
+}
+
+//per row, bands are resized between frames
+static void timeFetch(rtBand& band, bool image)
+{
+	if (fetchMode != RT_FETCH_AUTO || band.fetch != RT_FETCH_AUTO) return;
+	band.fetchMs[image] += band.ms / std::max(band.rows, 1u);
+	band.fetchFrames[image]++;
+	if (band.fetchFrames[0] < FETCH_TRIALS || band.fetchFrames[1] < FETCH_TRIALS) return;
+
+	band.fetch = band.fetchMs[1] < band.fetchMs[0] ? RT_FETCH_IMAGE : RT_FETCH_BUFFER;
+}
 
-	//init opencl setting, and enable CL GL interop
-	Ocl.InitCL(true);
+//tuned shapes are kept per launch variant
+static std::string tuneVariant(const Info& info, bool image)
+{
+	static const char* dispatch[] = { "scanline", "tile", "morton" };
+	std::string variant = image ? "image" : "buffer";
+	variant += std::string("/") + dispatch[info.dispatch];
+	variant += info.traversal == RT_TRAVERSAL_PACKET ? "/packet" : "/single";
+	variant += info.schedule == RT_SCHEDULE_PERSISTENT ? "/persistent" : "/ndrange";
+	return variant;
+}
+
+//work-group shape of the band's next launch of variant by tuner, trial is
+//set when the frame times a candidate. waits for the fetch path, shapes
+//timed while it alternates would compare two kernels
+static TuneShape tuneShape(rtBand& band, LaunchTuner& tuner, const std::string& variant, size_t tile, bool& trial)
+{
+	TuneShape square = { tile, tile };
+	trial = false;
+	if (fetchMode == RT_FETCH_AUTO && band.fetch == RT_FETCH_AUTO) return square;
+
+	if (tuner.Variant() != variant)
+	{
+		OCLsetting& cl = *band.ocl;
+		std::vector<TuneShape> shapes = tuneLaunch ? TuneShapes(cl.simdWidth, cl.groupLimit) : std::vector<TuneShape>();
+		tuner.Begin(tuneCache, MakeTuneKey(cl.device, variant, WIDTH, HEIGHT), shapes, square);
+	}
+	trial = tuner.Tuning();
+	return tuner.Shape();
+}
+
+//samples a pixel has before adaptive sampling judges its noise
+#define ADAPTIVE_MIN_SAMPLES 4
+
+//a-trous passes of the denoiser, the last one's taps are 2^7 pixels apart
+#define DENOISE_MAX_PASSES 8
+
+//the camera, lights and settings of the last frame, so its samples still
+//add up. a kd-tree build restarts them on its own
+static bool sameView()
+{
+	static PinholeCamera camera;
+	static Info info;
+	static std::vector<SphereLight> lights;
+
+	Info now = Core.info;
+	now.samples = info.samples;
+	bool same = memcmp(&camera, &Core.rtCam.camera, sizeof(PinholeCamera)) == 0
+		&& memcmp(&info, &now, sizeof(Info)) == 0
+		&& lights.size() == Core.pointLight.size()
+		&& memcmp(lights.data(), Core.pointLight.data(), sizeof(SphereLight) * lights.size()) == 0;
+
+	camera = Core.rtCam.camera;
+	info = Core.info;
+	lights = Core.pointLight;
+	return same;
+}
+
+//the band traces every pixel: it still times fetch paths or work-group
+//shapes, or the device has no 2d work-groups for a work list
+static bool wholeFrames(rtBand& band)
+{
+	return (fetchMode == RT_FETCH_AUTO && band.fetch == RT_FETCH_AUTO) || band.tuner.Tuning()
+		|| band.ocl->DispatchTile() == 0;
+}
+
+//resize bands by the throughput of each device
+static void balanceBands()
+{
+	if (Bands.size() < 2) return;
+
+	double total = 0.0;
+	for (rtBand& b : Bands)
+	{
+		double measured = b.rows / std::max(b.ms, 0.001);
+		if (b.rowsPerMs == 0.0) b.rowsPerMs = measured;
+		else b.rowsPerMs += BAND_SMOOTHING * (measured - b.rowsPerMs);
+		total += b.rowsPerMs;
+	}
+
+	unsigned first = 0;
+	unsigned left = (unsigned)Bands.size();
+	for (rtBand& b : Bands)
+	{
+		left--;
+		unsigned rows = HEIGHT - first;
+		if (left > 0)
+		{
+			//rows this band may take and still leave MIN_BAND_ROWS to each later band, signed so it cannot wrap
+			int room = (int)HEIGHT - (int)first - MIN_BAND_ROWS * (int)left;
+			room = std::max(room / MIN_BAND_ROWS * MIN_BAND_ROWS, MIN_BAND_ROWS);
+			rows = (unsigned)(HEIGHT * b.rowsPerMs / total / MIN_BAND_ROWS + 0.5) * MIN_BAND_ROWS;
+			rows = std::max(rows, (unsigned)MIN_BAND_ROWS);
+			rows = std::min(rows, (unsigned)room);
+		}
+		b.first = first;
+		b.rows = rows;
+		first += rows;
+	}
+}
+
+//read the frame image to host memory, RGBA float, top row first.
+//in split frame mode this composites the bands of all devices
+static void readFrame(float* dst)
+{
+	if (nativeMode)
+	{
+		memcpy(dst, Core.frameData.data(), sizeof(float) * Core.frameData.size());
+		return;
+	}
+
+	for (rtBand& b : Bands)
+	{
+		size_t origin[3] = { 0, b.first, 0 };
+		size_t region[3] = { WIDTH, b.rows, 1 };
+		float* band = dst + (size_t)b.first * WIDTH * 4;
+
+		if (b.ocl->glinterop) clEnqueueAcquireGLObjects(b.ocl->queue, 1, &b.image, 0, 0, NULL);
+		clEnqueueReadImage(b.ocl->queue, b.image, CL_FALSE, origin, region, 0, 0, band, 0, NULL, NULL);
+		if (b.ocl->glinterop) clEnqueueReleaseGLObjects(b.ocl->queue, 1, &b.image, 0, 0, NULL);
+	}
+	for (rtBand& b : Bands) clFinish(b.ocl->queue);
+}
+
+//without interop, stream the frame into the texture through a pbo ring.
+//filling the next pbo does not wait for the texture upload sourcing the last one
+static void uploadFrame()
+{
+	size_t fsize = sizeof(float) * 4 * WIDTH * HEIGHT;
+	Core.pboIndex = (Core.pboIndex + 1) % PBO_RING;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, Core.pbo[Core.pboIndex]);
+	float* dst = (float*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, fsize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (dst != NULL)
+	{
+		readFrame(dst);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		glBindTexture(GL_TEXTURE_2D, Core.frame_texture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHT, GL_RGBA, GL_FLOAT, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+//draw frame_texture as a full screen quad
+static void drawFrame()
+{
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(-1.0, 1.0, -1.0, 1.0, -1.0, 1.0);
+
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_LIGHTING);
+	glEnable(GL_TEXTURE_2D);
 
-	glGenTextures(1, &Core.frame_texture);
 	glBindTexture(GL_TEXTURE_2D, Core.frame_texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, WIDTH, HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
+	glBegin(GL_QUADS);
+
+	glTexCoord2f(0.0f, 1.0f);
+	glVertex3f(-1.0f, -1.0f, 0.1f);
+
+	glTexCoord2f(1.0f, 1.0f);
+	glVertex3f(1.0f, -1.0f, 0.1f);
+
+	glTexCoord2f(1.0f, 0.0f);
+	glVertex3f(1.0f, 1.0f, 0.1f);
+
+	glTexCoord2f(0.0f, 0.0f);
+	glVertex3f(-1.0f, 1.0f, 0.1f);
+	glEnd();
 	glBindTexture(GL_TEXTURE_2D, 0);
 
-	Core.frame_texture_img = clCreateFromGLTexture(Ocl.context, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, Core.frame_texture, NULL);
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
 
-	INTXN = clCreateBuffer(Ocl.context, CL_MEM_READ_WRITE, sizeof(int) * 800 * 600 * 2, NULL, NULL);
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+}
 
+/////////// implement plugining api  ///////////
+
+bool rtInit(RTdevice device /*= RT_DEVICE_GPU*/, RToutput output /*= RT_OUTPUT_WINDOW*/)
+{
+	if (isInit == true) return !initFailed;
+	isInit = true;
+	outputMode = output;
+	nativeMode = (device == RT_DEVICE_NATIVE);
+	initDevice = device;
+
+	const char* tunePath = getenv("RTAPI_TUNE_CACHE");
+	if (tunePath != NULL) tuneCache = tunePath;
+
+	//capture an unmodified application
+	const char* capturePath = getenv("RTAPI_CAPTURE");
+	if (capturePath != NULL && !Capture().Enabled()) Capture().Open(capturePath);
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_INIT, device, output);
+
+	if (nativeMode)
+	{
+		//c++ tracer renders into frameData
+		Native.reset(new NativeTracer(WIDTH, HEIGHT));
+		Core.frameData.resize(WIDTH * HEIGHT * 4, 0.0f);
+	}
+	else if (device == RT_DEVICE_ALL)
+	{
+		//no interop, the bands are composited on the host
+		std::vector<cl_device_id> devs = OCLsetting::ListDevices(CL_DEVICE_TYPE_GPU | CL_DEVICE_TYPE_CPU);
+		//every band keeps at least MIN_BAND_ROWS rows
+		if (devs.size() > HEIGHT / MIN_BAND_ROWS) devs.resize(HEIGHT / MIN_BAND_ROWS);
+		bool ok = devs.empty() ? Ocl.InitCL(false, CL_DEVICE_TYPE_GPU | CL_DEVICE_TYPE_CPU) : Ocl.InitCL(devs[0]);
+		if (ok == false)
+		{
+			printf("rtInit: opencl init failed.\n");
+			initFailed = true;
+			return false;
+		}
+
+		for (size_t i = 1; i < devs.size(); i++)
+		{
+			Peers.emplace_back(new OCLsetting(WIDTH, HEIGHT));
+			if (Peers.back()->InitCL(devs[i])) continue;
+			//render on the devices that did come up
+			printf("rtInit: skipping device %d.\n", (int)i);
+			Peers.pop_back();
+		}
+	}
+	else
+	{
+		cl_device_type type = CL_DEVICE_TYPE_GPU;
+		if (device == RT_DEVICE_CPU) type = CL_DEVICE_TYPE_CPU;
+		else if (device == RT_DEVICE_ANY) type = CL_DEVICE_TYPE_GPU | CL_DEVICE_TYPE_CPU;
+
+		//init opencl setting, and enable CL GL interop when drawing to a window
+		if (Ocl.InitCL(output == RT_OUTPUT_WINDOW, type) == false)
+		{
+			printf("rtInit: opencl init failed.\n");
+			initFailed = true;
+			return false;
+		}
+	}
+
+	if (output == RT_OUTPUT_WINDOW)
+	{
+		glGenTextures(1, &Core.frame_texture);
+		glBindTexture(GL_TEXTURE_2D, Core.frame_texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, WIDTH, HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	if (Ocl.glinterop)
+	{
+		Core.frame_texture_img = clCreateFromGLTexture(Ocl.context, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, Core.frame_texture, NULL);
+	}
+	else if (!nativeMode)
+	{
+		Core.frame_texture_img = createFrameImage(Ocl.context);
+	}
+
+	//split rows evenly until kernel times are known
+	if (!nativeMode)
+	{
+		std::vector<OCLsetting*> devs(1, &Ocl);
+		for (auto& peer : Peers) devs.push_back(peer.get());
+
+		unsigned count = (unsigned)devs.size();
+		for (unsigned i = 0; i < count; i++)
+		{
+			rtBand b;
+			b.ocl = devs[i];
+			b.image = (i == 0) ? Core.frame_texture_img : createFrameImage(devs[i]->context);
+			b.first = HEIGHT * i / count / MIN_BAND_ROWS * MIN_BAND_ROWS;
+			b.rows = (i + 1 < count ? HEIGHT * (i + 1) / count / MIN_BAND_ROWS * MIN_BAND_ROWS : HEIGHT) - b.first;
+			b.ms = 0.0;
+			b.rowsPerMs = 0.0;
+			b.history = false;
+			b.cached = false;
+			resetFetch(b);
+			Bands.push_back(b);
+		}
+	}
+
+	if (!Ocl.glinterop)
+	{
+		if (output == RT_OUTPUT_WINDOW)
+		{
+			size_t fsize = sizeof(float) * 4 * WIDTH * HEIGHT;
+			glGenBuffers(PBO_RING, Core.pbo);
+			for (int i = 0; i < PBO_RING; i++)
+			{
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, Core.pbo[i]);
+				glBufferData(GL_PIXEL_UNPACK_BUFFER, fsize, NULL, GL_STREAM_DRAW);
+			}
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+	}
+	return true;
 }
 
 void rtGenBuffers(GLsizei n, GLuint* buffers)
@@ -338,23 +909,28 @@ void rtGenBuffers(GLsizei n, GLuint* buffers)
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
 	}
 
 	if (n <= 0) return;
 	for (unsigned i = 0; i < n; i++)
 	{
 		buffers[i] = Core.glbuffers.size();
-		Core.glbuffers.push_back(RawBuffer());
+		Core.glbuffers.emplace_back();
 	}
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_GEN_BUFFERS, n);
 }
 
 void rtBindBuffer(GLenum target, GLuint buffer)
 {
-	Ocl.CheckInit();
+	if (isInit == false)
+	{
+		rtInit();
+	}
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_BIND_BUFFER, target, buffer);
+
 	static std::array<GLenum, 2> targetArray = { GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER };
 	
-	if (buffer > Core.glbuffers.size()) return;
+	if (buffer >= Core.glbuffers.size()) return;
 
 	auto& result = std::find(targetArray.begin(), 
 							 targetArray.end(), target);
@@ -377,8 +953,8 @@ void rtBufferData(GLenum target, GLsizeiptr size, const GLvoid * data, GLenum us
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
 	}
+	if (Capture().Enabled() && size > 0) Capture().BufferData(target, usage, size, data);
 
 	static std::array<GLenum, 3> usageArray = { GL_STREAM_DRAW, GL_STATIC_DRAW, GL_DYNAMIC_DRAW };
 	auto& u = std::find(usageArray.begin(), usageArray.end(), usage);
@@ -409,8 +985,8 @@ void rtVertexPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *poin
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
 	}
+	if (Capture().Enabled()) Capture().Pointer(CAPTURE_VERTEX_POINTER, size, type, stride, (uint64_t)(size_t)pointer);
 
 	if (size != 3)
 	{
@@ -443,8 +1019,8 @@ void rtColorPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *point
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
 	}
+	if (Capture().Enabled()) Capture().Pointer(CAPTURE_COLOR_POINTER, size, type, stride, (uint64_t)(size_t)pointer);
 
 	if (size != 3)
 	{
@@ -477,8 +1053,8 @@ void rtNormalPointer(GLenum type, GLsizei stride, const GLvoid *pointer)
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
 	}
+	if (Capture().Enabled()) Capture().Pointer(CAPTURE_NORMAL_POINTER, 3, type, stride, (uint64_t)(size_t)pointer);
 
 	unsigned st;
 	switch (type)
@@ -509,7 +1085,16 @@ void rtDrawArrays(GLenum mode, GLint first, GLsizei count)
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
+	}
+
+	//no gl context to query in headless mode
+	glm::mat4 modelview = headlessModelview;
+	if (outputMode != RT_OUTPUT_HEADLESS) glGetFloatv(GL_MODELVIEW_MATRIX, glm::value_ptr(modelview));
+
+	if (Capture().Enabled())
+	{
+		Capture().Modelview(glm::value_ptr(modelview));
+		Capture().Ints(CAPTURE_DRAW_ARRAYS, mode, first, count);
 	}
 
 	bool vertex_CAP = Core.capability[GL_VERTEX_ARRAY];
@@ -521,12 +1106,13 @@ void rtDrawArrays(GLenum mode, GLint first, GLsizei count)
 		return;
 	}
 
+	TRACE_SCOPE("ingest");
+	Timer ingest;
+	ingest.start();
+
 	bool color_CAP = Core.capability[GL_COLOR_ARRAY];
 	bool normal_CAP = Core.capability[GL_NORMAL_ARRAY];
 
-	glm::mat4 modelview;
-	glGetFloatv(GL_MODELVIEW_MATRIX, glm::value_ptr(modelview));
-
 	int looptimes = count / size;
 	
 	//set loop times
@@ -588,6 +1174,7 @@ void rtDrawArrays(GLenum mode, GLint first, GLsizei count)
 	}
 
 	Core.info.tri_SIZE += looptimes;
+	Stats.Current().ingestMs += ingest.getElapsedTimeInMilliSec();
 }
 
 void rtFlush()
@@ -595,125 +1182,477 @@ void rtFlush()
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
 	}
+	if (initFailed)
+	{
+		//nothing to draw on, drop the frame
+		Core.triangleData.clear();
+		Core.info.tri_SIZE = 0;
+		return;
+	}
+	TRACE_SCOPE("flush");
 
-	Core.info.light_enable = Core.capability[GL_LIGHTING];
-	unsigned ln = GL_LIGHT0;
-	for (int i = 0; i < 7; i++)
+	if (Capture().Enabled())
 	{
-		Core.pointLight[i].enable = Core.capability[ln];
-		ln += 1;
+		//the tree was built before the capture, rebuild it from this frame on replay
+		if (captureTreePending) Capture().Op(CAPTURE_BUILD_KDTREE);
+		captureTreePending = false;
+		Capture().Op(CAPTURE_FLUSH);
 	}
 
-	//check triangle data size, recreate buffer size properly
+	Core.info.light_enable = Core.capability[GL_LIGHTING];
+	BuildLightTree(Core.pointLight, Core.lightNodes);
+	Core.info.pl_SIZE = (int)Core.pointLight.size();
+	Core.info.lightNodes = (int)Core.lightNodes.size();
+
 	Core.info.tri_SIZE = Core.triangleData.size();
-	static unsigned TRISIZE = 0;
-	if (TRISIZE < Core.info.tri_SIZE)
+
+	if (nativeMode)
 	{
-		if (Ocl.triBuf != NULL)
+		Core.info.samples++;
+		Core.rtCam.prepareCamera();
+
+		TraceScope traceRender("trace");
+		Timer render;
+		render.start();
+		if (Core.isTreeBuild)
 		{
-			clReleaseMemObject(Ocl.triBuf);
-			Ocl.triBuf = NULL;
+			Bounds3f b = pbrt_kdtree->WorldBound();
+			float bound[6] = { b.pMin.x, b.pMin.y, b.pMin.z, b.pMax.x, b.pMax.y, b.pMax.z };
+			Native->Render(Core.info, Core.rtCam.camera, bound, Core.kdnodes, Core.kdtriangles,
+				Core.triangleData, Core.pointLight, Core.lightNodes, Core.frameData.data());
 		}
-		TRISIZE = Core.info.tri_SIZE;
-		Ocl.triBuf = clCreateBuffer(Ocl.context, CL_MEM_READ_ONLY, sizeof(Triangle) * TRISIZE, NULL, NULL);
-	}
+		else if (!Core.triangleData.empty())
+		{
+			//no tree yet, trace the whole scene as one leaf
+			float bound[6] = { FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			std::vector<int> all(Core.triangleData.size());
+			for (size_t i = 0; i < all.size(); i++)
+			{
+				all[i] = (int)i;
+				const Triangle& t = Core.triangleData[i];
+				for (const glm::vec4* v : { &t.v0, &t.v1, &t.v2 })
+				{
+					for (int a = 0; a < 3; a++)
+					{
+						bound[a] = std::min(bound[a], (*v)[a]);
+						bound[a + 3] = std::max(bound[a + 3], (*v)[a]);
+					}
+				}
+			}
+			std::vector<KDNode> leaf(1);
+			memset(leaf.data(), 0, sizeof(KDNode));
+			leaf[0].stat = isLeaf;
+			leaf[0].axis = None;
+			leaf[0].end = (int)all.size();
+			Native->Render(Core.info, Core.rtCam.camera, bound, leaf, all,
+				Core.triangleData, Core.pointLight, Core.lightNodes, Core.frameData.data());
+		}
+		Stats.Current().kernelMs = render.getElapsedTimeInMilliSec();
 
-	//send collected data to opencl buffer
-	clEnqueueWriteBuffer(Ocl.queue, Ocl.triBuf, CL_FALSE, 0, sizeof(Triangle) * TRISIZE, Core.triangleData.data(), 0, NULL, NULL);
-	clEnqueueWriteBuffer(Ocl.queue, Ocl.sphlBuf, CL_FALSE, 0, sizeof(SphereLight) * 8, Core.pointLight.data(), 0, NULL, NULL);
-	clFinish(Ocl.queue);
+		if (outputMode == RT_OUTPUT_WINDOW)
+		{
+			TRACE_SCOPE("present");
+			Timer blit;
+			blit.start();
+			uploadFrame();
+			drawFrame();
+			Stats.Current().blitMs = blit.getElapsedTimeInMilliSec();
+		}
 
-	//update sample & camera
-	Core.info.samples++;
-	Core.rtCam.prepareCamera();
+		Core.triangleData.clear();
+		Core.info.tri_SIZE = 0;
+		endFrameStats();
+		return;
+	}
 
-	//wait all data prepare
-	clFinish(Ocl.queue);
-	glFinish();
+	RTframeStats& stats = Stats.Current();
 
-	//gain frame_texture_img usage permission
-	clEnqueueAcquireGLObjects(Ocl.queue, 1,  &Core.frame_texture_img, 0, 0, NULL);
+	//align device clocks to the trace clock every frame, they drift
+	if (Trace().Enabled())
+	{
+		for (size_t i = 0; i < Bands.size(); i++)
+		{
+			char name[256];
+			clGetDeviceInfo(Bands[i].ocl->device, CL_DEVICE_NAME, 256, name, NULL);
+			Trace().SyncDevice(Bands[i].ocl->queue, (int)i, name);
+		}
+	}
 
-	cl_event execute_event;
+	double uploadBegin = Trace().NowUs();
+	Timer upload;
+	upload.start();
 
-	//set kernel arg
-	if(Core.isTreeBuild)
+	//send collected data to the opencl buffers of every device
+	std::vector<cl_event> tri_events(Bands.size(), NULL), light_events(Bands.size(), NULL);
+	for (size_t i = 0; i < Bands.size(); i++)
 	{
-		Bounds3f b = pbrt_kdtree->WorldBound(); 
-		cl_float8 bound = { b.pMin.x, b.pMin.y, b.pMin.z, 0, b.pMax.x, b.pMax.y, b.pMax.z, 0 };
+		OCLsetting& cl = *Bands[i].ocl;
 
-		//use kdtree kernel
-		clSetKernelArg(Ocl.kernel_PathTracing_KDtree, 0, sizeof(Info), &Core.info);
-		clSetKernelArg(Ocl.kernel_PathTracing_KDtree, 1, sizeof(PinholeCamera), &Core.rtCam.camera);
-		clSetKernelArg(Ocl.kernel_PathTracing_KDtree, 2, sizeof(cl_mem), &Core.frame_texture_img);
-		clSetKernelArg(Ocl.kernel_PathTracing_KDtree, 3, sizeof(cl_float8), &bound);
-		clSetKernelArg(Ocl.kernel_PathTracing_KDtree, 4, sizeof(cl_mem), &Core.node_buf);
-		clSetKernelArg(Ocl.kernel_PathTracing_KDtree, 5, sizeof(cl_mem), &Core.trilist_buf);
-		clSetKernelArg(Ocl.kernel_PathTracing_KDtree, 6, sizeof(cl_mem), &Ocl.triBuf);
-		clSetKernelArg(Ocl.kernel_PathTracing_KDtree, 7, sizeof(cl_mem), &Ocl.sphlBuf);
-		clSetKernelArg(Ocl.kernel_PathTracing_KDtree, 8, sizeof(cl_mem), &INTXN);
-		//do draw call
-		int err = clEnqueueNDRangeKernel(Ocl.queue, Ocl.kernel_PathTracing_KDtree, 2, NULL, Ocl.ndr, NULL, 0, NULL, &execute_event);
-	}
-	else
-	{	
-		//use common kernel
-		clSetKernelArg(Ocl.kernel_PathTracing, 0, sizeof(Info), &Core.info);
-		clSetKernelArg(Ocl.kernel_PathTracing, 1, sizeof(PinholeCamera), &Core.rtCam.camera);
-		clSetKernelArg(Ocl.kernel_PathTracing, 2, sizeof(cl_mem), &Core.frame_texture_img);
-		clSetKernelArg(Ocl.kernel_PathTracing, 3, sizeof(cl_mem), &Ocl.triBuf);
-		clSetKernelArg(Ocl.kernel_PathTracing, 4, sizeof(cl_mem), &Ocl.sphlBuf);
+		//check triangle data size, recreate buffer size properly
+		if (cl.triCap < Core.info.tri_SIZE)
+		{
+			if (cl.triBuf != NULL)
+			{
+				clReleaseMemObject(cl.triBuf);
+				cl.triBuf = NULL;
+			}
+			cl.triCap = Core.info.tri_SIZE;
+			cl.triBuf = clCreateBuffer(cl.context, CL_MEM_READ_ONLY, sizeof(Triangle) * cl.triCap, NULL, NULL);
+		}
 
-		//do draw call
-		clEnqueueNDRangeKernel(Ocl.queue, Ocl.kernel_PathTracing, 2, NULL, Ocl.ndr, NULL, 0, NULL, &execute_event);
+		if (Core.info.tri_SIZE > 0)
+			clEnqueueWriteBuffer(cl.queue, cl.triBuf, CL_FALSE, 0, sizeof(Triangle) * Core.info.tri_SIZE, Core.triangleData.data(), 0, NULL,
+				Trace().Enabled() ? &tri_events[i] : NULL);
+		cl.ReserveLights(Core.pointLight.size());
+		clEnqueueWriteBuffer(cl.queue, cl.sphlBuf, CL_FALSE, 0, sizeof(SphereLight) * Core.pointLight.size(), Core.pointLight.data(), 0, NULL,
+			Trace().Enabled() ? &light_events[i] : NULL);
+		if (!Core.lightNodes.empty())
+			clEnqueueWriteBuffer(cl.queue, cl.lightNodeBuf, CL_FALSE, 0, sizeof(LightNode) * Core.lightNodes.size(), Core.lightNodes.data(), 0, NULL, NULL);
 	}
 
-	clWaitForEvents(1, &execute_event);
-	
-	//release frame_texture_img usage permission
-	clEnqueueReleaseGLObjects(Ocl.queue, 1, &Core.frame_texture_img, 0, 0, NULL);
+	//update sample & camera
+	Core.info.samples++;
+	Core.rtCam.prepareCamera();
 
- 	glMatrixMode(GL_PROJECTION);
-	glPushMatrix();
-	glLoadIdentity();
-	glOrtho(-1.0, 1.0, -1.0, 1.0, -1.0, 1.0);
+	//adaptive samples add up while the view stays still. once every pixel
+	//has a few, only the noisy ones are traced again
+	bool adaptive = Core.info.threshold > 0.0f && Core.isTreeBuild;
+	if (!sameView()) adaptivePass = 0;
+	bool listPass = adaptive && adaptivePass >= ADAPTIVE_MIN_SAMPLES;
+	for (rtBand& band : Bands) listPass = listPass && !wholeFrames(band);
 
-	glMatrixMode(GL_MODELVIEW);
-	glPushMatrix();
-	glLoadIdentity();
+	//wait all data prepare
+	for (rtBand& band : Bands) clFinish(band.ocl->queue);
+	stats.uploadMs = upload.getElapsedTimeInMilliSec();
+	Trace().Complete("upload", uploadBegin, Trace().NowUs());
+	for (size_t i = 0; i < Bands.size(); i++)
+	{
+		if (tri_events[i] != NULL) eventMs(tri_events[i], "upload triangles", (int)i);
+		if (light_events[i] != NULL) eventMs(light_events[i], "upload lights", (int)i);
+	}
+	stats.uploadBytes = (double)(sizeof(Triangle) * Core.info.tri_SIZE + sizeof(SphereLight) * Core.pointLight.size()
+		+ sizeof(LightNode) * Core.lightNodes.size()) * Bands.size();
+	if (outputMode != RT_OUTPUT_HEADLESS) glFinish();
 
-	glDisable(GL_DEPTH_TEST);
-	glDisable(GL_LIGHTING);
-	glEnable(GL_TEXTURE_2D);
+	//gain frame_texture_img usage permission
+	cl_event acquire_event = NULL, release_event = NULL;
+	if (Ocl.glinterop) clEnqueueAcquireGLObjects(Ocl.queue, 1,  &Core.frame_texture_img, 0, 0, &acquire_event);
+
+	Bounds3f b = Core.isTreeBuild ? pbrt_kdtree->WorldBound() : Bounds3f();
+	cl_float8 bound = { b.pMin.x, b.pMin.y, b.pMin.z, 0, b.pMax.x, b.pMax.y, b.pMax.z, 0 };
+
+	//every device draws its band of rows, global offset keeps pixel ids of the whole frame
+	double traceBegin = Trace().NowUs();
+	std::vector<cl_event> execute_events(Bands.size()), list_events(Bands.size(), NULL);
+	std::vector<cl_event> edge_events(Bands.size(), NULL), aa_events(Bands.size(), NULL);
+	std::vector<std::vector<cl_event>> denoise_events(Bands.size());
+	//the denoiser is for frames of one sample, adaptive ones converge alone
+	bool denoise = Core.info.denoise > 0 && Core.isTreeBuild && !adaptive;
+	//reprojected frames trace only the pixels the cache can not fill, the
+	//first one and the first after the split moves fill it
+	bool reproject = Core.info.refresh < 1.0f && Core.isTreeBuild && !adaptive;
+	bool cachePass = reproject;
+	for (rtBand& band : Bands) cachePass = cachePass && band.cached && !wholeFrames(band);
+	std::vector<std::vector<cl_event>> cache_events(Bands.size());
+	//variable-rate frames trace the block corners of the rate map, frames
+	//timing the launch trace every pixel
+	bool variableRate = Core.isTreeBuild && !adaptive && buildRateMap();
+	for (rtBand& band : Bands) variableRate = variableRate && !wholeFrames(band);
+	std::vector<cl_event> fill_events(Bands.size(), NULL);
+	std::vector<bool> usedImage(Bands.size(), false);
+	std::vector<bool> tuning(Bands.size(), false), aaTuning(Bands.size(), false);
+	for (size_t i = 0; i < Bands.size(); i++)
+	{
+		rtBand& band = Bands[i];
+		OCLsetting& cl = *band.ocl;
+		size_t offset[2] = { 0, band.first };
+		size_t size[2] = { WIDTH, band.rows };
+
+		//2d work-groups, square unless tuned, the launch is padded to whole tiles
+		Info info = Core.info;
+		info.first = (int)band.first;
+		info.rows = (int)band.rows;
+		info.adaptive = adaptive ? (listPass ? ADAPTIVE_LIST : ADAPTIVE_FULL) : ADAPTIVE_OFF;
+		info.pass = (int)adaptivePass;
+		if (adaptive) cl.ReserveAdaptive();
+		//adaptive samples are jittered already, edges need work-groups
+		if (Core.info.aaSamples > 0 && Core.isTreeBuild && !adaptive && cl.DispatchTile() > 0)
+		{
+			info.antialias = AA_GBUFFER;
+			cl.ReserveAntialias();
+		}
+		else info.antialias = AA_OFF;
+		info.denoise = denoise ? Core.info.denoise : 0;
+		info.history = (denoise && band.history) ? 1 : 0;
+		if (denoise) cl.ReserveDenoise();
+		info.reproject = reproject ? (cachePass ? REPROJECT_LIST : REPROJECT_FULL) : REPROJECT_OFF;
+		if (reproject) cl.ReserveReprojection();
+		info.variableRate = variableRate ? 1 : 0;
+		if (variableRate)
+		{
+			cl.ReserveRates();
+			clEnqueueWriteBuffer(cl.queue, cl.rateBuf, CL_FALSE, 0, sizeof(cl_uchar) * rateMap.size(), rateMap.data(), 0, NULL, NULL);
+		}
+		//work lists take square work-groups whatever the dispatch
+		bool list = info.adaptive == ADAPTIVE_LIST || info.reproject == REPROJECT_LIST || variableRate;
+		bool scanline = (info.dispatch == RT_DISPATCH_SCANLINE && !list);
+		size_t tile = scanline ? 0 : cl.DispatchTile();
+		size_t local[2] = { tile, tile };
+		if (tile == 0)
+		{
+			//no packets or tile queue without known work-groups
+			info.dispatch = RT_DISPATCH_SCANLINE;
+			info.traversal = RT_TRAVERSAL_SINGLE;
+			info.schedule = RT_SCHEDULE_NDRANGE;
+		}
+		//as many top nodes as the device local memory holds
+		info.cachedNodes = (int)std::min(Core.kdTopNodes, cl.nodeCache);
 
-	glBindTexture(GL_TEXTURE_2D, Core.frame_texture);
-	glBegin(GL_QUADS);
+		//set kernel arg
+		if(Core.isTreeBuild)
+		{
+			//use kdtree kernel, the image variant reads views of the same buffers
+			bool image = fetchImage(band);
+			if (image && !cl.FetchImages(Core.kdnodes.size(), Core.triBlocks.size()))
+			{
+				image = false;
+				stats.imageFallbacks++;
+				if (band.fetch == RT_FETCH_AUTO) band.fetch = RT_FETCH_BUFFER;
+			}
+			usedImage[i] = image;
+			cl_kernel kernel = image ? cl.kernel_PathTracing_KDtree_image : cl.kernel_PathTracing_KDtree;
+			cl_mem nodes = image ? cl.nodeImg : cl.nodeBuf;
+			cl_mem blocks = image ? cl.blockImg : cl.blockBuf;
+			cl_mem tris = image ? cl.triImg : cl.triBuf;
+			if (list)
+			{
+				cl_uint zero = 0;
+				clEnqueueFillBuffer(cl.queue, cl.workCountBuf, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 0, NULL, NULL);
+				if (info.adaptive == ADAPTIVE_LIST)
+				{
+					//noisy pixels of the band into the work list, converged ones
+					//are written from their estimates
+					clSetKernelArg(cl.kernel_AdaptiveWorkList, 0, sizeof(Info), &info);
+					clSetKernelArg(cl.kernel_AdaptiveWorkList, 1, sizeof(cl_mem), &band.image);
+					clSetKernelArg(cl.kernel_AdaptiveWorkList, 2, sizeof(cl_mem), &cl.pixelStatBuf);
+					clSetKernelArg(cl.kernel_AdaptiveWorkList, 3, sizeof(cl_mem), &cl.workListBuf);
+					clSetKernelArg(cl.kernel_AdaptiveWorkList, 4, sizeof(cl_mem), &cl.workCountBuf);
+					clEnqueueNDRangeKernel(cl.queue, cl.kernel_AdaptiveWorkList, 2, offset, size, NULL, 0, NULL, &list_events[i]);
+				}
+				else if (info.reproject == REPROJECT_LIST) enqueueCache(band, info, offset, size, cache_events[i]);
+				else
+				{
+					//block corners of the rate map
+					clSetKernelArg(cl.kernel_RateWorkList, 0, sizeof(Info), &info);
+					clSetKernelArg(cl.kernel_RateWorkList, 1, sizeof(cl_mem), &cl.rateBuf);
+					clSetKernelArg(cl.kernel_RateWorkList, 2, sizeof(cl_mem), &cl.workListBuf);
+					clSetKernelArg(cl.kernel_RateWorkList, 3, sizeof(cl_mem), &cl.workCountBuf);
+					clEnqueueNDRangeKernel(cl.queue, cl.kernel_RateWorkList, 2, offset, size, NULL, 0, NULL, &list_events[i]);
+				}
+
+				//persistent work-groups take runs of the list. its pixels are
+				//scattered, so they trace single rays
+				info.traversal = RT_TRAVERSAL_SINGLE;
+				clEnqueueFillBuffer(cl.queue, cl.tileCounterBuf, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 0, NULL, NULL);
+				offset[1] = 0;
+				size[0] = cl.persistentGroups * tile;
+				size[1] = tile;
+			}
+			else if (tile > 0)
+			{
+				bool trial;
+				TuneShape shape = tuneShape(band, band.tuner, tuneVariant(info, image), tile, trial);
+				local[0] = shape.w;
+				local[1] = shape.h;
+				tuning[i] = trial;
+				size[0] = (size[0] + local[0] - 1) / local[0] * local[0];
+				size[1] = (size[1] + local[1] - 1) / local[1] * local[1];
+			}
 
-	glTexCoord2f(0.0f, 1.0f);
-	glVertex3f(-1.0f, -1.0f, 0.1f);
+			clSetKernelArg(kernel, 0, sizeof(Info), &info);
+			clSetKernelArg(kernel, 1, sizeof(PinholeCamera), &Core.rtCam.camera);
+			clSetKernelArg(kernel, 2, sizeof(cl_mem), &band.image);
+			clSetKernelArg(kernel, 3, sizeof(cl_float8), &bound);
+			clSetKernelArg(kernel, 4, sizeof(cl_mem), &nodes);
+			clSetKernelArg(kernel, 5, sizeof(cl_mem), &blocks);
+			clSetKernelArg(kernel, 6, sizeof(cl_mem), &tris);
+			clSetKernelArg(kernel, 7, sizeof(cl_mem), &cl.sphlBuf);
+			clSetKernelArg(kernel, 8, sizeof(cl_mem), &cl.intxnBuf);
+			clSetKernelArg(kernel, 9, sizeof(cl_mem), &cl.rayCountBuf);
+			clSetKernelArg(kernel, 10, sizeof(KDNode) * std::max(info.cachedNodes, 1), NULL);
+			clSetKernelArg(kernel, 11, sizeof(cl_mem), &cl.tileCounterBuf);
+			clSetKernelArg(kernel, 12, sizeof(cl_mem), &cl.lightNodeBuf);
+			clSetKernelArg(kernel, 13, sizeof(cl_mem), &cl.pixelStatBuf);
+			clSetKernelArg(kernel, 14, sizeof(cl_mem), &cl.workListBuf);
+			clSetKernelArg(kernel, 15, sizeof(cl_mem), &cl.workCountBuf);
+			clSetKernelArg(kernel, 16, sizeof(cl_mem), &cl.pixelGeomBuf);
+			clSetKernelArg(kernel, 17, sizeof(cl_mem), &cl.blueNoiseBuf);
+			clSetKernelArg(kernel, 18, sizeof(cl_mem), &cl.radianceBuf);
+			clSetKernelArg(kernel, 19, sizeof(cl_mem), &cl.cacheBuf);
+			clSetKernelArg(kernel, 20, sizeof(cl_mem), &cl.rateBuf);
+
+			//persistent: a row of work-groups that fills the device, no more
+			//than the band has tiles, takes the band's tiles from the counter
+			if (info.schedule == RT_SCHEDULE_PERSISTENT && !list)
+			{
+				cl_uint zero = 0;
+				size_t tiles = (size[0] / local[0]) * (size[1] / local[1]);
+				clEnqueueFillBuffer(cl.queue, cl.tileCounterBuf, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 0, NULL, NULL);
+				offset[1] = 0;
+				size[0] = std::min(cl.persistentGroups, tiles) * local[0];
+				size[1] = local[1];
+			}
+			//do draw call
+			clEnqueueNDRangeKernel(cl.queue, kernel, 2, offset, size, tile > 0 ? local : NULL, 0, NULL, &execute_events[i]);
 
-	glTexCoord2f(1.0f, 1.0f);
-	glVertex3f(1.0f, -1.0f, 0.1f);
+			if (info.variableRate)
+			{
+				//the rest of each coarse block from its corner
+				size_t fillOffset[2] = { 0, band.first };
+				size_t fillSize[2] = { WIDTH, band.rows };
+				clSetKernelArg(cl.kernel_RateFill, 0, sizeof(Info), &info);
+				clSetKernelArg(cl.kernel_RateFill, 1, sizeof(cl_mem), &cl.rateBuf);
+				clSetKernelArg(cl.kernel_RateFill, 2, sizeof(cl_mem), &cl.radianceBuf);
+				clSetKernelArg(cl.kernel_RateFill, 3, sizeof(cl_mem), &cl.pixelGeomBuf);
+				clSetKernelArg(cl.kernel_RateFill, 4, sizeof(cl_mem), &cl.cacheBuf);
+				clSetKernelArg(cl.kernel_RateFill, 5, sizeof(cl_mem), &band.image);
+				clEnqueueNDRangeKernel(cl.queue, cl.kernel_RateFill, 2, fillOffset, fillSize, NULL, 0, NULL, &fill_events[i]);
+			}
+			if (info.antialias == AA_GBUFFER)
+			{
+				//pixels whose first hit differs from a neighbour's into the work
+				//list, then traced again with subpixel rays
+				cl_uint zero = 0;
+				size_t edgeOffset[2] = { 0, band.first };
+				size_t edgeSize[2] = { WIDTH, band.rows };
+				clEnqueueFillBuffer(cl.queue, cl.workCountBuf, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 0, NULL, NULL);
+				clSetKernelArg(cl.kernel_EdgeWorkList, 0, sizeof(Info), &info);
+				clSetKernelArg(cl.kernel_EdgeWorkList, 1, sizeof(cl_mem), &cl.pixelGeomBuf);
+				clSetKernelArg(cl.kernel_EdgeWorkList, 2, sizeof(cl_mem), &cl.workListBuf);
+				clSetKernelArg(cl.kernel_EdgeWorkList, 3, sizeof(cl_mem), &cl.workCountBuf);
+				clSetKernelArg(cl.kernel_EdgeWorkList, 4, sizeof(cl_mem), &cl.rateBuf);
+				clEnqueueNDRangeKernel(cl.queue, cl.kernel_EdgeWorkList, 2, edgeOffset, edgeSize, NULL, 0, NULL, &edge_events[i]);
+
+				Info aa = info;
+				aa.antialias = AA_LIST;
+				aa.traversal = RT_TRAVERSAL_SINGLE;
+				//list pixels are scattered, the shape is tuned apart from the main launch
+				bool trial;
+				TuneShape shape = tuneShape(band, band.aaTuner, std::string(image ? "image" : "buffer") + "/aa_list", cl.DispatchTile(), trial);
+				aaTuning[i] = trial;
+				size_t aaOffset[2] = { 0, 0 };
+				size_t aaSize[2] = { cl.persistentGroups * shape.w, shape.h };
+				size_t aaLocal[2] = { shape.w, shape.h };
+				clSetKernelArg(kernel, 0, sizeof(Info), &aa);
+				clEnqueueFillBuffer(cl.queue, cl.tileCounterBuf, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 0, NULL, NULL);
+				clEnqueueNDRangeKernel(cl.queue, kernel, 2, aaOffset, aaSize, aaLocal, 0, NULL, &aa_events[i]);
+			}
+			if (info.denoise > 0) enqueueDenoise(band, info, denoise_events[i]);
+			if (reproject) std::swap(cl.cacheBuf, cl.prevCacheBuf);
+		}
+		else
+		{	
+			//use common kernel
+			clSetKernelArg(cl.kernel_PathTracing, 0, sizeof(Info), &info);
+			clSetKernelArg(cl.kernel_PathTracing, 1, sizeof(PinholeCamera), &Core.rtCam.camera);
+			clSetKernelArg(cl.kernel_PathTracing, 2, sizeof(cl_mem), &band.image);
+			clSetKernelArg(cl.kernel_PathTracing, 3, sizeof(cl_mem), &cl.triBuf);
+			clSetKernelArg(cl.kernel_PathTracing, 4, sizeof(cl_mem), &cl.sphlBuf);
+			if (tile > 0)
+			{
+				size[0] = (size[0] + tile - 1) / tile * tile;
+				size[1] = (size[1] + tile - 1) / tile * tile;
+			}
 
-	glTexCoord2f(1.0f, 0.0f);
-	glVertex3f(1.0f, 1.0f, 0.1f);
+			//do draw call
+			clEnqueueNDRangeKernel(cl.queue, cl.kernel_PathTracing, 2, offset, size, tile > 0 ? local : NULL, 0, NULL, &execute_events[i]);
+		}
+		//start this device before queueing the next one
+		clFlush(cl.queue);
+	}
 
-	glTexCoord2f(0.0f, 0.0f);
-	glVertex3f(-1.0f, 1.0f, 0.1f);
-	glEnd();
-	glBindTexture(GL_TEXTURE_2D, 0);
+	//kernel time of each device drives the next split
+	for (size_t i = 0; i < Bands.size(); i++)
+	{
+		//fetch path and work-group shape are judged on the main launch alone
+		Bands[i].ms = eventMs(execute_events[i], "kernel", (int)i);
+		if (Core.isTreeBuild && !listPass && !cachePass && !variableRate) timeFetch(Bands[i], usedImage[i]);
+		if (tuning[i]) Bands[i].tuner.Time(Bands[i].ms / std::max(Bands[i].rows, 1u));
+		if (list_events[i] != NULL) Bands[i].ms += eventMs(list_events[i], "work list", (int)i);
+		for (cl_event e : cache_events[i]) Bands[i].ms += eventMs(e, "reproject", (int)i);
+		if (fill_events[i] != NULL) Bands[i].ms += eventMs(fill_events[i], "rate fill", (int)i);
+		if (edge_events[i] != NULL) Bands[i].ms += eventMs(edge_events[i], "edges", (int)i);
+		if (aa_events[i] != NULL)
+		{
+			double aaMs = eventMs(aa_events[i], "antialias", (int)i);
+			if (aaTuning[i])
+			{
+				//the edge list length changes every frame, time per listed pixel
+				cl_uint listed = 0;
+				clEnqueueReadBuffer(Bands[i].ocl->queue, Bands[i].ocl->workCountBuf, CL_TRUE, 0, sizeof(cl_uint), &listed, 0, NULL, NULL);
+				if (listed > 0) Bands[i].aaTuner.Time(aaMs / listed);
+			}
+			Bands[i].ms += aaMs;
+		}
+		for (cl_event e : denoise_events[i]) Bands[i].ms += eventMs(e, "denoise", (int)i);
+		stats.kernelMs = std::max(stats.kernelMs, Bands[i].ms);
+	}
+	Trace().Complete("trace", traceBegin, Trace().NowUs());
 
-	glMatrixMode(GL_MODELVIEW);
-	glPopMatrix();
+	//ray counters of every device, reset for the next frame
+	for (rtBand& band : Bands)
+	{
+		cl_uint traced[4] = { 0, 0, 0, 0 };
+		cl_uint zero = 0;
+		clEnqueueReadBuffer(band.ocl->queue, band.ocl->rayCountBuf, CL_TRUE, 0, sizeof(traced), traced, 0, NULL, NULL);
+		clEnqueueFillBuffer(band.ocl->queue, band.ocl->rayCountBuf, &zero, sizeof(cl_uint), 0, sizeof(traced), 0, NULL, NULL);
+		stats.primaryRays += traced[0];
+		stats.reflectRays += traced[1];
+		stats.refractRays += traced[2];
+		stats.shadowRays += traced[3];
+	}
+	
+	//release frame_texture_img usage permission
+	if (Ocl.glinterop)
+	{
+		clEnqueueReleaseGLObjects(Ocl.queue, 1, &Core.frame_texture_img, 0, 0, &release_event);
+		stats.acquireMs = eventMs(acquire_event, "acquire", 0) + eventMs(release_event, "release", 0);
+	}
 
-	glMatrixMode(GL_PROJECTION);
-	glPopMatrix();
+	//headless, frame stays in the cl images until rtReadPixelsEXT
+	if (outputMode == RT_OUTPUT_WINDOW)
+	{
+		TRACE_SCOPE("present");
+		Timer blit;
+		blit.start();
+		if (!Ocl.glinterop) uploadFrame();
+		drawFrame();
+		stats.blitMs = blit.getElapsedTimeInMilliSec();
+	}
+
+	//adaptive and cache work list frames say nothing of the split, rate map
+	//frames cost the same every frame. rows moved to another device lose
+	//their estimates, so the samples start over
+	bool moved = false;
+	if (!listPass && !cachePass)
+	{
+		std::vector<unsigned> first(Bands.size());
+		for (size_t i = 0; i < Bands.size(); i++) first[i] = Bands[i].first;
+		balanceBands();
+		for (size_t i = 0; i < Bands.size(); i++) moved = moved || Bands[i].first != first[i];
+	}
+	adaptivePass = (adaptive && !moved) ? adaptivePass + 1 : 0;
+	//histories stay on their device, moved rows start new ones
+	for (rtBand& band : Bands) band.history = denoise && !moved;
+	for (rtBand& band : Bands) band.cached = reproject && !moved;
+	denoiseCamera = Core.rtCam.camera;
+	stats.deviceBytes = deviceBytes();
 
 	//clear data
 	Core.triangleData.clear();
 	Core.info.tri_SIZE = 0;
+	endFrameStats();
 }
 
 void rtEnableClientState(GLenum cap)
@@ -721,8 +1660,8 @@ void rtEnableClientState(GLenum cap)
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
 	}
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_ENABLE_CLIENT, cap);
 
 	auto& got = Core.capability.find(cap);
 	if (got != Core.capability.end())
@@ -736,8 +1675,8 @@ void rtDisableClientState(GLenum cap)
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
 	}
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_DISABLE_CLIENT, cap);
 
 	auto& got = Core.capability.find(cap);
 	if (got != Core.capability.end())
@@ -751,8 +1690,11 @@ void rtEnable(GLenum cap)
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
 	}
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_ENABLE, cap);
+
+	SphereLight* light = Core.Light(cap);
+	if (light != NULL) light->enable = true;
 
 	auto& got = Core.capability.find(cap);
 	if (got != Core.capability.end())
@@ -766,8 +1708,11 @@ void rtDisable(GLenum cap)
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
 	}
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_DISABLE, cap);
+
+	SphereLight* light = Core.Light(cap);
+	if (light != NULL) light->enable = false;
 
 	auto& got = Core.capability.find(cap);
 	if (got != Core.capability.end())
@@ -781,7 +1726,11 @@ void rtPerspective(GLdouble fovy, GLdouble aspect, GLdouble zNear, GLdouble zFar
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
+	}
+	if (Capture().Enabled())
+	{
+		double values[4] = { fovy, aspect, zNear, zFar };
+		Capture().Doubles(CAPTURE_PERSPECTIVE, values, 4);
 	}
 
 	Core.rtCam.fovy = fovy;
@@ -797,7 +1746,11 @@ void rtLookAt(GLdouble eyeX, GLdouble eyeY, GLdouble eyeZ,
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
+	}
+	if (Capture().Enabled())
+	{
+		double values[9] = { eyeX, eyeY, eyeZ, centerX, centerY, centerZ, upX, upY, upZ };
+		Capture().Doubles(CAPTURE_LOOK_AT, values, 9);
 	}
 
 	Core.rtCam.eye = glm::vec3(eyeX, eyeY, eyeZ);
@@ -810,19 +1763,21 @@ void rtLightfv(GLenum light, GLenum pname, const GLfloat *params)
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
 	}
+	if (Capture().Enabled()) Capture().Light(light, pname, params);
 
-	unsigned index = light - GL_LIGHT0;
-	if (index < 0 || index > 8) return;
-	auto& pl = Core.pointLight[index];
+	SphereLight* pl = Core.Light(light);
+	if (pl == NULL) return;
 	switch (pname)
 	{
 	case GL_POSITION:
-		pl.ori = glm::vec4(params[0], params[1], params[2], 0);
+		pl->ori = glm::vec4(params[0], params[1], params[2], 0);
 		break;
 	case GL_DIFFUSE:
-		pl.mat.color = glm::vec4(params[0], params[1], params[2], 1);
+		pl->mat.color = glm::vec4(params[0], params[1], params[2], 1);
+		break;
+	case RT_LIGHT_RANGE:
+		pl->range = params[0];
 		break;
 	default:
 		break;
@@ -834,8 +1789,8 @@ void rtMaterialEXT(RTenum type, float RefracIndex/* = 1*/)
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
 	}
+	if (Capture().Enabled()) Capture().Material(type, RefracIndex);
 
 	if(Core.bindVBO != NULL)
 	{
@@ -864,8 +1819,8 @@ void rtBuildKDtreeCurrentSceneEXT()
 	if (isInit == false)
 	{
 		rtInit();
-		Ocl.CheckInit();
 	}
+	if (Capture().Enabled()) Capture().Op(CAPTURE_BUILD_KDTREE);
 
 	if(!Core.isTreeBuild)
 	{
@@ -874,19 +1829,361 @@ void rtBuildKDtreeCurrentSceneEXT()
 		for (int i = 0; i <Core.info.tri_SIZE; i++)
 			triangles.push_back( std::make_shared<Triangle>(Core.triangleData[i]) );
 
+		TRACE_SCOPE("build");
 		Timer buildtree, treeconvert;
 		buildtree.start();
 		pbrt_kdtree = std::make_shared<KdTreeAccel>(triangles);
 		pbrt_kdtree->convertToMyKdFormat(Core.kdnodes, Core.kdtriangles);
+		Core.kdTopNodes = LayoutKDTopLevels(Core.kdnodes);
+		BuildTriBlocks(Core.kdnodes, Core.kdtriangles, Core.triangleData.data(), Core.triBlocks);
+		//an empty tree still needs a buffer
+		if (Core.triBlocks.empty()) Core.triBlocks.resize(1);
 		buildtree.stop();
 
-		printf("tree build: %lf sec", buildtree.getElapsedTimeInSec());
+		Stats.Current().buildMs += buildtree.getElapsedTimeInMilliSec();
 
-		if (Core.node_buf != NULL) clReleaseMemObject(Core.node_buf);
-		Core.node_buf = clCreateBuffer(Ocl.context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, sizeof(KDNode) * Core.kdnodes.size(), Core.kdnodes.data(), NULL);
-		Core.trilist_buf = clCreateBuffer(Ocl.context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, sizeof(int) * Core.kdtriangles.size(), Core.kdtriangles.data(), NULL);
+		//every device gets its own copy, the native tracer reads host memory
+		for (rtBand& band : Bands)
+		{
+			OCLsetting& cl = *band.ocl;
+			if (cl.nodeBuf != NULL) clReleaseMemObject(cl.nodeBuf);
+			if (cl.blockBuf != NULL) clReleaseMemObject(cl.blockBuf);
+			cl.nodeBuf = clCreateBuffer(cl.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(KDNode) * Core.kdnodes.size(), Core.kdnodes.data(), NULL);
+			cl.blockBuf = clCreateBuffer(cl.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(TriBlock) * Core.triBlocks.size(), Core.triBlocks.data(), NULL);
+			//new scene, time both fetch paths again
+			resetFetch(band);
+		}
 		Core.isTreeBuild = true;
+		adaptivePass = 0;
+	}
+
+}
+
+void rtInvalidateKDtreeEXT()
+{
+	if (isInit == false)
+	{
+		rtInit();
 	}
+	if (Capture().Enabled()) Capture().Op(CAPTURE_INVALIDATE_KDTREE);
 
+	//device copies are released by the next build
+	Core.isTreeBuild = false;
 }
 
+void rtReadPixelsEXT(GLenum type, GLvoid* pixels)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (pixels == NULL) return;
+
+	switch (type)
+	{
+	case GL_FLOAT:
+		readFrame((float*)pixels);
+		break;
+	case GL_UNSIGNED_BYTE:
+	{
+		std::vector<float> rgba(WIDTH * HEIGHT * 4);
+		readFrame(rgba.data());
+
+		unsigned char* dst = (unsigned char*)pixels;
+		for (size_t i = 0; i < rgba.size(); i++)
+		{
+			float c = std::min(std::max(rgba[i], 0.0f), 1.0f);
+			dst[i] = (unsigned char)(c * 255.0f + 0.5f);
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+void rtGetFrameStatsEXT(RTframeStats* last, RTframeStats* p50, RTframeStats* p99)
+{
+	Stats.Get(last, p50, p99);
+}
+
+void rtFrameStatsLogEXT(const char* path)
+{
+	Stats.OpenLog(path);
+}
+
+void rtTraceEventsEXT(const char* path)
+{
+	Trace().Open(path);
+}
+
+void rtTuneCacheEXT(const char* path)
+{
+	tuneLaunch = path != NULL;
+	tuneCache = path != NULL ? path : "";
+	//shapes are looked up again on the next frame
+	for (rtBand& band : Bands) band.tuner = band.aaTuner = LaunchTuner();
+}
+
+void rtModelviewEXT(const GLfloat* matrix)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (matrix == NULL) headlessModelview = glm::mat4(1.0f);
+	else headlessModelview = glm::make_mat4(matrix);
+}
+
+//write the state the api holds as calls, for a capture started after rtInit
+static void captureState()
+{
+	CaptureLog& cap = Capture();
+	cap.Ints(CAPTURE_INIT, initDevice, outputMode);
+
+	cap.Ints(CAPTURE_GEN_BUFFERS, (int)Core.glbuffers.size() - 1);
+	GLuint bindVBO = 0, bindIndexVBO = 0;
+	for (size_t i = 0; i < Core.glbuffers.size(); i++)
+	{
+		RawBuffer& rw = Core.glbuffers[i];
+		if (&rw == Core.bindVBO) bindVBO = (GLuint)i;
+		if (&rw == Core.bindIndexVBO) bindIndexVBO = (GLuint)i;
+		if (i == 0) continue;
+
+		cap.Ints(CAPTURE_BIND_BUFFER, GL_ARRAY_BUFFER, (int)i);
+		RTenum type = RT_MAT_DIFFUSE;
+		if (rw.BRDFtype == DIELEC) type = RT_MAT_DIELECTRIC;
+		else if (rw.BRDFtype == MIRR) type = RT_MAT_MIRROR;
+		cap.Material(type, rw.BRDFrIndex);
+		if (rw.size > 0) cap.BufferData(GL_ARRAY_BUFFER, GL_STATIC_DRAW, rw.size, rw.binary);
+	}
+	cap.Ints(CAPTURE_BIND_BUFFER, GL_ARRAY_BUFFER, bindVBO);
+	cap.Ints(CAPTURE_BIND_BUFFER, GL_ELEMENT_ARRAY_BUFFER, bindIndexVBO);
+
+	const RTPointer& v = Core.vptr;
+	const RTPointer& c = Core.cptr;
+	const RTPointer& n = Core.nptr;
+	if (v.type != 0) cap.Pointer(CAPTURE_VERTEX_POINTER, v.size, v.type, v.stride, (uint64_t)(size_t)v.pointer);
+	if (c.type != 0) cap.Pointer(CAPTURE_COLOR_POINTER, c.size, c.type, c.stride, (uint64_t)(size_t)c.pointer);
+	if (n.type != 0) cap.Pointer(CAPTURE_NORMAL_POINTER, n.size, n.type, n.stride, (uint64_t)(size_t)n.pointer);
+
+	//client states and caps share the table, rtEnable sets either
+	for (auto& cp : Core.capability)
+		cap.Ints(cp.second ? CAPTURE_ENABLE : CAPTURE_DISABLE, cp.first);
+
+	const RTCamera& cam = Core.rtCam;
+	double perspective[4] = { cam.fovy, cam.aspect, cam.zNear, cam.zFar };
+	double lookAt[9] = { cam.eye.x, cam.eye.y, cam.eye.z, cam.center.x, cam.center.y, cam.center.z, cam.up.x, cam.up.y, cam.up.z };
+	cap.Doubles(CAPTURE_PERSPECTIVE, perspective, 4);
+	cap.Doubles(CAPTURE_LOOK_AT, lookAt, 9);
+
+	for (size_t i = 0; i < Core.pointLight.size(); i++)
+	{
+		const SphereLight& pl = Core.pointLight[i];
+		GLenum light = GL_LIGHT0 + (GLenum)i;
+		cap.Light(light, GL_POSITION, &pl.ori.x);
+		cap.Light(light, GL_DIFFUSE, &pl.mat.color.x);
+		cap.Light(light, RT_LIGHT_RANGE, &pl.range);
+		cap.Ints(pl.enable ? CAPTURE_ENABLE : CAPTURE_DISABLE, light);
+	}
+
+	cap.Modelview(glm::value_ptr(headlessModelview));
+	cap.Ints(CAPTURE_DISPATCH, Core.info.dispatch);
+	cap.Ints(CAPTURE_TRAVERSAL, Core.info.traversal);
+	cap.Ints(CAPTURE_FETCH, fetchMode);
+	cap.Ints(CAPTURE_SCHEDULE, Core.info.schedule);
+	cap.Ints(CAPTURE_LIGHT_SAMPLING, Core.info.lightSampling, Core.info.shadowRays);
+	double adaptiveValues[2] = { Core.info.threshold, (double)Core.info.maxSamples };
+	cap.Doubles(CAPTURE_ADAPTIVE, adaptiveValues, 2);
+	cap.Ints(CAPTURE_ANTIALIAS, Core.info.aaSamples);
+	cap.Ints(CAPTURE_SAMPLER, Core.info.sampler);
+	cap.Ints(CAPTURE_DENOISE, Core.info.denoise);
+	double refresh = Core.info.refresh;
+	cap.Doubles(CAPTURE_REPROJECTION, &refresh, 1);
+	double terminationValues[2] = { Core.info.cutoff, (double)Core.info.rayBudget };
+	cap.Doubles(CAPTURE_PATH_TERMINATION, terminationValues, 2);
+	double foveaValues[3] = { fovea.x, fovea.y, fovea.z };
+	cap.Doubles(CAPTURE_FOVEATION, foveaValues, 3);
+	if (!appRates.empty()) cap.RateMap(appRatesWidth, appRatesHeight, appRates.data());
+	captureTreePending = Core.isTreeBuild;
+}
+
+void rtCaptureEXT(const char* path)
+{
+	if (!Capture().Open(path) || path == NULL) return;
+
+	//started after rtInit, replay needs what came before
+	if (isInit) captureState();
+}
+
+void rtDispatchEXT(RTdispatch mode)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_DISPATCH, mode);
+	Core.info.dispatch = mode;
+}
+
+void rtTraversalEXT(RTtraversal mode)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_TRAVERSAL, mode);
+	Core.info.traversal = mode;
+}
+
+void rtScheduleEXT(RTschedule mode)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_SCHEDULE, mode);
+	Core.info.schedule = mode;
+}
+
+void rtLightSamplingEXT(RTlightSampling mode, int shadowRays /*= 1*/)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_LIGHT_SAMPLING, mode, shadowRays);
+	Core.info.lightSampling = mode;
+	Core.info.shadowRays = std::max(shadowRays, 1);
+}
+
+void rtAdaptiveSamplingEXT(float threshold, int maxSamples /*= 64*/)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (Capture().Enabled())
+	{
+		double values[2] = { threshold, (double)maxSamples };
+		Capture().Doubles(CAPTURE_ADAPTIVE, values, 2);
+	}
+	Core.info.threshold = std::max(threshold, 0.0f);
+	Core.info.maxSamples = std::max(maxSamples, ADAPTIVE_MIN_SAMPLES);
+}
+
+void rtAntialiasEXT(int samples)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_ANTIALIAS, samples);
+	Core.info.aaSamples = std::max(samples, 0);
+}
+
+void rtSamplerEXT(RTsampler mode)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_SAMPLER, mode);
+	Core.info.sampler = mode;
+}
+
+void rtDenoiseEXT(int passes)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_DENOISE, passes);
+	Core.info.denoise = std::min(std::max(passes, 0), DENOISE_MAX_PASSES);
+}
+
+void rtReprojectionEXT(float refresh)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (Capture().Enabled())
+	{
+		double value = refresh;
+		Capture().Doubles(CAPTURE_REPROJECTION, &value, 1);
+	}
+	Core.info.refresh = std::min(std::max(refresh, 0.0f), 1.0f);
+}
+
+void rtPathTerminationEXT(float cutoff, int rayBudget /*= 0*/)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (Capture().Enabled())
+	{
+		double values[2] = { cutoff, (double)rayBudget };
+		Capture().Doubles(CAPTURE_PATH_TERMINATION, values, 2);
+	}
+	Core.info.cutoff = std::max(cutoff, 0.0f);
+	Core.info.rayBudget = std::max(rayBudget, 0);
+}
+
+void rtFoveationEXT(float x, float y, float radius)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (Capture().Enabled())
+	{
+		double values[3] = { x, y, radius };
+		Capture().Doubles(CAPTURE_FOVEATION, values, 3);
+	}
+	fovea = glm::vec3(x, y, std::max(radius, 0.0f));
+}
+
+void rtRateMapEXT(const unsigned char* rates, int width, int height)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (rates == NULL || width <= 0 || height <= 0)
+	{
+		rates = NULL;
+		width = height = 0;
+	}
+	if (Capture().Enabled()) Capture().RateMap(width, height, rates);
+	appRates.assign(rates, rates + width * height);
+	appRatesWidth = width;
+	appRatesHeight = height;
+}
+
+void rtFetchEXT(RTfetch mode)
+{
+	if (isInit == false)
+	{
+		rtInit();
+	}
+
+	if (Capture().Enabled()) Capture().Ints(CAPTURE_FETCH, mode);
+	fetchMode = mode;
+	for (rtBand& band : Bands) resetFetch(band);
+}
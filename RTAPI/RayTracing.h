@@ -5,7 +5,13 @@
 #include <gl\glew.h>
 #include <gl\GL.h>
 
-void rtInit();
+#include "RTtypes.h"
+
+/*
+// false when no device of the policy came up (the reason is printed).
+// later calls return the same, rtFlush then draws nothing
+*/
+bool rtInit(RTdevice device = RT_DEVICE_GPU, RToutput output = RT_OUTPUT_WINDOW);
 
 void rtFlush();
 void rtGenBuffers(GLsizei n, GLuint* buffers);
@@ -26,17 +32,146 @@ void rtLookAt(GLdouble eyeX, GLdouble eyeY, GLdouble eyeZ,
 				GLdouble centerX, GLdouble centerY, GLdouble centerZ,
 				GLdouble upX, GLdouble upY, GLdouble upZ);
 
+/*
+// lights are GL_LIGHT0 + i for any i below RT_MAX_LIGHTS, rtEnable turns
+// each on. pname RT_LIGHT_RANGE sets the distance past which a light does
+// not shade from params[0], unlimited by default
+*/
 void rtLightfv(GLenum light, GLenum pname, const GLfloat *params);
 
+void rtMaterialEXT(RTenum type, float RefracIndex = 1);
+void rtBuildKDtreeCurrentSceneEXT();
+/*
+// drop the kd-tree, the next rtBuildKDtreeCurrentSceneEXT builds the
+// scene drawn since the last flush
+*/
+void rtInvalidateKDtreeEXT();
+/*
+// pixel order of the opencl work-items, RT_DISPATCH_MORTON by default.
+// devices too small for square work-groups keep scanline order
+*/
+void rtDispatchEXT(RTdispatch mode);
+/*
+// primary ray traversal, RT_TRAVERSAL_PACKET by default.
+// packets need square work-groups, scanline dispatch traverses single rays
+*/
+void rtTraversalEXT(RTtraversal mode);
+/*
+// work-group scheduling, RT_SCHEDULE_NDRANGE by default.
+// persistent work-groups need square tiles, scanline dispatch keeps ndrange
+*/
+void rtScheduleEXT(RTschedule mode);
+/*
+// shadow rays of a hit, RT_LIGHTS_ALL by default. shadowRays is the
+// number of lights sampled per hit with RT_LIGHTS_SAMPLED
+*/
+void rtLightSamplingEXT(RTlightSampling mode, int shadowRays = 1);
+/*
+// adaptive sampling on opencl devices, off (threshold 0) by default. while
+// the camera, scene and lights stay the same every frame adds a jittered
+// sample to the pixels whose mean luminance still has a relative standard
+// error above threshold, until they have maxSamples. the frame shows the
+// mean of each pixel's samples
+*/
+void rtAdaptiveSamplingEXT(float threshold, int maxSamples = 64);
+/*
+// anti-aliasing on opencl devices, off (0 samples) by default. pixels whose
+// first hit differs from a neighbour's in primitive, normal or depth are
+// traced again with samples jittered rays. ignored while adaptive sampling
+// is on, its samples are jittered already
+*/
+void rtAntialiasEXT(int samples);
+/*
+// sample sequence of subpixel jitter and light picks, RT_SAMPLER_SOBOL by
+// default. frames without jitter or sampled lights do not use it
+*/
+void rtSamplerEXT(RTsampler mode);
+/*
+// denoiser on opencl devices, off (0 passes) by default. each frame is
+// blended into a history of the surfaces seen the frame before, then
+// filtered by passes (at most 8) edge-aware a-trous passes guided by the
+// first hit's normal, depth and color. ignored while adaptive sampling is on
+*/
+void rtDenoiseEXT(int passes);
+/*
+// reprojection cache on opencl devices, off (refresh 1) by default. the
+// first hits of a frame are kept and moved to the pixels they fall on in
+// the next view, which traces only the pixels left without one, those seen
+// through a gap of nearer ones, those cached for 32 frames and a random
+// refresh share of the rest. ignored while adaptive sampling is on
+*/
+void rtReprojectionEXT(float refresh);
+/*
+// variable-rate tracing on opencl devices, off (radius 0) by default. the
+// frame is cut in 16x16 pixel tiles: tiles within radius of the fovea
+// (x, y) trace every pixel, those within twice radius one pixel per 2x2
+// block and the rest one per 4x4 block, with half and a quarter of the
+// bounce depth. the other pixels of a block take its color. x is a fraction
+// of the frame width and y of its height from the top left, radius one of
+// its height. ignored while adaptive sampling is on
+*/
+void rtFoveationEXT(float x, float y, float radius);
+/*
+// reflection and refraction paths end once their weight (times 0.8 per
+// mirror bounce and dielectric pass) is below cutoff, 0 by default keeps
+// them to the depth limit. frames of adaptive sampling keep such a path at
+// odds weight / cutoff instead and scale it up by as much, so their mean is
+// unbiased. rayBudget caps the reflection and refraction rays of a pixel,
+// 0 is no limit
+*/
+void rtPathTerminationEXT(float cutoff, int rayBudget = 0);
+/*
+// rate map of the next frames in place of the radial one: width x height
+// rates, top row first, stretched over the tiles of the frame. rate 0
+// traces every pixel, 1 one per 2x2 block, 2 one per 4x4 block. NULL goes
+// back to rtFoveationEXT
+*/
+void rtRateMapEXT(const unsigned char* rates, int width, int height);
+/*
+// kd-tree data fetch path, RT_FETCH_AUTO by default.
+// devices without image1d_buffer support always read buffers
+*/
+void rtFetchEXT(RTfetch mode);
 
 /*
-//four tpye: emissive, diffuse, dielectic, mirror,
-// only dielectic type must provide a refractive index
+// copy the last flushed frame to caller memory, RGBA top row first
+// type is GL_FLOAT or GL_UNSIGNED_BYTE
 */
-typedef enum { RT_MAT_DIFFUSE, RT_MAT_DIELECTRIC, RT_MAT_MIRROR } RTenum;
+void rtReadPixelsEXT(GLenum type, GLvoid* pixels);
 
-void rtMaterialEXT(RTenum type, float RefracIndex = 1);
-void rtBuildKDtreeCurrentSceneEXT();
+/*
+// stats of the last flushed frame, p50 / p99 of every field over the
+// last 256 frames. any pointer may be NULL
+*/
+void rtGetFrameStatsEXT(RTframeStats* last, RTframeStats* p50 = NULL, RTframeStats* p99 = NULL);
+/*
+// append every frame's stats to a csv file, NULL stops logging
+*/
+void rtFrameStatsLogEXT(const char* path);
+/*
+// record ingest / upload / build / trace / present scopes and the opencl
+// commands of every device as chrome trace-event json. the file is written
+// when called again (NULL stops) or at exit
+*/
+void rtTraceEventsEXT(const char* path);
+/*
+// modelview applied by rtDrawArrays in headless mode, 16 floats column
+// major, NULL resets to identity. window mode reads GL_MODELVIEW_MATRIX
+*/
+void rtModelviewEXT(const GLfloat* matrix);
+/*
+// serialize every rt* call with buffer contents to path for bench/rtreplay,
+// NULL stops. started after rtInit it first writes the current state.
+// the RTAPI_CAPTURE environment variable captures from rtInit on
+*/
+void rtCaptureEXT(const char* path);
+/*
+// file that keeps tuned work-group shapes across runs, none by default or
+// the RTAPI_TUNE_CACHE environment variable. shapes missing from it are
+// timed for a few frames on each device. "" tunes without a file, NULL
+// stops tuning, square tiles are used
+*/
+void rtTuneCacheEXT(const char* path);
 
 #define glGenBuffers rtGenBuffers
 #define glBindBuffer rtBindBuffer
@@ -0,0 +1,231 @@
+#include "Sampler.h"
+
+#include <cmath>
+#include <algorithm>
+#include <random>
+
+//void-and-cluster energy filter and the share of the initial pattern
+#define BLUE_NOISE_SIGMA 1.5f
+#define BLUE_NOISE_SEED 0.1f
+
+//strata of a stratified dimension, a 4x4 grid for a pair
+#define STRATA 16
+
+//r2 steps and the golden ratio as 32 bit fractions
+#define R2_X 3242174889u
+#define R2_Y 2447445413u
+#define GOLDEN 2654435769u
+
+//integer hash, good enough to decorrelate pixels
+static uint32_t hash(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+static float unitFloat(uint32_t x)
+{
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+static uint32_t reverseBits(uint32_t x)
+{
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+	x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+	x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+	x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+	return x;
+}
+
+//every other bit of v, from bit 0
+static uint32_t compactBits(uint32_t v)
+{
+	v &= 0x55555555;
+	v = (v | (v >> 1)) & 0x33333333;
+	v = (v | (v >> 2)) & 0x0f0f0f0f;
+	v = (v | (v >> 4)) & 0x00ff00ff;
+	v = (v | (v >> 8)) & 0x0000ffff;
+	return v;
+}
+
+//owen scrambling of the bits of x, the hash of laine and karras
+static uint32_t owenScramble(uint32_t x, uint32_t seed)
+{
+	x = reverseBits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverseBits(x);
+}
+
+//second sobol dimension, the first is reverseBits
+static uint32_t sobol1(uint32_t index)
+{
+	uint32_t x = 0;
+	for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+		if (index & 1) x ^= v;
+	return x;
+}
+
+//adds (sign 1) or takes away (-1) the toroidal gaussian around point p
+static void addEnergy(std::vector<float>& energy, const std::vector<float>& filter, int p, float sign)
+{
+	int px = p % BLUE_NOISE_SIZE, py = p / BLUE_NOISE_SIZE;
+	for (int y = 0; y < BLUE_NOISE_SIZE; y++)
+	{
+		int dy = (y - py + BLUE_NOISE_SIZE) % BLUE_NOISE_SIZE;
+		for (int x = 0; x < BLUE_NOISE_SIZE; x++)
+		{
+			int dx = (x - px + BLUE_NOISE_SIZE) % BLUE_NOISE_SIZE;
+			energy[y * BLUE_NOISE_SIZE + x] += sign * filter[dy * BLUE_NOISE_SIZE + dx];
+		}
+	}
+}
+
+//tightest cluster of the ones, or largest void of the zeros
+static int extreme(const std::vector<float>& energy, const std::vector<char>& pattern, char ones)
+{
+	int best = -1;
+	for (int i = 0; i < (int)energy.size(); i++)
+	{
+		if (pattern[i] != ones) continue;
+		if (best < 0 || (ones ? energy[i] > energy[best] : energy[i] < energy[best])) best = i;
+	}
+	return best;
+}
+
+static std::vector<uint32_t> buildBlueNoise()
+{
+	const int n = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+	std::vector<float> filter(n);
+	for (int y = 0; y < BLUE_NOISE_SIZE; y++)
+	{
+		for (int x = 0; x < BLUE_NOISE_SIZE; x++)
+		{
+			float dx = (float)std::min(x, BLUE_NOISE_SIZE - x);
+			float dy = (float)std::min(y, BLUE_NOISE_SIZE - y);
+			filter[y * BLUE_NOISE_SIZE + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA));
+		}
+	}
+
+	//random initial pattern, relaxed by moving its tightest cluster to
+	//its largest void until that is the same pixel, or a cycle runs long
+	std::vector<char> pattern(n, 0);
+	std::vector<float> energy(n, 0.0f);
+	std::mt19937 rng(1);
+	int ones = 0;
+	while (ones < (int)(n * BLUE_NOISE_SEED))
+	{
+		int p = (int)(rng() % n);
+		if (pattern[p]) continue;
+		pattern[p] = 1;
+		addEnergy(energy, filter, p, 1.0f);
+		ones++;
+	}
+	for (int i = 0; i < n; i++)
+	{
+		int cluster = extreme(energy, pattern, 1);
+		pattern[cluster] = 0;
+		addEnergy(energy, filter, cluster, -1.0f);
+		int hole = extreme(energy, pattern, 0);
+		pattern[hole] = 1;
+		addEnergy(energy, filter, hole, 1.0f);
+		if (hole == cluster) break;
+	}
+
+	//ranks below the initial pattern by removing clusters, above it by
+	//filling voids
+	std::vector<uint32_t> rank(n, 0);
+	std::vector<char> removing = pattern;
+	std::vector<float> removingEnergy = energy;
+	for (int r = ones - 1; r >= 0; r--)
+	{
+		int cluster = extreme(removingEnergy, removing, 1);
+		removing[cluster] = 0;
+		addEnergy(removingEnergy, filter, cluster, -1.0f);
+		rank[cluster] = (uint32_t)r;
+	}
+	for (int r = ones; r < n; r++)
+	{
+		int hole = extreme(energy, pattern, 0);
+		pattern[hole] = 1;
+		addEnergy(energy, filter, hole, 1.0f);
+		rank[hole] = (uint32_t)r;
+	}
+	return rank;
+}
+
+const std::vector<uint32_t>& BlueNoiseMask()
+{
+	static const std::vector<uint32_t> mask = buildBlueNoise();
+	return mask;
+}
+
+Sampler MakeSampler(RTsampler kind, uint32_t x, uint32_t y, uint32_t width, uint32_t index)
+{
+	Sampler s;
+	s.kind = kind;
+	s.x = x;
+	s.y = y;
+	s.index = index;
+	s.dim = 0;
+	s.scramble = hash(x + width * y);
+	return s;
+}
+
+glm::vec2 Sample2D(Sampler& s)
+{
+	uint32_t dimSeed = hash(s.dim++ * GOLDEN + 1);
+	uint32_t seed = hash(s.scramble ^ dimSeed);
+	switch (s.kind)
+	{
+	case RT_SAMPLER_STRATIFIED:
+	{
+		//cells of every STRATA samples in bit reversed z-order, quadrants
+		//fill first. a shuffle per run of STRATA keeps them stratified
+		uint32_t shuffle = hash(seed ^ (s.index / STRATA));
+		uint32_t cell = (reverseBits(s.index % STRATA) >> 28) ^ (shuffle % STRATA);
+		uint32_t r = hash(shuffle ^ hash(s.index));
+		return (glm::vec2((float)compactBits(cell), (float)compactBits(cell >> 1)) + glm::vec2(unitFloat(r), unitFloat(hash(r)))) * 0.25f;
+	}
+	case RT_SAMPLER_SOBOL:
+	{
+		//shuffled and scrambled per pixel and dimension pair
+		uint32_t i = owenScramble(s.index, seed);
+		uint32_t a = hash(seed);
+		uint32_t b = hash(a);
+		return glm::vec2(unitFloat(owenScramble(reverseBits(i), a)), unitFloat(owenScramble(sobol1(i), b)));
+	}
+	case RT_SAMPLER_R2:
+	{
+		uint32_t r = hash(seed);
+		return glm::vec2(unitFloat(seed + s.index * R2_X), unitFloat(r + s.index * R2_Y));
+	}
+	case RT_SAMPLER_BLUE_NOISE:
+	{
+		//the mask shifted per dimension pair, stepped by r2 per sample
+		const std::vector<uint32_t>& mask = BlueNoiseMask();
+		uint32_t other = hash(dimSeed);
+		uint32_t u = mask[((s.y + (dimSeed >> 8)) % BLUE_NOISE_SIZE) * BLUE_NOISE_SIZE + (s.x + dimSeed) % BLUE_NOISE_SIZE];
+		uint32_t v = mask[((s.y + (other >> 8)) % BLUE_NOISE_SIZE) * BLUE_NOISE_SIZE + (s.x + other) % BLUE_NOISE_SIZE];
+		return glm::vec2(unitFloat(u * BLUE_NOISE_STEP + s.index * R2_X), unitFloat(v * BLUE_NOISE_STEP + s.index * R2_Y));
+	}
+	default:
+	{
+		uint32_t r = hash(seed ^ hash(s.index));
+		return glm::vec2(unitFloat(r), unitFloat(hash(r)));
+	}
+	}
+}
+
+float Sample1D(Sampler& s)
+{
+	return Sample2D(s).x;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "RTstruct.h"
+#include "RTtypes.h"
+
+#include <vector>
+#include <cstdint>
+
+//------ sample sequences
+// the sampling module of RayTracing.cl for the native tracer. a sampler
+// walks the dimensions of one sample of a pixel, every call takes the next
+// pair: subpixel jitter first, then one light pick per shaded hit.
+// sequences are indexed by pixel and sample, the same numbers as the kernel
+
+//BLUE_NOISE_SIZE squared ranks of a void-and-cluster blue noise mask,
+//built on first use
+const std::vector<uint32_t>& BlueNoiseMask();
+
+struct Sampler
+{
+	RTsampler kind;
+	uint32_t x, y;        //pixel
+	uint32_t index;       //sample of the pixel
+	uint32_t dim;         //next dimension pair
+	uint32_t scramble;    //per pixel
+};
+
+Sampler MakeSampler(RTsampler kind, uint32_t x, uint32_t y, uint32_t width, uint32_t index);
+//next dimension pair in [0, 1)
+glm::vec2 Sample2D(Sampler& s);
+//first of the next pair
+float Sample1D(Sampler& s);
@@ -8,30 +8,20 @@
 //  AUTHOR: Song Ho Ahn (song.ahn@gmail.com)
 // CREATED: 2003-01-13
 // UPDATED: 2006-01-13
+// std::chrono steady_clock instead of QueryPerformanceCounter / gettimeofday
 //
 // Copyright (c) 2003 Song Ho Ahn
 //////////////////////////////////////////////////////////////////////////////
 
 #include "Timer.h"
-#include <stdlib.h>
 
 ///////////////////////////////////////////////////////////////////////////////
 // constructor
 ///////////////////////////////////////////////////////////////////////////////
 Timer::Timer()
 {
-#ifdef WIN32
-    QueryPerformanceFrequency(&frequency);
-    startCount.QuadPart = 0;
-    endCount.QuadPart = 0;
-#else
-    startCount.tv_sec = startCount.tv_usec = 0;
-    endCount.tv_sec = endCount.tv_usec = 0;
-#endif
-
     stopped = 0;
-    startTimeInMicroSec = 0;
-    endTimeInMicroSec = 0;
+    startCount = endCount = Clock::now();
 }
 
 
@@ -52,11 +42,7 @@ Timer::~Timer()
 void Timer::start()
 {
     stopped = 0; // reset stop flag
-#ifdef WIN32
-    QueryPerformanceCounter(&startCount);
-#else
-    gettimeofday(&startCount, NULL);
-#endif
+    startCount = Clock::now();
 }
 
 
@@ -68,12 +54,7 @@ void Timer::start()
 void Timer::stop()
 {
     stopped = 1; // set timer stopped flag
-
-#ifdef WIN32
-    QueryPerformanceCounter(&endCount);
-#else
-    gettimeofday(&endCount, NULL);
-#endif
+    endCount = Clock::now();
 }
 
 
@@ -84,21 +65,10 @@ void Timer::stop()
 ///////////////////////////////////////////////////////////////////////////////
 double Timer::getElapsedTimeInMicroSec()
 {
-#ifdef WIN32
     if(!stopped)
-        QueryPerformanceCounter(&endCount);
-
-    startTimeInMicroSec = startCount.QuadPart * (1000000.0 / frequency.QuadPart);
-    endTimeInMicroSec = endCount.QuadPart * (1000000.0 / frequency.QuadPart);
-#else
-    if(!stopped)
-        gettimeofday(&endCount, NULL);
-
-    startTimeInMicroSec = (startCount.tv_sec * 1000000.0) + startCount.tv_usec;
-    endTimeInMicroSec = (endCount.tv_sec * 1000000.0) + endCount.tv_usec;
-#endif
+        endCount = Clock::now();
 
-    return endTimeInMicroSec - startTimeInMicroSec;
+    return std::chrono::duration<double, std::micro>(endCount - startCount).count();
 }
 
 
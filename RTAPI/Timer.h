@@ -8,6 +8,7 @@
 //  AUTHOR: Song Ho Ahn (song.ahn@gmail.com)
 // CREATED: 2003-01-13
 // UPDATED: 2006-01-13
+// std::chrono steady_clock instead of QueryPerformanceCounter / gettimeofday
 //
 // Copyright (c) 2003 Song Ho Ahn
 //////////////////////////////////////////////////////////////////////////////
@@ -15,13 +16,7 @@
 #ifndef TIMER_H_DEF
 #define TIMER_H_DEF
 
-#define WIN32
-
-#ifdef WIN32   // Windows system specific
-#include <windows.h>
-#else          // Unix based system specific
-#include <sys/time.h>
-#endif
+#include <chrono>
 
 
 class Timer
@@ -42,17 +37,11 @@ protected:
 
 
 private:
-    double startTimeInMicroSec;                 // starting time in micro-second
-    double endTimeInMicroSec;                   // ending time in micro-second
+    typedef std::chrono::steady_clock Clock;
+
     int    stopped;                             // stop flag 
-#ifdef WIN32
-    LARGE_INTEGER frequency;                    // ticks per second
-    LARGE_INTEGER startCount;                   //
-    LARGE_INTEGER endCount;                     //
-#else
-    timeval startCount;                         //
-    timeval endCount;                           //
-#endif
+    Clock::time_point startCount;               //
+    Clock::time_point endCount;                 //
 };
 
 #endif // TIMER_H_DEF
@@ -0,0 +1,102 @@
+#include "TraceEvent.h"
+
+#include <cstdio>
+
+//stop recording past this, about 40 MB of events
+#define MAX_TRACE_EVENTS 1000000
+
+TraceLog& Trace()
+{
+	static TraceLog log;
+	return log;
+}
+
+TraceLog::TraceLog()
+	:enabled(false), epoch(std::chrono::steady_clock::now())
+{
+}
+
+TraceLog::~TraceLog()
+{
+	if (enabled) Write();
+}
+
+void TraceLog::Open(const char* path)
+{
+	if (enabled) Write();
+	enabled = false;
+	events.clear();
+	if (path == NULL) return;
+
+	this->path = path;
+	enabled = true;
+}
+
+double TraceLog::NowUs() const
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void TraceLog::Complete(const char* name, double beginUs, double endUs, int pid /* = 0 */)
+{
+	if (!enabled || events.size() >= MAX_TRACE_EVENTS) return;
+
+	Event e = { name, beginUs, endUs - beginUs, pid };
+	events.push_back(e);
+}
+
+void TraceLog::SyncDevice(cl_command_queue queue, int device, const char* deviceName)
+{
+	if (!enabled) return;
+	if (deviceOffsetUs.size() <= (size_t)device)
+	{
+		deviceOffsetUs.resize(device + 1, 0.0);
+		deviceNames.resize(device + 1);
+	}
+	deviceNames[device] = deviceName;
+
+	//the marker completes between the two host reads, take the midpoint
+	cl_event marker;
+	double before = NowUs();
+	clEnqueueMarkerWithWaitList(queue, 0, NULL, &marker);
+	clWaitForEvents(1, &marker);
+	double after = NowUs();
+
+	cl_ulong end = 0;
+	clGetEventProfilingInfo(marker, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+	clReleaseEvent(marker);
+	deviceOffsetUs[device] = 0.5 * (before + after) - end * 1e-3;
+}
+
+void TraceLog::Device(const char* name, cl_event e, int device)
+{
+	if (!enabled || (size_t)device >= deviceOffsetUs.size()) return;
+
+	cl_ulong start = 0, end = 0;
+	clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+	clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+
+	double offset = deviceOffsetUs[device];
+	Complete(name, start * 1e-3 + offset, end * 1e-3 + offset, device + 1);
+}
+
+void TraceLog::Write()
+{
+	FILE* f = fopen(path.c_str(), "w");
+	if (f == NULL)
+	{
+		printf("can not open trace file %s\n", path.c_str());
+		return;
+	}
+
+	fprintf(f, "{\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"host\"}}");
+	for (size_t i = 0; i < deviceNames.size(); i++)
+		fprintf(f, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}", (int)i + 1, deviceNames[i].c_str());
+
+	for (const Event& e : events)
+		fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":0}", e.name, e.ts, e.dur, e.pid);
+
+	fprintf(f, "\n]}\n");
+	fclose(f);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <CL\cl.h>
+
+//------ trace events
+// records host scopes and profiled opencl commands as chrome trace-event
+// json (chrome://tracing, perfetto). device timestamps are moved onto the
+// host clock with a marker per device, so cpu / gpu overlap lines up.
+// host scopes are pid 0, opencl device i is pid i + 1.
+class TraceLog
+{
+public:
+
+	TraceLog();
+	~TraceLog();
+
+	//start recording into path, NULL writes the file and stops
+	void Open(const char* path);
+	bool Enabled() const { return enabled; }
+
+	//microseconds on the host trace clock
+	double NowUs() const;
+
+	void Complete(const char* name, double beginUs, double endUs, int pid = 0);
+
+	//measure the device clock offset of a queue, call before Device events
+	void SyncDevice(cl_command_queue queue, int device, const char* deviceName);
+	//a profiled command of that device, the event is not released
+	void Device(const char* name, cl_event e, int device);
+
+private:
+
+	struct Event
+	{
+		const char* name;
+		double ts, dur;
+		int pid;
+	};
+
+	void Write();
+
+	bool enabled;
+	std::string path;
+	std::chrono::steady_clock::time_point epoch;
+	std::vector<Event> events;
+	std::vector<double> deviceOffsetUs;          //host us - device us
+	std::vector<std::string> deviceNames;
+};
+
+//one trace log in program
+TraceLog& Trace();
+
+//host scope, recorded on destruction
+class TraceScope
+{
+public:
+	TraceScope(const char* name) :name(name), beginUs(Trace().Enabled() ? Trace().NowUs() : 0.0) {}
+	~TraceScope() { if (Trace().Enabled()) Trace().Complete(name, beginUs, Trace().NowUs()); }
+
+private:
+	const char* name;
+	double beginUs;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
@@ -239,7 +239,11 @@ int main(int argc, char** argv)
 #pragma region Ray Tracing INIT
 #ifdef RAYTRACING
 	//RT library init
-	rtInit();
+	if (!rtInit())
+	{
+		printf("no opencl device for the ray tracer\n");
+		return 1;
+	}
 #endif
 #pragma endregion
 
@@ -50,8 +50,10 @@
 // accelerators/kdtreeaccel.cpp*
 
 #include "kdtreeaccel.h"
+#include "../Timer.h"
 #include <algorithm>
 #include <memory>
+#include <cstring>
 
 #define Infinity std::numeric_limits<float>::infinity()
 
@@ -146,11 +148,16 @@ KdTreeAccel::KdTreeAccel(const std::vector<std::shared_ptr<Triangle>> &p,
       emptyBonus(emptyBonus),
       Triangles(p) {
     // Build kd-tree for accelerator
+    memset(&stats, 0, sizeof(stats));
+    Timer total, phase;
+    total.start();
+    nodes = nullptr;
     nextFreeNode = nAllocedNodes = 0;
     if (maxDepth <= 0)
         maxDepth = std::round(8 + 1.3f * Log2Int(Triangles.size()));
 
     // Compute bounds for kd-tree construction
+    phase.start();
     std::vector<Bounds3f> primBounds;
     primBounds.reserve(Triangles.size());
     for (const std::shared_ptr<Triangle> &prim : Triangles) {
@@ -163,6 +170,7 @@ KdTreeAccel::KdTreeAccel(const std::vector<std::shared_ptr<Triangle>> &p,
         bounds = Union(bounds, b);
         primBounds.push_back(b);
     }
+    stats.boundsMs = phase.getElapsedTimeInMilliSec();
 
     // Allocate working memory for kd-tree construction
     std::unique_ptr<BoundEdge[]> edges[3];
@@ -178,21 +186,24 @@ KdTreeAccel::KdTreeAccel(const std::vector<std::shared_ptr<Triangle>> &p,
     // Start recursive construction of kd-tree
     buildTree(0, bounds, primBounds, primNums.get(), Triangles.size(),
               maxDepth, edges, prims0.get(), prims1.get());
+
+    // Working memory still alive, prims1 dominates for deep trees
+    size_t N = Triangles.size();
+    stats.prims1Bytes = sizeof(int) * (maxDepth + 1) * N;
+    stats.scratchBytes = 3 * 2 * N * sizeof(BoundEdge) + 2 * N * sizeof(int) + stats.prims1Bytes +
+        primBounds.capacity() * sizeof(Bounds3f) + nAllocedNodes * sizeof(KdAccelNode) +
+        TriangleIndices.capacity() * sizeof(int);
+    stats.totalMs = total.getElapsedTimeInMilliSec();
 }
 
 void KdAccelNode::InitLeaf(int *primNums, int np,
                            std::vector<int> *TriangleIndices) {
     flags = 3;
     nPrims |= (np << 2);
-    // Store Triangle ids for leaf node
-    if (np == 0)
-        oneTriangle = 0;
-    else if (np == 1)
-        oneTriangle = primNums[0];
-    else {
-        TriangleIndicesOffset = TriangleIndices->size();
-        for (int i = 0; i < np; ++i) TriangleIndices->push_back(primNums[i]);
-    }
+    // Store Triangle ids for leaf node, single triangle leaves too: the
+    // converted KDNode always reads [offset, offset + np) of TriangleIndices
+    TriangleIndicesOffset = TriangleIndices->size();
+    for (int i = 0; i < np; ++i) TriangleIndices->push_back(primNums[i]);
 }
 
 KdTreeAccel::~KdTreeAccel() { FreeAligned(nodes); }
@@ -217,8 +228,11 @@ void KdTreeAccel::buildTree(int nodeNum, const Bounds3f &nodeBounds,
     ++nextFreeNode;
 
     // Initialize leaf node if termination criteria met
+    Timer phase;
     if (nTriangles <= maxPrims || depth == 0) {
+        phase.start();
         nodes[nodeNum].InitLeaf(primNums, nTriangles, &TriangleIndices);
+        stats.leafMs += phase.getElapsedTimeInMilliSec();
         return;
     }
 
@@ -238,6 +252,7 @@ void KdTreeAccel::buildTree(int nodeNum, const Bounds3f &nodeBounds,
 retrySplit:
 
     // Initialize edges for _axis_
+    phase.start();
     for (int i = 0; i < nTriangles; ++i) {
         int pn = primNums[i];
         const Bounds3f &bounds = allPrimBounds[pn];
@@ -254,7 +269,10 @@ retrySplit:
                       return e0.t < e1.t;
               });
 
+    stats.edgesMs += phase.getElapsedTimeInMilliSec();
+
     // Compute cost of all splits for _axis_ to find best
+    phase.start();
     int nBelow = 0, nAbove = nTriangles;
     for (int i = 0; i < 2 * nTriangles; ++i) {
         if (edges[axis][i].type == EdgeType::End) --nAbove;
@@ -287,6 +305,7 @@ retrySplit:
         if (edges[axis][i].type == EdgeType::Start) ++nBelow;
     }
     //Assert(nBelow == nTriangles && nAbove == 0);
+    stats.sweepMs += phase.getElapsedTimeInMilliSec();
 
     // Create leaf if no good splits were found
     if (bestAxis == -1 && retries < 2) {
@@ -297,11 +316,14 @@ retrySplit:
     if (bestCost > oldCost) ++badRefines;
     if ((bestCost > 4 * oldCost && nTriangles < 16) || bestAxis == -1 ||
         badRefines == 3) {
+        phase.start();
         nodes[nodeNum].InitLeaf(primNums, nTriangles, &TriangleIndices);
+        stats.leafMs += phase.getElapsedTimeInMilliSec();
         return;
     }
 
     // Classify Triangles with respect to split
+    phase.start();
     int n0 = 0, n1 = 0;
     for (int i = 0; i < bestOffset; ++i)
         if (edges[bestAxis][i].type == EdgeType::Start)
@@ -309,6 +331,7 @@ retrySplit:
     for (int i = bestOffset + 1; i < 2 * nTriangles; ++i)
         if (edges[bestAxis][i].type == EdgeType::End)
             prims1[n1++] = edges[bestAxis][i].primNum;
+    stats.classifyMs += phase.getElapsedTimeInMilliSec();
 
     // Recursively initialize children nodes
     float tSplit = edges[bestAxis][bestOffset].t;
@@ -330,6 +353,8 @@ std::shared_ptr<KdTreeAccel> CreateKdTreeAccelerator(
 
 void KdTreeAccel::convertToMyKdFormat(std::vector<KDNode>& kdnodes, std::vector<int>& kdtriangles)
 {
+	Timer convert;
+	convert.start();
 	kdnodes.clear();
 	kdnodes.reserve(nextFreeNode);
 	kdtriangles = TriangleIndices;
@@ -346,6 +371,7 @@ void KdTreeAccel::convertToMyKdFormat(std::vector<KDNode>& kdnodes, std::vector<
 			mynode.axis = None;
 			mynode.split = 0;
 			mynode.child_id = { -1, -1 };	
+			mynode.block = -1;
 			mynode.start = node.TriangleIndicesOffset;
 			mynode.end = node.TriangleIndicesOffset + node.nTriangles();
 		}
@@ -356,7 +382,9 @@ void KdTreeAccel::convertToMyKdFormat(std::vector<KDNode>& kdnodes, std::vector<
 			mynode.child_id = { i + 1, node.AboveChild() };  //left child is current node id + 1
 			mynode.start = -1;
 			mynode.end = -1;
+			mynode.block = -1;
 		}
 		kdnodes.push_back(mynode);
 	}
+	stats.convertMs = convert.getElapsedTimeInMilliSec();
 }
@@ -43,6 +43,7 @@
 // accelerators/kdtreeaccel.h*
 #include "../RTstruct.h"
 #include "../KDstruct.h"
+#include "../KDstats.h"
 #include "geometry.h"
 
 // KdTreeAccel Declarations
@@ -60,6 +61,8 @@ class KdTreeAccel{
 
 	//convert to My CL program format
 	void convertToMyKdFormat(std::vector<KDNode>& kdnodes, std::vector<int>& kdtriangles);
+	//phase times and scratch memory of the build (and last convert)
+	const KDBuildStats& BuildStats() const { return stats; }
 
   private:
     // KdTreeAccel Private Methods
@@ -78,6 +81,7 @@ class KdTreeAccel{
     KdAccelNode *nodes;
     int nAllocedNodes, nextFreeNode;
     Bounds3f bounds;
+    KDBuildStats stats;
 };
 
 struct KdToDo {
@@ -0,0 +1,239 @@
+#include "BenchScenes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <assimp/cimport.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+//hashed counter instead of <random> distributions, whose numbers differ
+//between standard libraries, so the scenes and their goldens are the same
+//with every compiler
+struct SceneRandom
+{
+	uint32_t seed, index;
+
+	SceneRandom(uint32_t seed) : seed(seed), index(0) {}
+
+	//the integer hash of the sampler
+	static uint32_t Hash(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	float Uniform(float lo, float hi)
+	{
+		uint32_t r = Hash(seed ^ Hash(index++));
+		return lo + (hi - lo) * ((r >> 8) * (1.0f / 16777216.0f));
+	}
+
+	//drawn x, y, z in order, constructor arguments have no evaluation order
+	glm::vec3 Vec3(float lo, float hi)
+	{
+		float x = Uniform(lo, hi);
+		float y = Uniform(lo, hi);
+		float z = Uniform(lo, hi);
+		return glm::vec3(x, y, z);
+	}
+};
+
+static void pushTriangle(Mesh& mesh, glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 color)
+{
+	glm::vec3 n = glm::normalize(glm::cross(b - a, c - a));
+	mesh.points.push_back({ a, n, color });
+	mesh.points.push_back({ b, n, color });
+	mesh.points.push_back({ c, n, color });
+}
+
+//quad a b c d counter clockwise seen from the front
+static void pushQuad(Mesh& mesh, glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d, glm::vec3 color)
+{
+	pushTriangle(mesh, a, b, c, color);
+	pushTriangle(mesh, a, c, d, color);
+}
+
+static void pushBox(Mesh& mesh, glm::vec3 lo, glm::vec3 hi, glm::vec3 color)
+{
+	glm::vec3 p[8];
+	for (int i = 0; i < 8; i++)
+		p[i] = glm::vec3((i & 1) ? hi.x : lo.x, (i & 2) ? hi.y : lo.y, (i & 4) ? hi.z : lo.z);
+
+	pushQuad(mesh, p[0], p[2], p[3], p[1], color);  //-z
+	pushQuad(mesh, p[4], p[5], p[7], p[6], color);  //+z
+	pushQuad(mesh, p[0], p[4], p[6], p[2], color);  //-x
+	pushQuad(mesh, p[1], p[3], p[7], p[5], color);  //+x
+	pushQuad(mesh, p[0], p[1], p[5], p[4], color);  //-y
+	pushQuad(mesh, p[2], p[6], p[7], p[3], color);  //+y
+}
+
+Scene cornellScene()
+{
+	Scene scene;
+	glm::vec3 white(0.75f), red(0.75f, 0.2f, 0.2f), green(0.2f, 0.75f, 0.2f);
+
+	Mesh room = { {}, RT_MAT_DIFFUSE, 1.0f };
+	pushQuad(room, { -100, 0, -100 }, { -100, 0, 100 }, { 100, 0, 100 }, { 100, 0, -100 }, white);        //floor
+	pushQuad(room, { -100, 200, -100 }, { 100, 200, -100 }, { 100, 200, 100 }, { -100, 200, 100 }, white); //ceiling
+	pushQuad(room, { -100, 0, -100 }, { 100, 0, -100 }, { 100, 200, -100 }, { -100, 200, -100 }, white);   //back
+	pushQuad(room, { 100, 0, -100 }, { 100, 0, 100 }, { 100, 200, 100 }, { 100, 200, -100 }, green);       //right
+	scene.meshes.push_back(room);
+
+	Mesh left = { {}, RT_MAT_MIRROR, 1.0f };
+	pushQuad(left, { -100, 0, 100 }, { -100, 0, -100 }, { -100, 200, -100 }, { -100, 200, 100 }, red);
+	scene.meshes.push_back(left);
+
+	Mesh tall = { {}, RT_MAT_DIFFUSE, 1.0f };
+	pushBox(tall, { -60, 0, -60 }, { -10, 120, -10 }, white);
+	scene.meshes.push_back(tall);
+
+	Mesh glass = { {}, RT_MAT_DIELECTRIC, 1.5f };
+	pushBox(glass, { 15, 0, 10 }, { 65, 60, 60 }, white);
+	scene.meshes.push_back(glass);
+
+	scene.center = glm::vec3(0, 100, 0);
+	scene.radius = 175.0f;
+	scene.light = glm::vec3(0, 180, 70);
+	return scene;
+}
+
+Scene spheresScene(size_t budget)
+{
+	Scene scene;
+	const int grid = 4;
+	size_t perSphere = std::max<size_t>(budget / (grid * grid), 32);
+	int rings = std::max(4, (int)std::sqrt(perSphere / 2.0));
+	int segments = rings;
+
+	SceneRandom rng(7);
+
+	for (int gx = 0; gx < grid; gx++)
+	{
+		for (int gz = 0; gz < grid; gz++)
+		{
+			Mesh mesh = { {}, ((gx + gz) % 5 == 0) ? RT_MAT_MIRROR : RT_MAT_DIFFUSE, 1.0f };
+			glm::vec3 c((gx - 1.5f) * 60.0f, 25.0f, (gz - 1.5f) * 60.0f);
+			glm::vec3 color = rng.Vec3(0.2f, 1.0f);
+			const float r = 25.0f, pi = 3.14159265f;
+
+			auto at = [&](int i, int j)
+			{
+				float th = pi * i / rings, ph = 2.0f * pi * j / segments;
+				return c + r * glm::vec3(std::sin(th) * std::cos(ph), std::cos(th), std::sin(th) * std::sin(ph));
+			};
+			for (int i = 0; i < rings; i++)
+			{
+				for (int j = 0; j < segments; j++)
+				{
+					glm::vec3 a = at(i, j), b = at(i + 1, j), d = at(i, j + 1), e = at(i + 1, j + 1);
+					if (i != 0) pushTriangle(mesh, a, d, b, color);
+					if (i != rings - 1) pushTriangle(mesh, d, e, b, color);
+				}
+			}
+			scene.meshes.push_back(mesh);
+		}
+	}
+
+	Mesh floor = { {}, RT_MAT_DIFFUSE, 1.0f };
+	pushQuad(floor, { -300, 0, -300 }, { -300, 0, 300 }, { 300, 0, 300 }, { 300, 0, -300 }, glm::vec3(0.7f));
+	scene.meshes.push_back(floor);
+
+	scene.center = glm::vec3(0, 25, 0);
+	scene.radius = 260.0f;
+	scene.light = glm::vec3(50, 250, 80);
+	return scene;
+}
+
+Scene soupScene(size_t budget)
+{
+	Scene scene;
+	SceneRandom rng(11);
+
+	const size_t chunk = 1000000;
+	for (size_t done = 0; done < budget; done += chunk)
+	{
+		Mesh mesh = { {}, RT_MAT_DIFFUSE, 1.0f };
+		size_t n = std::min(chunk, budget - done);
+		mesh.points.reserve(n * 3);
+		for (size_t i = 0; i < n; i++)
+		{
+			glm::vec3 o = rng.Vec3(-100.0f, 100.0f);
+			glm::vec3 a = o + rng.Vec3(-3.0f, 3.0f);
+			glm::vec3 b = o + rng.Vec3(-3.0f, 3.0f);
+			glm::vec3 c = o + rng.Vec3(-3.0f, 3.0f);
+			glm::vec3 color = rng.Vec3(0.2f, 1.0f);
+			if (glm::length(glm::cross(b - a, c - a)) < 1e-4f) continue;
+			pushTriangle(mesh, a, b, c, color);
+		}
+		scene.meshes.push_back(std::move(mesh));
+	}
+
+	scene.center = glm::vec3(0, 0, 0);
+	scene.radius = 320.0f;
+	scene.light = glm::vec3(0, 250, 250);
+	return scene;
+}
+
+bool modelScene(const std::string& file, Scene& scene)
+{
+	const aiScene* ai = aiImportFile(file.c_str(), aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_ImproveCacheLocality);
+	if (!ai) return false;
+
+	Mesh mesh = { {}, RT_MAT_DIFFUSE, 1.0f };
+	glm::vec3 lo(1e30f), hi(-1e30f);
+	for (unsigned m = 0; m < ai->mNumMeshes; m++)
+	{
+		const aiMesh* am = ai->mMeshes[m];
+		aiColor4D kd;
+		glm::vec3 color(1.0f);
+		if (AI_SUCCESS == aiGetMaterialColor(ai->mMaterials[am->mMaterialIndex], AI_MATKEY_COLOR_DIFFUSE, &kd))
+			color = glm::vec3(kd.r, kd.g, kd.b);
+
+		for (unsigned f = 0; f < am->mNumFaces; f++)
+		{
+			const aiFace& face = am->mFaces[f];
+			if (face.mNumIndices != 3) continue;
+			glm::vec3 v[3];
+			for (int k = 0; k < 3; k++)
+			{
+				const aiVector3D& p = am->mVertices[face.mIndices[k]];
+				v[k] = glm::vec3(p.x, p.y, p.z);
+				lo = glm::min(lo, v[k]);
+				hi = glm::max(hi, v[k]);
+			}
+			pushTriangle(mesh, v[0], v[1], v[2], color);
+		}
+	}
+	aiReleaseImport(ai);
+
+	scene.meshes.push_back(std::move(mesh));
+	scene.center = 0.5f * (lo + hi);
+	scene.radius = std::max(glm::length(hi - lo), 1e-3f);
+	scene.light = scene.center + glm::vec3(0, 0.6f, 0.4f) * scene.radius;
+	return true;
+}
+
+std::vector<Triangle> sceneTriangles(const Scene& scene)
+{
+	std::vector<Triangle> triangles;
+	triangles.reserve(scene.triangles);
+	for (const Mesh& mesh : scene.meshes)
+	{
+		for (size_t i = 0; i + 2 < mesh.points.size(); i += 3)
+		{
+			Triangle t = {};
+			t.v0 = glm::vec4(mesh.points[i].v, 1);
+			t.v1 = glm::vec4(mesh.points[i + 1].v, 1);
+			t.v2 = glm::vec4(mesh.points[i + 2].v, 1);
+			t.n0 = t.n1 = t.n2 = glm::vec4(mesh.points[i].n, 0);
+			triangles.push_back(t);
+		}
+	}
+	return triangles;
+}
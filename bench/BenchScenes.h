@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <glm/glm.hpp>
+
+#include "RTtypes.h"
+#include "RTstruct.h"
+
+//------ benchmark scenes
+// procedural and loaded triangle sets shared by the benchmarks
+
+//VBO structure, same layout as the demo
+struct PointData
+{
+	glm::vec3 v;  //vertex
+	glm::vec3 n;  //normal
+	glm::vec3 c;  //color
+};
+
+struct Mesh
+{
+	std::vector<PointData> points;
+	RTenum material;
+	float rIndex;
+};
+
+//meshes plus a camera frame: the scene fits in a sphere at center
+struct Scene
+{
+	std::vector<Mesh> meshes;
+	glm::vec3 center;
+	float radius;
+	glm::vec3 light;
+	size_t triangles;
+};
+
+//open box, mirror left wall, diffuse tall block and glass short block
+Scene cornellScene();
+//grid of uv spheres sharing the triangle budget
+Scene spheresScene(size_t budget);
+//random small triangles in a cube, split into 1M triangle vbos
+Scene soupScene(size_t budget);
+//every mesh of the model in one diffuse vbo
+bool modelScene(const std::string& file, Scene& scene);
+
+//every triangle of the scene as kernel Triangles
+std::vector<Triangle> sceneTriangles(const Scene& scene);
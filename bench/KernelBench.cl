@@ -0,0 +1,97 @@
+//------ thin kernels around the RayTracing.cl helpers for bench/clbench
+// built appended to RayTracing.cl. rays are ori, dir float4 pairs, every
+// kernel writes a per ray result so the compiler can not drop the tests.
+
+void makeRay(Ray* ray, global const float4* rays, uint i)
+{
+	ray->ori = rays[2 * i];
+	ray->dir = rays[2 * i + 1];
+	ray->revdir = native_recip(ray->dir);
+	ray->ray_type = Origin;
+	ray->rec.primID = -1;
+	ray->rec.prim_type = MISS;
+	ray->rec.isInPrim = false;
+	ray->rec.depth = 0;
+	ray->rec.t = FLT_MAX;
+	ray->rec.INTXN = (int2)(0, 0);
+}
+
+//tests triangles i .. i + tests - 1 (mod count)
+kernel void bench_TriINTXN(global const float4* rays, global const Triangle* triangles,
+	uint count, uint tests, global float* result)
+{
+	uint i = get_global_id(0);
+	Ray ray;
+	makeRay(&ray, rays, i);
+	for (uint k = 0; k < tests; ++k)
+	{
+		uint id = (i + k) % count;
+		Triangle tri = triangles[id];
+		TriINTXN(&ray.rec, &ray, &tri, id);
+	}
+	result[i] = ray.rec.t;
+}
+
+//tests / 4 blocks from block i (mod count), the same triangle tests as bench_TriINTXN
+kernel void bench_TriBlockINTXN(global const float4* rays, global const TriBlock* blocks,
+	uint count, uint tests, global float* result)
+{
+	uint i = get_global_id(0);
+	Ray ray;
+	makeRay(&ray, rays, i);
+	for (uint k = 0; k < tests; k += 4)
+	{
+		TriBlock block = blocks[(i + k / 4) % count];
+		TriBlockINTXN(&ray.rec, &ray, &block);
+	}
+	result[i] = ray.rec.t;
+}
+
+kernel void bench_AABBINTXN(global const float4* rays, global const float8* boxes,
+	uint count, uint tests, global float* result)
+{
+	uint i = get_global_id(0);
+	Ray ray;
+	makeRay(&ray, rays, i);
+	KDNode node;   //not read by the test
+	float acc = 0.0f;
+	for (uint k = 0; k < tests; ++k)
+	{
+		float8 box = boxes[(i + k) % count];
+		float2 t;
+		if (AABBINTXN(&t, &ray, &node, &box)) acc += t.s0;
+	}
+	result[i] = acc;
+}
+
+kernel void bench_SphLiINTXN(global const float4* rays, global const SphereLight* lights,
+	uint count, uint tests, global float* result)
+{
+	uint i = get_global_id(0);
+	Ray ray;
+	makeRay(&ray, rays, i);
+	for (uint k = 0; k < tests; ++k)
+	{
+		uint id = (i + k) % count;
+		SphereLight sphl = lights[id];
+		SphLiINTXN(&ray.rec, &ray, &sphl, id);
+	}
+	result[i] = ray.rec.t;
+}
+
+//closest hit through the kd-tree, intxn gets the triangle tests per ray.
+//the first cachedNodes nodes are read from local memory as in PathTracing_kdtree
+kernel void bench_stackKDtreeTraversal(global const float4* rays, float8 nodeBound,
+	NODE_BUF kdnodes, BLOCK_BUF triBlocks,
+	global float* result, global int2* intxn, local KDNode* nodeCache, int cachedNodes)
+{
+	for (uint k = get_local_id(0); k < cachedNodes; k += get_local_size(0)) nodeCache[k] = loadNode(kdnodes, k);
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	uint i = get_global_id(0);
+	Ray ray;
+	makeRay(&ray, rays, i);
+	stackKDtreeTraversal(&nodeBound, kdnodes, nodeCache, cachedNodes, triBlocks, &ray.rec, &ray);
+	result[i] = ray.rec.t;
+	intxn[i] = ray.rec.INTXN;
+}
@@ -0,0 +1,486 @@
+//------ clbench
+// opencl kernel micro-benchmark. builds RayTracing.cl alone with the thin
+// kernels of KernelBench.cl and times PathTracing_kdtree and its helpers on
+// synthetic triangle, node and ray buffers with event profiling, without the
+// host pipeline around them. prints one json object with ns per ray and per
+// intersection test. runs on any opencl device, pocl included.
+//
+// clbench [--device cpu|gpu|any] [--triangles N] [--rays N] [--tests N] [--repeat N]
+//         [--dispatch scanline|tile|morton] [--tile N|WxH] [--traversal single|packet]
+//         [--node-cache N] [--fetch buffer|image] [--schedule ndrange|persistent] [--out file]
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <random>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cfloat>
+
+#include <CL\cl.h>
+#include <glm\glm.hpp>
+
+#include "RTtypes.h"
+#include "RTstruct.h"
+#include "KDstruct.h"
+#include "OCLsetting.h"
+#include "KDlayout.h"
+#include "LightTree.h"
+#include "pbrt_kdtree\kdtreeaccel.h"
+#include "BenchScenes.h"
+
+//frame of PathTracing_kdtree, same as the library
+#define FRAME_WIDTH 800
+#define FRAME_HEIGHT 600
+
+struct Options
+{
+	std::string device = "cpu";
+	std::string dispatch = "morton";
+	size_t tile[2] = { 8, 8 };   //work-group shape for tile / morton dispatch
+	std::string traversal = "packet";
+	int nodeCache = -1; //top kd-tree nodes in local memory, -1 = as the library
+	std::string fetch = "buffer";
+	std::string schedule = "ndrange";
+	std::string out;
+	size_t triangles = 100000;
+	size_t rays = 1 << 18;
+	unsigned tests = 64;
+	int repeat = 5;
+};
+
+struct Result
+{
+	const char* kernel;
+	double ms;          //median of the repeats
+	double rays;
+	double tests;       //intersection tests of one run
+};
+
+static void check(cl_int err, const char* what)
+{
+	if (err == CL_SUCCESS) return;
+	printf("%s failed (%d).\n", what, err);
+	exit(1);
+}
+
+//median kernel time of repeat launches, each after one untimed launch.
+//counter, if any, is cleared before every launch
+static double launch(cl_command_queue queue, cl_kernel kernel, cl_uint dims, const size_t* size, int repeat,
+	const size_t* local = NULL, cl_mem counter = NULL)
+{
+	std::vector<double> ms;
+	for (int i = -1; i < repeat; i++)
+	{
+		cl_uint zero = 0;
+		if (counter != NULL) clEnqueueFillBuffer(queue, counter, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 0, NULL, NULL);
+		cl_event e;
+		check(clEnqueueNDRangeKernel(queue, kernel, dims, NULL, size, local, 0, NULL, &e), "clEnqueueNDRangeKernel");
+		clWaitForEvents(1, &e);
+		cl_ulong begin = 0, end = 0;
+		clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &begin, NULL);
+		clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+		clReleaseEvent(e);
+		if (i >= 0) ms.push_back((end - begin) * 1e-6);
+	}
+	std::nth_element(ms.begin(), ms.begin() + ms.size() / 2, ms.end());
+	return ms[ms.size() / 2];
+}
+
+static std::string readFile(const char* file)
+{
+	std::ifstream ifs(file);
+	return std::string((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+}
+
+static bool parseArgs(int argc, char** argv, Options& opt)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool more = i + 1 < argc;
+		if (a == "--device" && more) opt.device = argv[++i];
+		else if (a == "--out" && more) opt.out = argv[++i];
+		else if (a == "--triangles" && more) opt.triangles = (size_t)atof(argv[++i]);
+		else if (a == "--rays" && more) opt.rays = (size_t)atof(argv[++i]);
+		else if (a == "--tests" && more) opt.tests = (unsigned)atoi(argv[++i]);
+		else if (a == "--repeat" && more) opt.repeat = atoi(argv[++i]);
+		else if (a == "--dispatch" && more) opt.dispatch = argv[++i];
+		else if (a == "--tile" && more)
+		{
+			//N for a square, WxH for any power of two shape
+			const char* shape = argv[++i];
+			const char* x = strchr(shape, 'x');
+			opt.tile[0] = (size_t)atoi(shape);
+			opt.tile[1] = x != NULL ? (size_t)atoi(x + 1) : opt.tile[0];
+		}
+		else if (a == "--traversal" && more) opt.traversal = argv[++i];
+		else if (a == "--node-cache" && more) opt.nodeCache = atoi(argv[++i]);
+		else if (a == "--fetch" && more) opt.fetch = argv[++i];
+		else if (a == "--schedule" && more) opt.schedule = argv[++i];
+		else
+		{
+			printf("usage: clbench [--device cpu|gpu|any] [--triangles N] [--rays N] [--tests N] [--repeat N]\n"
+				"               [--dispatch scanline|tile|morton] [--tile N|WxH] [--traversal single|packet]\n"
+				"               [--node-cache N] [--fetch buffer|image] [--schedule ndrange|persistent] [--out file]\n");
+			return false;
+		}
+	}
+	return opt.rays > 0 && opt.tests > 0 && opt.repeat > 0 && opt.tile[0] > 0 && opt.tile[1] > 0;
+}
+
+int main(int argc, char** argv)
+{
+	Options opt;
+	if (!parseArgs(argc, argv, opt)) return 1;
+
+	//---device, context and program
+	cl_device_type type = CL_DEVICE_TYPE_CPU;
+	if (opt.device == "gpu") type = CL_DEVICE_TYPE_GPU;
+	else if (opt.device == "any") type = CL_DEVICE_TYPE_GPU | CL_DEVICE_TYPE_CPU;
+	std::vector<cl_device_id> devs = OCLsetting::ListDevices(type);
+	if (devs.empty())
+	{
+		printf("no opencl %s device.\n", opt.device.c_str());
+		return 1;
+	}
+	cl_device_id device = devs[0];
+	char deviceName[256];
+	clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL);
+
+	cl_int err;
+	cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
+	check(err, "clCreateContext");
+#ifdef NV_CL12
+	cl_command_queue queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+#else
+	cl_queue_properties cqprop[] = { CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0 };
+	cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, cqprop, &err);
+#endif
+	check(err, "clCreateCommandQueue");
+
+	std::string source = readFile("RayTracing.cl");
+	std::string bench = readFile("KernelBench.cl");
+	if (source.empty() || bench.empty())
+	{
+		printf("RayTracing.cl and KernelBench.cl must be in the working directory.\n");
+		return 1;
+	}
+	source += "\n" + bench;
+	const char* sources[] = { source.c_str() };
+	cl_program program = clCreateProgramWithSource(context, 1, sources, NULL, &err);
+	check(err, "clCreateProgramWithSource");
+	bool image = (opt.fetch == "image");
+	if (clBuildProgram(program, 1, &device, image ? "-DFETCH_IMAGE" : "", NULL, NULL) != CL_SUCCESS)
+	{
+		size_t size = 0;
+		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &size);
+		std::string log(size, '\0');
+		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, size, &log[0], NULL);
+		printf("%s\n", log.c_str());
+		return 1;
+	}
+
+	//---synthetic scene, rays start inside the scene bound in random directions
+	Scene scene = soupScene(opt.triangles);
+	std::vector<Triangle> triangles = sceneTriangles(scene);
+	scene.meshes.clear();
+	for (Triangle& t : triangles)
+	{
+		t.brdf_type = DIFF;
+		t.m0.color = t.m1.color = t.m2.color = glm::vec4(0.75f, 0.75f, 0.75f, 1.0f);
+	}
+
+	std::vector<std::shared_ptr<Triangle>> prims;
+	prims.reserve(triangles.size());
+	for (const Triangle& t : triangles) prims.push_back(std::make_shared<Triangle>(t));
+	KdTreeAccel tree(prims);
+	prims.clear();
+	std::vector<KDNode> kdnodes;
+	std::vector<int> kdtriangles;
+	tree.convertToMyKdFormat(kdnodes, kdtriangles);
+	size_t topNodes = LayoutKDTopLevels(kdnodes);
+	std::vector<TriBlock> blocks;
+	BuildTriBlocks(kdnodes, kdtriangles, triangles.data(), blocks);
+	Bounds3f b = tree.WorldBound();
+	cl_float8 bound = { { b.pMin.x, b.pMin.y, b.pMin.z, 0, b.pMax.x, b.pMax.y, b.pMax.z, 0 } };
+	glm::vec3 lo(b.pMin.x, b.pMin.y, b.pMin.z), hi(b.pMax.x, b.pMax.y, b.pMax.z);
+
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::normal_distribution<float> gauss;
+	std::vector<glm::vec4> rays(opt.rays * 2);
+	for (size_t i = 0; i < opt.rays; i++)
+	{
+		glm::vec3 ori = lo + (hi - lo) * glm::vec3(unit(rng), unit(rng), unit(rng));
+		glm::vec3 dir = glm::normalize(glm::vec3(gauss(rng), gauss(rng), gauss(rng)) + glm::vec3(1e-6f));
+		rays[2 * i] = glm::vec4(ori, 1);
+		rays[2 * i + 1] = glm::vec4(dir, 0);
+	}
+
+	//random boxes and lights inside the bound
+	std::vector<cl_float8> boxes(4096);
+	for (cl_float8& box : boxes)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			float x = unit(rng), y = unit(rng);
+			box.s[a] = lo[a] + (hi[a] - lo[a]) * std::min(x, y);
+			box.s[a + 4] = lo[a] + (hi[a] - lo[a]) * std::max(x, y);
+		}
+		box.s[3] = box.s[7] = 0;
+	}
+	std::vector<SphereLight> lights(8);   //value-initialised, unset fields are 0
+	for (SphereLight& l : lights)
+	{
+		l.ori = glm::vec4(lo + (hi - lo) * glm::vec3(unit(rng), unit(rng), unit(rng)), 0);
+		l.radius = glm::length(hi - lo) * 0.02f;
+		l.mat.color = glm::vec4(1, 1, 1, 1);
+		l.mat.rIndex = 1;
+		l.range = FLT_MAX;
+		l.enable = true;
+	}
+
+	//---device buffers
+	cl_mem rayBuf = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(glm::vec4) * rays.size(), rays.data(), &err);
+	cl_mem triBuf = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(Triangle) * triangles.size(), triangles.data(), &err);
+	cl_mem nodeBuf = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(KDNode) * kdnodes.size(), kdnodes.data(), &err);
+	cl_mem blockBuf = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(TriBlock) * std::max(blocks.size(), (size_t)1), blocks.data(), &err);
+	cl_mem boxBuf = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_float8) * boxes.size(), boxes.data(), &err);
+	cl_mem lightBuf = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(SphereLight) * lights.size(), lights.data(), &err);
+	cl_mem resultBuf = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * opt.rays, NULL, &err);
+	size_t pixels = std::max(opt.rays, (size_t)FRAME_WIDTH * FRAME_HEIGHT);
+	cl_mem intxnBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int2) * pixels, NULL, &err);
+	cl_mem rayCountBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * 4, NULL, &err);
+	cl_mem tileCounterBuf = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &err);
+	check(err, "clCreateBuffer");
+
+	//kd-tree data the traversal kernels read, image views for --fetch image
+	cl_mem nodeData = nodeBuf, blockData = blockBuf, triData = triBuf;
+	if (image)
+	{
+		nodeData = OCLsetting::BufferImage(context, device, nodeBuf, kdnodes.size() * sizeof(KDNode) / 16, CL_RGBA);
+		blockData = OCLsetting::BufferImage(context, device, blockBuf, std::max(blocks.size(), (size_t)1) * sizeof(TriBlock) / 16, CL_RGBA);
+		triData = OCLsetting::BufferImage(context, device, triBuf, triangles.size() * sizeof(Triangle) / 16, CL_RGBA);
+		if (nodeData == NULL || blockData == NULL || triData == NULL)
+		{
+			printf("%s can not view the kd-tree buffers as images.\n", deviceName);
+			return 1;
+		}
+	}
+
+	//local node cache budget of the whole kernel, the larger user of local memory
+	cl_kernel probe = clCreateKernel(program, "PathTracing_kdtree", &err);
+	check(err, "PathTracing_kdtree");
+	size_t cached = OCLsetting::LocalNodeCache(device, probe);
+	clReleaseKernel(probe);
+	if (opt.nodeCache >= 0) cached = (size_t)opt.nodeCache;
+	cl_int cachedNodes = (cl_int)std::min(cached, topNodes);
+	size_t cacheBytes = sizeof(KDNode) * std::max(cachedNodes, 1);
+
+	std::vector<Result> results;
+	size_t global[2] = { opt.rays, 1 };
+	cl_uint count;
+
+	//---primitive tests, tests per ray each
+	const char* tests[] = { "bench_TriINTXN", "bench_TriBlockINTXN", "bench_AABBINTXN", "bench_SphLiINTXN" };
+	cl_mem prims3[] = { triBuf, blockBuf, boxBuf, lightBuf };
+	cl_uint counts[] = { (cl_uint)triangles.size(), (cl_uint)std::max(blocks.size(), (size_t)1), (cl_uint)boxes.size(), (cl_uint)lights.size() };
+	for (int k = 0; k < 4; k++)
+	{
+		cl_kernel kernel = clCreateKernel(program, tests[k], &err);
+		check(err, tests[k]);
+		count = counts[k];
+		clSetKernelArg(kernel, 0, sizeof(cl_mem), &rayBuf);
+		clSetKernelArg(kernel, 1, sizeof(cl_mem), &prims3[k]);
+		clSetKernelArg(kernel, 2, sizeof(cl_uint), &count);
+		clSetKernelArg(kernel, 3, sizeof(cl_uint), &opt.tests);
+		clSetKernelArg(kernel, 4, sizeof(cl_mem), &resultBuf);
+		Result r = { tests[k] + 6, launch(queue, kernel, 1, global, opt.repeat), (double)opt.rays, (double)opt.rays * opt.tests };
+		results.push_back(r);
+		clReleaseKernel(kernel);
+	}
+
+	//---kd-tree traversal, tests counted by the kernel
+	{
+		cl_kernel kernel = clCreateKernel(program, "bench_stackKDtreeTraversal", &err);
+		check(err, "bench_stackKDtreeTraversal");
+		clSetKernelArg(kernel, 0, sizeof(cl_mem), &rayBuf);
+		clSetKernelArg(kernel, 1, sizeof(cl_float8), &bound);
+		clSetKernelArg(kernel, 2, sizeof(cl_mem), &nodeData);
+		clSetKernelArg(kernel, 3, sizeof(cl_mem), &blockData);
+		clSetKernelArg(kernel, 4, sizeof(cl_mem), &resultBuf);
+		clSetKernelArg(kernel, 5, sizeof(cl_mem), &intxnBuf);
+		clSetKernelArg(kernel, 6, cacheBytes, NULL);
+		clSetKernelArg(kernel, 7, sizeof(cl_int), &cachedNodes);
+		double ms = launch(queue, kernel, 1, global, opt.repeat);
+
+		std::vector<cl_int2> intxn(opt.rays);
+		clEnqueueReadBuffer(queue, intxnBuf, CL_TRUE, 0, sizeof(cl_int2) * intxn.size(), intxn.data(), 0, NULL, NULL);
+		double tested = 0;
+		for (const cl_int2& n : intxn) tested += n.s[0];
+		Result r = { "stackKDtreeTraversal", ms, (double)opt.rays, tested };
+		results.push_back(r);
+		clReleaseKernel(kernel);
+	}
+
+	//---whole kernel, one light, camera outside the bound looking at its center
+	{
+		cl_kernel kernel = clCreateKernel(program, "PathTracing_kdtree", &err);
+		check(err, "PathTracing_kdtree");
+
+		cl_image_format format = { CL_RGBA, CL_FLOAT };
+		cl_image_desc desc;
+		memset(&desc, 0, sizeof(desc));
+		desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+		desc.image_width = FRAME_WIDTH;
+		desc.image_height = FRAME_HEIGHT;
+		cl_mem frame = clCreateImage(context, CL_MEM_WRITE_ONLY, &format, &desc, NULL, &err);
+		check(err, "clCreateImage");
+
+		for (size_t i = 1; i < lights.size(); i++) lights[i].enable = false;
+		clEnqueueWriteBuffer(queue, lightBuf, CL_TRUE, 0, sizeof(SphereLight) * lights.size(), lights.data(), 0, NULL, NULL);
+		std::vector<LightNode> lightNodes;
+		BuildLightTree(lights, lightNodes);
+		cl_mem lightNodeBuf = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(LightNode) * lightNodes.size(), lightNodes.data(), &err);
+		check(err, "clCreateBuffer");
+
+		Info info;
+		info.tri_SIZE = (int)triangles.size();
+		info.pl_SIZE = (int)lights.size();
+		info.samples = 1;
+		info.maxdepth = 8;
+		info.light_enable = 1;
+		info.width = FRAME_WIDTH;
+		info.height = FRAME_HEIGHT;
+		info.dispatch = RT_DISPATCH_SCANLINE;
+		if (opt.dispatch == "tile") info.dispatch = RT_DISPATCH_TILE;
+		else if (opt.dispatch == "morton") info.dispatch = RT_DISPATCH_MORTON;
+		//packets follow the library, scanline launches traverse single rays
+		info.traversal = RT_TRAVERSAL_SINGLE;
+		if (opt.traversal == "packet" && info.dispatch != RT_DISPATCH_SCANLINE) info.traversal = RT_TRAVERSAL_PACKET;
+		info.cachedNodes = cachedNodes;
+		info.schedule = RT_SCHEDULE_NDRANGE;
+		if (opt.schedule == "persistent" && info.dispatch != RT_DISPATCH_SCANLINE) info.schedule = RT_SCHEDULE_PERSISTENT;
+		info.first = 0;
+		info.rows = FRAME_HEIGHT;
+		info.lightNodes = (int)lightNodes.size();
+		info.lightSampling = RT_LIGHTS_ALL;
+		info.shadowRays = 1;
+		info.adaptive = ADAPTIVE_OFF;
+		info.pass = 0;
+		info.threshold = 0.0f;
+		info.maxSamples = 0;
+		info.antialias = AA_OFF;
+		info.aaSamples = 0;
+		info.sampler = RT_SAMPLER_RANDOM;
+		info.denoise = 0;
+		info.history = 0;
+		info.reproject = REPROJECT_OFF;
+		info.refresh = 1.0f;
+		info.variableRate = 0;
+		info.cutoff = 0.0f;
+		info.rayBudget = 0;
+
+		//same view plane as RTCamera::prepareCamera, 60 degrees fovy
+		glm::vec3 center = (lo + hi) * 0.5f;
+		glm::vec3 eye = center + glm::vec3(0, 0, glm::length(hi - lo));
+		glm::vec3 vdir = glm::normalize(center - eye);
+		glm::vec3 dx = glm::normalize(glm::cross(vdir, glm::vec3(0, 1, 0)));
+		glm::vec3 dy = glm::normalize(glm::cross(dx, vdir));
+		float aspect = FRAME_WIDTH / (float)FRAME_HEIGHT;
+		dx *= (glm::tan(glm::radians(60.0f * aspect / 2.0f)) * 2) / FRAME_WIDTH;
+		dy *= (glm::tan(glm::radians(60.0f / 2.0f)) * 2) / FRAME_HEIGHT;
+		PinholeCamera camera;
+		camera.pos = glm::vec4(eye, 0);
+		camera.dxUnit = glm::vec4(dx, 0);
+		camera.dyUnit = glm::vec4(dy, 0);
+		camera.ulViewPos = glm::vec4(eye + vdir - (FRAME_WIDTH / 2.0f) * dx + (FRAME_HEIGHT / 2.0f) * dy, 0);
+
+		clSetKernelArg(kernel, 0, sizeof(Info), &info);
+		clSetKernelArg(kernel, 1, sizeof(PinholeCamera), &camera);
+		clSetKernelArg(kernel, 2, sizeof(cl_mem), &frame);
+		clSetKernelArg(kernel, 3, sizeof(cl_float8), &bound);
+		clSetKernelArg(kernel, 4, sizeof(cl_mem), &nodeData);
+		clSetKernelArg(kernel, 5, sizeof(cl_mem), &blockData);
+		clSetKernelArg(kernel, 6, sizeof(cl_mem), &triData);
+		clSetKernelArg(kernel, 7, sizeof(cl_mem), &lightBuf);
+		clSetKernelArg(kernel, 8, sizeof(cl_mem), &intxnBuf);
+		clSetKernelArg(kernel, 9, sizeof(cl_mem), &rayCountBuf);
+		clSetKernelArg(kernel, 10, cacheBytes, NULL);
+		clSetKernelArg(kernel, 11, sizeof(cl_mem), &tileCounterBuf);
+		clSetKernelArg(kernel, 12, sizeof(cl_mem), &lightNodeBuf);
+		cl_mem none = NULL;
+		for (cl_uint a = 13; a <= 20; a++) clSetKernelArg(kernel, a, sizeof(cl_mem), &none);
+
+		cl_uint zero = 0;
+		clEnqueueFillBuffer(queue, rayCountBuf, &zero, sizeof(cl_uint), 0, sizeof(cl_uint) * 4, 0, NULL, NULL);
+		size_t size[2] = { FRAME_WIDTH, FRAME_HEIGHT };
+		size_t local[2] = { opt.tile[0], opt.tile[1] };
+		if (info.dispatch != RT_DISPATCH_SCANLINE)
+		{
+			size[0] = (size[0] + local[0] - 1) / local[0] * local[0];
+			size[1] = (size[1] + local[1] - 1) / local[1] * local[1];
+		}
+		if (info.schedule == RT_SCHEDULE_PERSISTENT)
+		{
+			//one row of work-groups that fills the device, as the library
+			size_t tiles = (size[0] / local[0]) * (size[1] / local[1]);
+			size[0] = std::min(OCLsetting::PersistentGroups(device), tiles) * local[0];
+			size[1] = local[1];
+		}
+		double ms = launch(queue, kernel, 2, size, opt.repeat, info.dispatch != RT_DISPATCH_SCANLINE ? local : NULL,
+			info.schedule == RT_SCHEDULE_PERSISTENT ? tileCounterBuf : NULL);
+
+		//counters and intersection counts of the last run
+		cl_uint traced[4];
+		clEnqueueReadBuffer(queue, rayCountBuf, CL_TRUE, 0, sizeof(traced), traced, 0, NULL, NULL);
+		std::vector<cl_int2> intxn(FRAME_WIDTH * FRAME_HEIGHT);
+		clEnqueueReadBuffer(queue, intxnBuf, CL_TRUE, 0, sizeof(cl_int2) * intxn.size(), intxn.data(), 0, NULL, NULL);
+		double tested = 0;
+		for (const cl_int2& n : intxn) tested += n.s[0] + n.s[1];
+		double runs = opt.repeat + 1.0;
+		double rayTotal = (traced[0] + traced[1] + traced[2] + traced[3]) / runs;
+		Result r = { "PathTracing_kdtree", ms, rayTotal, tested };
+		results.push_back(r);
+
+		clReleaseMemObject(frame);
+		clReleaseMemObject(lightNodeBuf);
+		clReleaseKernel(kernel);
+	}
+
+	//---report
+	FILE* f = stdout;
+	if (!opt.out.empty() && (f = fopen(opt.out.c_str(), "w")) == NULL)
+	{
+		printf("can not open %s\n", opt.out.c_str());
+		return 1;
+	}
+	fprintf(f, "{\n  \"device\": \"%s\",\n  \"dispatch\": \"%s\",\n  \"schedule\": \"%s\",\n  \"traversal\": \"%s\",\n  \"cached_nodes\": %d,\n  \"fetch\": \"%s\",\n  \"triangles\": %zu,\n  \"nodes\": %zu,\n  \"rays\": %zu,\n  \"tests_per_ray\": %u,\n  \"kernels\": [\n",
+		deviceName, opt.dispatch.c_str(), opt.schedule.c_str(), opt.traversal.c_str(), (int)cachedNodes, opt.fetch.c_str(), triangles.size(), kdnodes.size(), opt.rays, opt.tests);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const Result& r = results[i];
+		fprintf(f, "    { \"kernel\": \"%s\", \"ms\": %.4f, \"ns_per_ray\": %.4f, \"ns_per_test\": %.4f, \"tests_per_ray\": %.2f }%s\n",
+			r.kernel, r.ms, r.ms * 1e6 / std::max(r.rays, 1.0), r.ms * 1e6 / std::max(r.tests, 1.0),
+			r.tests / std::max(r.rays, 1.0), i + 1 < results.size() ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+	if (f != stdout) fclose(f);
+
+	if (image)
+	{
+		clReleaseMemObject(nodeData);
+		clReleaseMemObject(blockData);
+		clReleaseMemObject(triData);
+	}
+	cl_mem buffers[] = { rayBuf, triBuf, nodeBuf, blockBuf, boxBuf, lightBuf, resultBuf, intxnBuf, rayCountBuf, tileCounterBuf };
+	for (cl_mem m : buffers) clReleaseMemObject(m);
+	clReleaseProgram(program);
+	clReleaseCommandQueue(queue);
+	clReleaseContext(context);
+	return 0;
+}
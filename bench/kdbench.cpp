@@ -0,0 +1,214 @@
+//------ kdbench
+// kd-tree construction benchmark comparing the two builders, the pbrt
+// KdTreeAccel used by rtBuildKDtreeCurrentSceneEXT and KDTREE::KDTree.
+// builds over procedural scenes of increasing size (and optional models) and
+// prints a json array with build time, phase breakdown, tree shape, SAH cost
+// and scratch memory per builder and scene.
+//
+// kdbench [--max N] [--repeat N] [--builder pbrt|kdtree|both] [--model file]... [--out file]
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cfloat>
+
+#include "Timer.h"
+#include "KDstats.h"
+#include "KDTree.h"
+#include "pbrt_kdtree\kdtreeaccel.h"
+#include "BenchScenes.h"
+
+struct Options
+{
+	size_t maxTriangles = 1000000;
+	int repeat = 3;
+	std::string builder = "both";
+	std::vector<std::string> models;
+	std::string out;
+};
+
+struct Result
+{
+	double buildMs;        //best of the repeats, build + convert
+	KDBuildStats stats;    //phases of the best repeat
+	KDTreeMetrics metrics;
+};
+
+static void triangleBound(const std::vector<Triangle>& triangles, float bound[6])
+{
+	for (int a = 0; a < 3; a++)
+	{
+		bound[a] = FLT_MAX;
+		bound[a + 3] = -FLT_MAX;
+	}
+	for (const Triangle& t : triangles)
+	{
+		const glm::vec4* v[3] = { &t.v0, &t.v1, &t.v2 };
+		for (int k = 0; k < 3; k++)
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				bound[a] = std::min(bound[a], (*v[k])[a]);
+				bound[a + 3] = std::max(bound[a + 3], (*v[k])[a]);
+			}
+		}
+	}
+}
+
+static Result buildPbrt(const std::vector<Triangle>& triangles, const float bound[6], int repeat)
+{
+	std::vector<std::shared_ptr<Triangle>> prims;
+	prims.reserve(triangles.size());
+	for (const Triangle& t : triangles) prims.push_back(std::make_shared<Triangle>(t));
+
+	Result r;
+	r.buildMs = DBL_MAX;
+	std::vector<KDNode> kdnodes;
+	std::vector<int> kdtriangles;
+	for (int i = 0; i < repeat; i++)
+	{
+		kdnodes.clear();
+		kdtriangles.clear();
+		Timer timer;
+		timer.start();
+		KdTreeAccel tree(prims);
+		tree.convertToMyKdFormat(kdnodes, kdtriangles);
+		double ms = timer.getElapsedTimeInMilliSec();
+		if (ms < r.buildMs)
+		{
+			r.buildMs = ms;
+			r.stats = tree.BuildStats();
+		}
+	}
+	r.metrics = MeasureKDTree(kdnodes, bound, triangles.size());
+	return r;
+}
+
+static Result buildKDTree(const std::vector<Triangle>& triangles, const float bound[6], int repeat)
+{
+	//buildTree takes a non const vector
+	std::vector<Triangle> input = triangles;
+
+	Result r;
+	r.buildMs = DBL_MAX;
+	std::vector<KDNode> kdnodes;
+	std::vector<int> kdtriangles;
+	for (int i = 0; i < repeat; i++)
+	{
+		kdnodes.clear();
+		kdtriangles.clear();
+		Timer timer;
+		timer.start();
+		KDTREE::KDTree tree(64, 16);
+		tree.buildTree(input);
+		tree.convertSharedKDnodes(kdnodes, kdtriangles);
+		double ms = timer.getElapsedTimeInMilliSec();
+		if (ms < r.buildMs)
+		{
+			r.buildMs = ms;
+			r.stats = tree.BuildStats();
+		}
+	}
+	r.metrics = MeasureKDTree(kdnodes, bound, triangles.size());
+	return r;
+}
+
+static void printResult(FILE* f, bool first, const char* builder, const std::string& scene, size_t triangles, const Result& r)
+{
+	const KDBuildStats& s = r.stats;
+	const KDTreeMetrics& m = r.metrics;
+	fprintf(f, "%s  {\n", first ? "" : ",\n");
+	fprintf(f, "    \"builder\": \"%s\", \"scene\": \"%s\", \"triangles\": %zu,\n", builder, scene.c_str(), triangles);
+	fprintf(f, "    \"build_ms\": %.4f,\n", r.buildMs);
+	fprintf(f, "    \"phase_ms\": { \"bounds\": %.4f, \"edges\": %.4f, \"sweep\": %.4f, \"classify\": %.4f, \"leaf\": %.4f, \"convert\": %.4f },\n",
+		s.boundsMs, s.edgesMs, s.sweepMs, s.classifyMs, s.leafMs, s.convertMs);
+	fprintf(f, "    \"nodes\": %zu, \"leaves\": %zu, \"empty_leaves\": %zu, \"references\": %zu, \"duplicates\": %zu,\n",
+		m.nodes, m.leaves, m.emptyLeaves, m.references, m.duplicates);
+	fprintf(f, "    \"max_depth\": %d, \"avg_leaf\": %.4f, \"sah_cost\": %.4f,\n", m.maxDepth, m.avgLeafSize, m.sahCost);
+	fprintf(f, "    \"scratch_bytes\": %zu, \"prims1_bytes\": %zu\n  }", s.scratchBytes, s.prims1Bytes);
+}
+
+static bool parseArgs(int argc, char** argv, Options& opt)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool more = i + 1 < argc;
+		if (a == "--max" && more) opt.maxTriangles = (size_t)atof(argv[++i]);
+		else if (a == "--repeat" && more) opt.repeat = atoi(argv[++i]);
+		else if (a == "--builder" && more) opt.builder = argv[++i];
+		else if (a == "--model" && more) opt.models.push_back(argv[++i]);
+		else if (a == "--out" && more) opt.out = argv[++i];
+		else
+		{
+			printf("usage: kdbench [--max N] [--repeat N] [--builder pbrt|kdtree|both] [--model file]... [--out file]\n");
+			return false;
+		}
+	}
+	return opt.repeat > 0;
+}
+
+int main(int argc, char** argv)
+{
+	Options opt;
+	if (!parseArgs(argc, argv, opt)) return 1;
+	bool pbrt = opt.builder != "kdtree";
+	bool kdtree = opt.builder != "pbrt";
+
+	//procedural sets grow by 10x up to --max, then the models
+	std::vector<std::pair<std::string, size_t>> runs;
+	for (size_t n = 1000; n <= opt.maxTriangles; n *= 10)
+	{
+		runs.push_back({ "soup", n });
+		runs.push_back({ "spheres", n });
+	}
+	for (const std::string& file : opt.models) runs.push_back({ file, 0 });
+
+	FILE* f = stdout;
+	if (!opt.out.empty() && (f = fopen(opt.out.c_str(), "w")) == NULL)
+	{
+		printf("can not open %s\n", opt.out.c_str());
+		return 1;
+	}
+
+	fprintf(f, "[\n");
+	bool first = true;
+	for (const auto& run : runs)
+	{
+		//one scene alive at a time, 1M triangle vbos are large
+		Scene scene;
+		if (run.first == "soup") scene = soupScene(run.second);
+		else if (run.first == "spheres") scene = spheresScene(run.second);
+		else if (!modelScene(run.first, scene))
+		{
+			fprintf(stderr, "Can't read model %s\n", run.first.c_str());
+			continue;
+		}
+		scene.triangles = 0;
+		for (const Mesh& m : scene.meshes) scene.triangles += m.points.size() / 3;
+		std::vector<Triangle> triangles = sceneTriangles(scene);
+		scene.meshes.clear();
+
+		float bound[6];
+		triangleBound(triangles, bound);
+
+		if (pbrt)
+		{
+			printResult(f, first, "pbrt", run.first, triangles.size(), buildPbrt(triangles, bound, opt.repeat));
+			first = false;
+		}
+		if (kdtree)
+		{
+			printResult(f, first, "kdtree", run.first, triangles.size(), buildKDTree(triangles, bound, opt.repeat));
+			first = false;
+		}
+		fflush(f);
+	}
+	fprintf(f, "\n]\n");
+
+	if (f != stdout) fclose(f);
+	return 0;
+}
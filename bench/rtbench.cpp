@@ -0,0 +1,291 @@
+//------ rtbench
+// headless end-to-end benchmark of the RTAPI pipeline.
+// renders a fixed camera path over a loaded model or a procedural scene and
+// prints one json object (build, upload, kernel times, Mrays/s by ray type,
+// peak host / device memory) so runs can be compared across commits and devices.
+//
+// rtbench [--device gpu|cpu|any|native|all] [--scene cornell|spheres|soup|<model file>]
+//         [--triangles N] [--frames N] [--warmup N] [--path orbit|dolly|static] [--out file]
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <cstddef>
+#include <random>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "Timer.h"
+#include "RayTracing.h"
+#include "BenchScenes.h"
+
+struct Options
+{
+	std::string device = "gpu";
+	std::string scene = "cornell";
+	std::string path = "orbit";
+	std::string out;
+	size_t triangles = 100000;
+	int frames = 64;
+	int warmup = 2;
+	int lights = 1;
+	std::string lightSampling = "all";
+	std::string adaptive;
+	int aa = 0;
+	std::string sampler = "sobol";
+	int denoise = 0;
+	float reproject = 1.0f;
+	float foveate = 0.0f;
+	std::string cutoff;
+};
+
+//camera of frame i on the path
+static void cameraAt(const Options& opt, const Scene& scene, int i, int frames, glm::vec3& eye, glm::vec3& center)
+{
+	float t = frames > 1 ? (float)i / (frames - 1) : 0.0f;
+	center = scene.center;
+	if (opt.path == "static")
+	{
+		eye = scene.center + glm::vec3(0, 0, scene.radius);
+	}
+	else if (opt.path == "dolly")
+	{
+		eye = scene.center + glm::vec3(0, 0, scene.radius * (1.0f - 0.6f * t));
+	}
+	else
+	{
+		float a = 2.0f * 3.14159265f * t;
+		eye = scene.center + scene.radius * glm::vec3(std::sin(a), 0.15f, std::cos(a));
+	}
+}
+
+static double peakHostBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return (double)pmc.PeakWorkingSetSize;
+	return 0.0;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss * 1024.0;
+#endif
+}
+
+static double percentile(std::vector<double> v, double q)
+{
+	if (v.empty()) return 0.0;
+	size_t rank = (size_t)(q * (v.size() - 1) + 0.5);
+	std::nth_element(v.begin(), v.begin() + rank, v.end());
+	return v[rank];
+}
+
+static void printTimes(FILE* f, const char* name, const std::vector<double>& v)
+{
+	double sum = 0.0;
+	for (double x : v) sum += x;
+	fprintf(f, "  \"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f },\n",
+		name, v.empty() ? 0.0 : sum / v.size(), percentile(v, 0.5), percentile(v, 0.99));
+}
+
+static bool parseArgs(int argc, char** argv, Options& opt)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool more = i + 1 < argc;
+		if (a == "--device" && more) opt.device = argv[++i];
+		else if (a == "--scene" && more) opt.scene = argv[++i];
+		else if (a == "--path" && more) opt.path = argv[++i];
+		else if (a == "--out" && more) opt.out = argv[++i];
+		else if (a == "--triangles" && more) opt.triangles = (size_t)atof(argv[++i]);
+		else if (a == "--frames" && more) opt.frames = atoi(argv[++i]);
+		else if (a == "--warmup" && more) opt.warmup = atoi(argv[++i]);
+		else if (a == "--lights" && more) opt.lights = atoi(argv[++i]);
+		else if (a == "--light-sampling" && more) opt.lightSampling = argv[++i];
+		else if (a == "--adaptive" && more) opt.adaptive = argv[++i];
+		else if (a == "--aa" && more) opt.aa = atoi(argv[++i]);
+		else if (a == "--sampler" && more) opt.sampler = argv[++i];
+		else if (a == "--denoise" && more) opt.denoise = atoi(argv[++i]);
+		else if (a == "--reproject" && more) opt.reproject = (float)atof(argv[++i]);
+		else if (a == "--foveate" && more) opt.foveate = (float)atof(argv[++i]);
+		else if (a == "--cutoff" && more) opt.cutoff = argv[++i];
+		else
+		{
+			printf("usage: rtbench [--device gpu|cpu|any|native|all] [--scene cornell|spheres|soup|<model>]\n"
+				"               [--triangles N] [--frames N] [--warmup N] [--path orbit|dolly|static] [--out file]\n"
+				"               [--lights N] [--light-sampling all|sampled[:rays]] [--adaptive threshold[:max]]\n"
+				"               [--aa samples] [--sampler random|stratified|sobol|r2|blue]\n"
+				"               [--denoise passes] [--reproject refresh] [--foveate radius]\n"
+				"               [--cutoff weight[:budget]]\n");
+			return false;
+		}
+	}
+	return opt.frames > 0 && opt.warmup >= 0 && opt.lights > 0 && opt.lights < RT_MAX_LIGHTS && opt.aa >= 0 && opt.denoise >= 0
+		&& opt.reproject >= 0.0f && opt.reproject <= 1.0f && opt.foveate >= 0.0f;
+}
+
+int main(int argc, char** argv)
+{
+	Options opt;
+	if (!parseArgs(argc, argv, opt)) return 1;
+
+	RTdevice device = RT_DEVICE_GPU;
+	if (opt.device == "cpu") device = RT_DEVICE_CPU;
+	else if (opt.device == "any") device = RT_DEVICE_ANY;
+	else if (opt.device == "native") device = RT_DEVICE_NATIVE;
+	else if (opt.device == "all") device = RT_DEVICE_ALL;
+
+	Timer sceneTimer;
+	sceneTimer.start();
+	Scene scene;
+	if (opt.scene == "cornell") scene = cornellScene();
+	else if (opt.scene == "spheres") scene = spheresScene(opt.triangles);
+	else if (opt.scene == "soup") scene = soupScene(opt.triangles);
+	else if (!modelScene(opt.scene, scene))
+	{
+		printf("Can't read model %s\n", opt.scene.c_str());
+		return 1;
+	}
+	scene.triangles = 0;
+	for (const Mesh& m : scene.meshes) scene.triangles += m.points.size() / 3;
+	double sceneMs = sceneTimer.getElapsedTimeInMilliSec();
+
+	if (!rtInit(device, RT_OUTPUT_HEADLESS)) return 1;
+
+	std::vector<GLuint> vbos(scene.meshes.size());
+	glGenBuffers((GLsizei)vbos.size(), vbos.data());
+	for (size_t i = 0; i < vbos.size(); i++)
+	{
+		const Mesh& mesh = scene.meshes[i];
+		glBindBuffer(GL_ARRAY_BUFFER, vbos[i]);
+		rtMaterialEXT(mesh.material, mesh.rIndex);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(PointData) * mesh.points.size(), mesh.points.data(), GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	gluPerspective(60, 4.0 / 3.0, 1, 3000.0);
+	GLfloat diffuse[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	GLfloat position[] = { scene.light.x, scene.light.y, scene.light.z, 1.0f };
+	glLightfv(GL_LIGHT1, GL_DIFFUSE, diffuse);
+	glLightfv(GL_LIGHT1, GL_POSITION, position);
+	glEnable(GL_LIGHTING);
+	glEnable(GL_LIGHT1);
+
+	//extra lights scattered through the scene, each reaching a fifth of it
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	GLfloat range[] = { scene.radius * 0.2f };
+	for (int l = 1; l < opt.lights; l++)
+	{
+		GLenum light = GL_LIGHT1 + l;
+		glm::vec3 p = scene.center + scene.radius * 0.5f * glm::vec3(unit(rng), unit(rng), unit(rng));
+		GLfloat at[] = { p.x, p.y, p.z, 1.0f };
+		glLightfv(light, GL_DIFFUSE, diffuse);
+		glLightfv(light, GL_POSITION, at);
+		glLightfv(light, RT_LIGHT_RANGE, range);
+		glEnable(light);
+	}
+	if (opt.lightSampling.compare(0, 7, "sampled") == 0)
+	{
+		size_t colon = opt.lightSampling.find(':');
+		rtLightSamplingEXT(RT_LIGHTS_SAMPLED, colon == std::string::npos ? 1 : atoi(opt.lightSampling.c_str() + colon + 1));
+	}
+	if (!opt.adaptive.empty())
+	{
+		size_t colon = opt.adaptive.find(':');
+		rtAdaptiveSamplingEXT((float)atof(opt.adaptive.c_str()), colon == std::string::npos ? 64 : atoi(opt.adaptive.c_str() + colon + 1));
+	}
+	if (opt.aa > 0) rtAntialiasEXT(opt.aa);
+	static const char* samplers[] = { "random", "stratified", "sobol", "r2", "blue" };
+	for (int k = 0; k < 5; k++)
+		if (opt.sampler == samplers[k]) rtSamplerEXT((RTsampler)k);
+	if (opt.denoise > 0) rtDenoiseEXT(opt.denoise);
+	if (opt.reproject < 1.0f) rtReprojectionEXT(opt.reproject);
+	if (opt.foveate > 0.0f) rtFoveationEXT(0.5f, 0.5f, opt.foveate);
+	if (!opt.cutoff.empty())
+	{
+		size_t colon = opt.cutoff.find(':');
+		rtPathTerminationEXT((float)atof(opt.cutoff.c_str()), colon == std::string::npos ? 0 : atoi(opt.cutoff.c_str() + colon + 1));
+	}
+
+	glEnable(GL_COLOR_MATERIAL);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+
+	std::vector<double> ingest, upload, kernel, frame;
+	double buildMs = 0.0, peakDevice = 0.0, imageFallbacks = 0.0;
+	double rays[4] = { 0, 0, 0, 0 }, kernelTotal = 0.0;
+
+	int total = opt.warmup + opt.frames;
+	for (int i = 0; i < total; i++)
+	{
+		glm::vec3 eye, center;
+		cameraAt(opt, scene, std::max(i - opt.warmup, 0), opt.frames, eye, center);
+		gluLookAt(eye.x, eye.y, eye.z, center.x, center.y, center.z, 0, 1, 0);
+
+		for (size_t m = 0; m < vbos.size(); m++)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, vbos[m]);
+			glVertexPointer(3, GL_FLOAT, sizeof(PointData), (void*)offsetof(PointData, v));
+			glNormalPointer(GL_FLOAT, sizeof(PointData), (void*)offsetof(PointData, n));
+			glColorPointer(3, GL_FLOAT, sizeof(PointData), (void*)offsetof(PointData, c));
+			glDrawArrays(GL_TRIANGLES, 0, (GLsizei)scene.meshes[m].points.size());
+		}
+		rtBuildKDtreeCurrentSceneEXT();
+		glFlush();
+
+		RTframeStats stats;
+		rtGetFrameStatsEXT(&stats);
+		buildMs += stats.buildMs;
+		peakDevice = std::max(peakDevice, stats.deviceBytes);
+		imageFallbacks += stats.imageFallbacks;
+		if (i < opt.warmup) continue;
+
+		ingest.push_back(stats.ingestMs);
+		upload.push_back(stats.uploadMs);
+		kernel.push_back(stats.kernelMs);
+		frame.push_back(stats.frameMs);
+		rays[0] += stats.primaryRays;
+		rays[1] += stats.reflectRays;
+		rays[2] += stats.refractRays;
+		rays[3] += stats.shadowRays;
+		kernelTotal += stats.kernelMs;
+	}
+
+	//rays per microsecond of kernel time = Mrays/s
+	double us = std::max(kernelTotal * 1000.0, 1e-6);
+
+	FILE* f = stdout;
+	if (!opt.out.empty() && (f = fopen(opt.out.c_str(), "w")) == NULL)
+	{
+		printf("can not open %s\n", opt.out.c_str());
+		return 1;
+	}
+
+	fprintf(f, "{\n");
+	fprintf(f, "  \"device\": \"%s\",\n  \"scene\": \"%s\",\n  \"path\": \"%s\",\n", opt.device.c_str(), opt.scene.c_str(), opt.path.c_str());
+	fprintf(f, "  \"triangles\": %zu,\n  \"frames\": %d,\n  \"warmup\": %d,\n", scene.triangles, opt.frames, opt.warmup);
+	fprintf(f, "  \"scene_ms\": %.4f,\n  \"build_ms\": %.4f,\n", sceneMs, buildMs);
+	printTimes(f, "ingest_ms", ingest);
+	printTimes(f, "upload_ms", upload);
+	printTimes(f, "kernel_ms", kernel);
+	printTimes(f, "frame_ms", frame);
+	fprintf(f, "  \"mrays_per_s\": { \"primary\": %.4f, \"reflect\": %.4f, \"refract\": %.4f, \"shadow\": %.4f, \"total\": %.4f },\n",
+		rays[0] / us, rays[1] / us, rays[2] / us, rays[3] / us, (rays[0] + rays[1] + rays[2] + rays[3]) / us);
+	fprintf(f, "  \"image_fallbacks\": %.0f,\n", imageFallbacks);
+	fprintf(f, "  \"peak_host_bytes\": %.0f,\n  \"peak_device_bytes\": %.0f\n}\n", peakHostBytes(), peakDevice);
+
+	if (f != stdout) fclose(f);
+	return 0;
+}
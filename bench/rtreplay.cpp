@@ -0,0 +1,231 @@
+//------ rtreplay
+// feeds an rtCaptureEXT / RTAPI_CAPTURE file back into the library headless,
+// as fast as it renders, and prints one json object with the frame times
+// like rtbench. reproduces an application's workload without the application.
+//
+// rtreplay <capture> [--device gpu|cpu|any|native|all|captured] [--warmup N]
+//          [--frames N] [--image file.ppm] [--out file]
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "Timer.h"
+#include "RayTracing.h"
+#include "Capture.h"
+
+struct Options
+{
+	std::string capture;
+	std::string device = "captured";
+	std::string image;
+	std::string out;
+	int warmup = 0;
+	int frames = 0;   //0 = every frame of the capture
+};
+
+static double percentile(std::vector<double> v, double q)
+{
+	if (v.empty()) return 0.0;
+	size_t rank = (size_t)(q * (v.size() - 1) + 0.5);
+	std::nth_element(v.begin(), v.begin() + rank, v.end());
+	return v[rank];
+}
+
+static void printTimes(FILE* f, const char* name, const std::vector<double>& v)
+{
+	double sum = 0.0;
+	for (double x : v) sum += x;
+	fprintf(f, "  \"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f },\n",
+		name, v.empty() ? 0.0 : sum / v.size(), percentile(v, 0.5), percentile(v, 0.99));
+}
+
+//last frame as a binary ppm
+static bool writeImage(const std::string& file)
+{
+	const unsigned width = 800, height = 600;
+	std::vector<unsigned char> rgba(width * height * 4);
+	rtReadPixelsEXT(GL_UNSIGNED_BYTE, rgba.data());
+
+	FILE* f = fopen(file.c_str(), "wb");
+	if (f == NULL) return false;
+	fprintf(f, "P6\n%u %u\n255\n", width, height);
+	for (size_t i = 0; i < width * height; i++) fwrite(&rgba[i * 4], 1, 3, f);
+	fclose(f);
+	return true;
+}
+
+static bool parseArgs(int argc, char** argv, Options& opt)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool more = i + 1 < argc;
+		if (a == "--device" && more) opt.device = argv[++i];
+		else if (a == "--warmup" && more) opt.warmup = atoi(argv[++i]);
+		else if (a == "--frames" && more) opt.frames = atoi(argv[++i]);
+		else if (a == "--image" && more) opt.image = argv[++i];
+		else if (a == "--out" && more) opt.out = argv[++i];
+		else if (opt.capture.empty() && a[0] != '-') opt.capture = a;
+		else
+		{
+			opt.capture.clear();
+			break;
+		}
+	}
+	if (opt.capture.empty())
+	{
+		printf("usage: rtreplay <capture> [--device gpu|cpu|any|native|all|captured] [--warmup N]\n"
+			"                [--frames N] [--image file.ppm] [--out file]\n");
+		return false;
+	}
+	return opt.warmup >= 0 && opt.frames >= 0;
+}
+
+int main(int argc, char** argv)
+{
+	Options opt;
+	if (!parseArgs(argc, argv, opt)) return 1;
+
+	CaptureReader reader;
+	if (!reader.Open(opt.capture.c_str()))
+	{
+		printf("%s\n", reader.Error().c_str());
+		return 1;
+	}
+
+	std::vector<double> ingest, upload, kernel, frame;
+	double buildMs = 0.0, peakDevice = 0.0;
+	double rays = 0.0, kernelTotal = 0.0;
+	int flushed = 0, draws = 0;
+	size_t bufferBytes = 0;
+
+	Timer wall;
+	wall.start();
+	CaptureRecord r;
+	while (reader.Next(r))
+	{
+		const int* i = r.i;
+		const double* d = r.d;
+		switch (r.op)
+		{
+		case CAPTURE_INIT:
+		{
+			//always headless, the capture may come from a window
+			RTdevice device = (RTdevice)i[0];
+			if (opt.device == "gpu") device = RT_DEVICE_GPU;
+			else if (opt.device == "cpu") device = RT_DEVICE_CPU;
+			else if (opt.device == "any") device = RT_DEVICE_ANY;
+			else if (opt.device == "native") device = RT_DEVICE_NATIVE;
+			else if (opt.device == "all") device = RT_DEVICE_ALL;
+			if (!rtInit(device, RT_OUTPUT_HEADLESS)) return 1;
+			break;
+		}
+		case CAPTURE_GEN_BUFFERS:
+		{
+			std::vector<GLuint> ids(std::max(i[0], 0));
+			glGenBuffers(i[0], ids.data());
+			break;
+		}
+		case CAPTURE_BIND_BUFFER: glBindBuffer(i[0], i[1]); break;
+		case CAPTURE_BUFFER_DATA:
+			glBufferData(i[0], r.data.size(), i[2] != 0 ? r.data.data() : NULL, i[1]);
+			bufferBytes += r.data.size();
+			break;
+		case CAPTURE_VERTEX_POINTER: glVertexPointer(i[0], i[1], i[2], (const GLvoid*)(size_t)r.offset); break;
+		case CAPTURE_COLOR_POINTER: glColorPointer(i[0], i[1], i[2], (const GLvoid*)(size_t)r.offset); break;
+		case CAPTURE_NORMAL_POINTER: glNormalPointer(i[1], i[2], (const GLvoid*)(size_t)r.offset); break;
+		case CAPTURE_DRAW_ARRAYS: glDrawArrays(i[0], i[1], i[2]); draws++; break;
+		case CAPTURE_ENABLE_CLIENT: glEnableClientState(i[0]); break;
+		case CAPTURE_DISABLE_CLIENT: glDisableClientState(i[0]); break;
+		case CAPTURE_ENABLE: glEnable(i[0]); break;
+		case CAPTURE_DISABLE: glDisable(i[0]); break;
+		case CAPTURE_PERSPECTIVE: gluPerspective(d[0], d[1], d[2], d[3]); break;
+		case CAPTURE_LOOK_AT: gluLookAt(d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7], d[8]); break;
+		case CAPTURE_LIGHT:
+		{
+			//only the values the pname takes were recorded
+			GLfloat params[4] = { 0, 0, 0, 0 };
+			for (int k = 0; k < std::min(std::max(i[2], 0), 4); k++) params[k] = (GLfloat)d[k];
+			glLightfv(i[0], i[1], params);
+			break;
+		}
+		case CAPTURE_MATERIAL: rtMaterialEXT((RTenum)i[0], (float)d[0]); break;
+		case CAPTURE_BUILD_KDTREE: rtBuildKDtreeCurrentSceneEXT(); break;
+		case CAPTURE_INVALIDATE_KDTREE: rtInvalidateKDtreeEXT(); break;
+		case CAPTURE_DISPATCH: rtDispatchEXT((RTdispatch)i[0]); break;
+		case CAPTURE_TRAVERSAL: rtTraversalEXT((RTtraversal)i[0]); break;
+		case CAPTURE_FETCH: rtFetchEXT((RTfetch)i[0]); break;
+		case CAPTURE_SCHEDULE: rtScheduleEXT((RTschedule)i[0]); break;
+		case CAPTURE_LIGHT_SAMPLING: rtLightSamplingEXT((RTlightSampling)i[0], i[1]); break;
+		case CAPTURE_ADAPTIVE: rtAdaptiveSamplingEXT((float)d[0], (int)d[1]); break;
+		case CAPTURE_ANTIALIAS: rtAntialiasEXT(i[0]); break;
+		case CAPTURE_SAMPLER: rtSamplerEXT((RTsampler)i[0]); break;
+		case CAPTURE_DENOISE: rtDenoiseEXT(i[0]); break;
+		case CAPTURE_REPROJECTION: rtReprojectionEXT((float)d[0]); break;
+		case CAPTURE_PATH_TERMINATION: rtPathTerminationEXT((float)d[0], (int)d[1]); break;
+		case CAPTURE_FOVEATION: rtFoveationEXT((float)d[0], (float)d[1], (float)d[2]); break;
+		case CAPTURE_RATE_MAP: rtRateMapEXT(r.data.empty() ? NULL : (const unsigned char*)r.data.data(), i[0], i[1]); break;
+		case CAPTURE_MODELVIEW:
+		{
+			GLfloat m[16];
+			for (int k = 0; k < 16; k++) m[k] = (GLfloat)d[k];
+			rtModelviewEXT(m);
+			break;
+		}
+		case CAPTURE_FLUSH:
+		{
+			glFlush();
+			RTframeStats stats;
+			rtGetFrameStatsEXT(&stats);
+			buildMs += stats.buildMs;
+			peakDevice = std::max(peakDevice, stats.deviceBytes);
+			if (flushed++ < opt.warmup) break;
+
+			ingest.push_back(stats.ingestMs);
+			upload.push_back(stats.uploadMs);
+			kernel.push_back(stats.kernelMs);
+			frame.push_back(stats.frameMs);
+			rays += stats.primaryRays + stats.reflectRays + stats.refractRays + stats.shadowRays;
+			kernelTotal += stats.kernelMs;
+			break;
+		}
+		default:
+			break;
+		}
+		if (opt.frames > 0 && (int)frame.size() >= opt.frames) break;
+	}
+	double wallMs = wall.getElapsedTimeInMilliSec();
+
+	if (!reader.Error().empty()) printf("%s, replayed up to it\n", reader.Error().c_str());
+	if (flushed == 0)
+	{
+		printf("%s has no frames\n", opt.capture.c_str());
+		return 1;
+	}
+	if (!opt.image.empty() && !writeImage(opt.image)) printf("can not write %s\n", opt.image.c_str());
+
+	FILE* f = stdout;
+	if (!opt.out.empty() && (f = fopen(opt.out.c_str(), "w")) == NULL)
+	{
+		printf("can not open %s\n", opt.out.c_str());
+		return 1;
+	}
+
+	double us = std::max(kernelTotal * 1000.0, 1e-6);
+	fprintf(f, "{\n");
+	fprintf(f, "  \"capture\": \"%s\",\n  \"device\": \"%s\",\n", opt.capture.c_str(), opt.device.c_str());
+	fprintf(f, "  \"frames\": %d,\n  \"warmup\": %d,\n  \"draws\": %d,\n  \"buffer_bytes\": %zu,\n",
+		(int)frame.size(), std::min(flushed, opt.warmup), draws, bufferBytes);
+	fprintf(f, "  \"wall_ms\": %.4f,\n  \"build_ms\": %.4f,\n", wallMs, buildMs);
+	printTimes(f, "ingest_ms", ingest);
+	printTimes(f, "upload_ms", upload);
+	printTimes(f, "kernel_ms", kernel);
+	printTimes(f, "frame_ms", frame);
+	fprintf(f, "  \"mrays_per_s\": %.4f,\n  \"peak_device_bytes\": %.0f\n}\n", rays / us, peakDevice);
+
+	if (f != stdout) fclose(f);
+	return 0;
+}
@@ -0,0 +1,344 @@
+//------ rtregress
+// image regression and kernel time gate for RayTracing.cl.
+// renders fixed reference cases through the headless path and compares every
+// frame to a golden image (8 bit ppm). with --time its median kernel time is
+// also held to the recorded baseline. exits 1 if any case changed or got
+// slower than allowed, so it can run after each change to the kernel, and
+// 77 if the device is missing.
+// defaults to RT_DEVICE_CPU, any cpu opencl (pocl, intel cpu runtime) will do.
+// the goldens are shared, the native tracer renders the kernel's image.
+// kernel time baselines depend on the machine, they are not committed:
+// --update --time records kernel_ms_<device>.txt next to the goldens.
+//
+// rtregress [--update] [--time] [--device gpu|cpu|any|native] [--golden dir] [--actual dir]
+//           [--case name] [--frames N] [--rmse levels] [--bad fraction] [--pixel levels]
+//           [--slack fraction] [--max-kernel-ms ms]
+
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstddef>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "RayTracing.h"
+#include "BenchScenes.h"
+
+//exit code without the device, ctest reports the test as skipped
+#define RTREGRESS_NO_DEVICE 77
+
+#ifndef RTREGRESS_GOLDEN
+#define RTREGRESS_GOLDEN "golden"
+#endif
+
+//frame size of the library
+static const unsigned WIDTH = 800, HEIGHT = 600;
+
+struct Options
+{
+	bool update = false;
+	bool time = false;      //kernel time gate against the recorded baseline
+	std::string device = "cpu";
+	std::string golden = RTREGRESS_GOLDEN;
+	std::string actual;
+	std::string only;
+	int frames = 5;
+	double rmse = 1.0;      //max root mean square error, in 8 bit levels
+	double bad = 0.001;     //max fraction of pixels off by more than pixel
+	int pixel = 16;         //8 bit levels a channel may differ before its pixel is bad
+	double slack = 0.25;    //max kernel time growth over the baseline
+	double maxKernelMs = 0; //absolute kernel limit, 0 = off
+};
+
+//a reference case: scene, camera and light
+struct Case
+{
+	const char* name;
+	const char* scene;
+	size_t triangles;
+	float yaw;      //degrees around the scene center, 0 looks down -z
+	float pitch;
+	float distance; //in scene radii
+};
+
+//cover every material, shadows, the kd-tree kernel on dense and sparse sets
+static const Case Cases[] = {
+	{ "cornell_front", "cornell", 0, 0.0f, 0.0f, 1.0f },
+	{ "cornell_corner", "cornell", 0, 35.0f, 15.0f, 1.0f },
+	{ "spheres_20k", "spheres", 20000, 20.0f, 10.0f, 1.2f },
+	{ "soup_50k", "soup", 50000, -30.0f, 20.0f, 1.5f },
+};
+
+struct Result
+{
+	double rmse;
+	double bad;
+	double kernelMs;
+};
+
+static void makeDir(const std::string& dir)
+{
+#ifdef _WIN32
+	_mkdir(dir.c_str());
+#else
+	mkdir(dir.c_str(), 0755);
+#endif
+}
+
+static bool writePPM(const std::string& file, const std::vector<unsigned char>& rgba)
+{
+	FILE* f = fopen(file.c_str(), "wb");
+	if (f == NULL)
+	{
+		printf("can not write %s\n", file.c_str());
+		return false;
+	}
+	fprintf(f, "P6\n%u %u\n255\n", WIDTH, HEIGHT);
+	std::vector<unsigned char> rgb(WIDTH * HEIGHT * 3);
+	for (size_t i = 0; i < WIDTH * HEIGHT; i++)
+	{
+		rgb[i * 3 + 0] = rgba[i * 4 + 0];
+		rgb[i * 3 + 1] = rgba[i * 4 + 1];
+		rgb[i * 3 + 2] = rgba[i * 4 + 2];
+	}
+	fwrite(rgb.data(), 1, rgb.size(), f);
+	fclose(f);
+	return true;
+}
+
+//only the P6 files writePPM makes
+static bool readPPM(const std::string& file, std::vector<unsigned char>& rgb)
+{
+	FILE* f = fopen(file.c_str(), "rb");
+	if (f == NULL) return false;
+	unsigned w = 0, h = 0, maxval = 0;
+	bool ok = fscanf(f, "P6 %u %u %u", &w, &h, &maxval) == 3 && fgetc(f) != EOF
+		&& w == WIDTH && h == HEIGHT && maxval == 255;
+	if (ok)
+	{
+		rgb.resize(WIDTH * HEIGHT * 3);
+		ok = fread(rgb.data(), 1, rgb.size(), f) == rgb.size();
+	}
+	fclose(f);
+	return ok;
+}
+
+//case name -> median kernel ms
+static std::map<std::string, double> readBaselines(const std::string& file)
+{
+	std::map<std::string, double> baselines;
+	FILE* f = fopen(file.c_str(), "r");
+	if (f == NULL) return baselines;
+	char name[256];
+	double ms;
+	while (fscanf(f, "%255s %lf", name, &ms) == 2) baselines[name] = ms;
+	fclose(f);
+	return baselines;
+}
+
+static bool writeBaselines(const std::string& file, const std::map<std::string, double>& baselines)
+{
+	FILE* f = fopen(file.c_str(), "w");
+	if (f == NULL)
+	{
+		printf("can not write %s\n", file.c_str());
+		return false;
+	}
+	for (const auto& b : baselines) fprintf(f, "%s %.4f\n", b.first.c_str(), b.second);
+	fclose(f);
+	return true;
+}
+
+//draw the case for opt.frames frames, keep the last image and the median kernel time
+static double renderCase(const Options& opt, const Case& c, std::vector<unsigned char>& rgba)
+{
+	Scene scene;
+	if (std::string(c.scene) == "cornell") scene = cornellScene();
+	else if (std::string(c.scene) == "spheres") scene = spheresScene(c.triangles);
+	else scene = soupScene(c.triangles);
+
+	std::vector<GLuint> vbos(scene.meshes.size());
+	glGenBuffers((GLsizei)vbos.size(), vbos.data());
+	for (size_t i = 0; i < vbos.size(); i++)
+	{
+		const Mesh& mesh = scene.meshes[i];
+		glBindBuffer(GL_ARRAY_BUFFER, vbos[i]);
+		rtMaterialEXT(mesh.material, mesh.rIndex);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(PointData) * mesh.points.size(), mesh.points.data(), GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	GLfloat position[] = { scene.light.x, scene.light.y, scene.light.z, 1.0f };
+	glLightfv(GL_LIGHT1, GL_POSITION, position);
+
+	float yaw = glm::radians(c.yaw), pitch = glm::radians(c.pitch);
+	glm::vec3 dir(std::sin(yaw) * std::cos(pitch), std::sin(pitch), std::cos(yaw) * std::cos(pitch));
+	glm::vec3 eye = scene.center + scene.radius * c.distance * dir;
+	gluLookAt(eye.x, eye.y, eye.z, scene.center.x, scene.center.y, scene.center.z, 0, 1, 0);
+
+	//the tree of the previous case must not be reused
+	rtInvalidateKDtreeEXT();
+
+	std::vector<double> kernel;
+	for (int i = 0; i < opt.frames; i++)
+	{
+		for (size_t m = 0; m < vbos.size(); m++)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, vbos[m]);
+			glVertexPointer(3, GL_FLOAT, sizeof(PointData), (void*)offsetof(PointData, v));
+			glNormalPointer(GL_FLOAT, sizeof(PointData), (void*)offsetof(PointData, n));
+			glColorPointer(3, GL_FLOAT, sizeof(PointData), (void*)offsetof(PointData, c));
+			glDrawArrays(GL_TRIANGLES, 0, (GLsizei)scene.meshes[m].points.size());
+		}
+		rtBuildKDtreeCurrentSceneEXT();
+		glFlush();
+
+		RTframeStats stats;
+		rtGetFrameStatsEXT(&stats);
+		kernel.push_back(stats.kernelMs);
+	}
+
+	rgba.resize(WIDTH * HEIGHT * 4);
+	rtReadPixelsEXT(GL_UNSIGNED_BYTE, rgba.data());
+
+	std::nth_element(kernel.begin(), kernel.begin() + kernel.size() / 2, kernel.end());
+	return kernel[kernel.size() / 2];
+}
+
+static Result compare(const Options& opt, const std::vector<unsigned char>& rgba, const std::vector<unsigned char>& golden)
+{
+	Result r = { 0.0, 0.0, 0.0 };
+	double sum = 0.0;
+	size_t bad = 0;
+	for (size_t i = 0; i < WIDTH * HEIGHT; i++)
+	{
+		int worst = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			int d = std::abs((int)rgba[i * 4 + k] - (int)golden[i * 3 + k]);
+			sum += d * d;
+			worst = std::max(worst, d);
+		}
+		if (worst > opt.pixel) bad++;
+	}
+	r.rmse = std::sqrt(sum / (WIDTH * HEIGHT * 3.0));
+	r.bad = bad / (double)(WIDTH * HEIGHT);
+	return r;
+}
+
+static bool parseArgs(int argc, char** argv, Options& opt)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool more = i + 1 < argc;
+		if (a == "--update") opt.update = true;
+		else if (a == "--time") opt.time = true;
+		else if (a == "--device" && more) opt.device = argv[++i];
+		else if (a == "--golden" && more) opt.golden = argv[++i];
+		else if (a == "--actual" && more) opt.actual = argv[++i];
+		else if (a == "--case" && more) opt.only = argv[++i];
+		else if (a == "--frames" && more) opt.frames = atoi(argv[++i]);
+		else if (a == "--rmse" && more) opt.rmse = atof(argv[++i]);
+		else if (a == "--bad" && more) opt.bad = atof(argv[++i]);
+		else if (a == "--pixel" && more) opt.pixel = atoi(argv[++i]);
+		else if (a == "--slack" && more) opt.slack = atof(argv[++i]);
+		else if (a == "--max-kernel-ms" && more) opt.maxKernelMs = atof(argv[++i]);
+		else
+		{
+			printf("usage: rtregress [--update] [--time] [--device gpu|cpu|any|native] [--golden dir] [--actual dir]\n"
+				"                 [--case name] [--frames N] [--rmse levels] [--bad fraction] [--pixel levels]\n"
+				"                 [--slack fraction] [--max-kernel-ms ms]\n");
+			return false;
+		}
+	}
+	return opt.frames > 0;
+}
+
+int main(int argc, char** argv)
+{
+	Options opt;
+	if (!parseArgs(argc, argv, opt)) return 1;
+
+	RTdevice device = RT_DEVICE_CPU;
+	if (opt.device == "gpu") device = RT_DEVICE_GPU;
+	else if (opt.device == "any") device = RT_DEVICE_ANY;
+	else if (opt.device == "native") device = RT_DEVICE_NATIVE;
+
+	if (!rtInit(device, RT_OUTPUT_HEADLESS)) return RTREGRESS_NO_DEVICE;
+	gluPerspective(60, 4.0 / 3.0, 1, 3000.0);
+	GLfloat diffuse[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glLightfv(GL_LIGHT1, GL_DIFFUSE, diffuse);
+	glEnable(GL_LIGHTING);
+	glEnable(GL_LIGHT1);
+	glEnable(GL_COLOR_MATERIAL);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+
+	if (opt.update) makeDir(opt.golden);
+	if (!opt.actual.empty()) makeDir(opt.actual);
+	std::string baselineFile = opt.golden + "/kernel_ms_" + opt.device + ".txt";
+	std::map<std::string, double> baselines = readBaselines(baselineFile);
+
+	int failed = 0, run = 0;
+	for (const Case& c : Cases)
+	{
+		if (!opt.only.empty() && opt.only != c.name) continue;
+		run++;
+
+		std::vector<unsigned char> rgba;
+		double kernelMs = renderCase(opt, c, rgba);
+		std::string goldenFile = opt.golden + "/" + c.name + ".ppm";
+		if (!opt.actual.empty()) writePPM(opt.actual + "/" + c.name + ".ppm", rgba);
+
+		if (opt.update)
+		{
+			if (!writePPM(goldenFile, rgba)) return 1;
+			if (opt.time) baselines[c.name] = kernelMs;
+			printf("%-16s updated  kernel %.3f ms\n", c.name, kernelMs);
+			continue;
+		}
+
+		std::vector<unsigned char> golden;
+		if (!readPPM(goldenFile, golden))
+		{
+			printf("%-16s FAIL     no golden %s, run with --update\n", c.name, goldenFile.c_str());
+			failed++;
+			continue;
+		}
+
+		Result r = compare(opt, rgba, golden);
+		r.kernelMs = kernelMs;
+		bool imageOk = r.rmse <= opt.rmse && r.bad <= opt.bad;
+
+		//kernel gate: slack over the recorded baseline and the absolute limit
+		bool kernelOk = true;
+		double baseline = (opt.time && baselines.count(c.name)) ? baselines[c.name] : 0.0;
+		if (baseline > 0.0 && r.kernelMs > baseline * (1.0 + opt.slack)) kernelOk = false;
+		if (opt.maxKernelMs > 0.0 && r.kernelMs > opt.maxKernelMs) kernelOk = false;
+
+		printf("%-16s %-8s rmse %.3f  bad %.5f  kernel %.3f ms (baseline %.3f)%s%s\n", c.name,
+			imageOk && kernelOk ? "ok" : "FAIL", r.rmse, r.bad, r.kernelMs, baseline,
+			imageOk ? "" : "  image changed", kernelOk ? "" : "  kernel slower");
+		if (!imageOk || !kernelOk) failed++;
+	}
+
+	if (opt.update) return !opt.time || writeBaselines(baselineFile, baselines) ? 0 : 1;
+
+	if (run == 0)
+	{
+		printf("no case named %s\n", opt.only.c_str());
+		return 1;
+	}
+	printf("%d of %d cases failed\n", failed, run);
+	return failed > 0 ? 1 : 0;
+}